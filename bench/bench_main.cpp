@@ -0,0 +1,555 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#define main airspyhf_decimator_program_main
+#include "../src/main.cpp"
+#undef main
+
+namespace {
+
+constexpr double kBenchInputRateHz = 768000.0;
+constexpr std::size_t kBenchBlockSamples = 16384;
+
+struct BenchConfig {
+    double seconds = 20.0;
+};
+
+std::vector<uint8_t> makeBenchPayload(std::size_t samples) {
+    std::vector<uint8_t> payload(samples * kBytesPerIQ);
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    for (std::size_t index = 0; index < samples; ++index) {
+        const double phase = kTwoPi * -9000.0 * static_cast<double>(index) /
+                             kBenchInputRateHz;
+        const float i = 0.5f * static_cast<float>(std::cos(phase)) + noise(rng);
+        const float q = 0.5f * static_cast<float>(std::sin(phase)) + noise(rng);
+        std::memcpy(payload.data() + index * kBytesPerIQ, &i, sizeof(float));
+        std::memcpy(payload.data() + index * kBytesPerIQ + sizeof(float), &q,
+                    sizeof(float));
+    }
+    return payload;
+}
+
+void printRow(const std::string &name, uint64_t samples, double elapsedSec) {
+    const double sps = static_cast<double>(samples) / elapsedSec;
+    std::printf("%-34s %10.2f Msps %8.1fx realtime %8.2f ns/sample\n",
+                name.c_str(), sps / 1e6, sps / kBenchInputRateHz,
+                1e9 / sps);
+}
+
+// Parse + shift + three-stage decimation per ZMQ-sized block, for one
+// sample/accumulator type.
+template <typename Sample>
+void benchChain(const BenchConfig &config, const char *name) {
+    const auto payload = makeBenchPayload(kBenchBlockSamples);
+    const uint64_t totalSamples =
+        static_cast<uint64_t>(config.seconds * kBenchInputRateHz);
+
+    SampleBuffer<Sample> block;
+    BasicFrequencyShifter<Sample> shifter(kBenchInputRateHz, 10000.0);
+    BasicFirDecimator<Sample> stage1(8, 8 * 16, 0.45f / 8.0f);
+    BasicFirDecimator<Sample> stage2(5, 5 * 16, 0.45f / 5.0f);
+    BasicFirDecimator<Sample> stage3(5, 5 * 16, 0.45f / 5.0f);
+
+    uint64_t processed = 0;
+    std::size_t produced = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (processed < totalSamples) {
+        convertToComplex(payload.data(), payload.size(), block);
+        shifter.mix(block);
+        produced += stage3.process(stage2.process(stage1.process(block))).size();
+        processed += block.size();
+    }
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    if (produced == 0) {
+        throw std::runtime_error("benchmark chain produced no output");
+    }
+    printRow(name, processed, elapsed);
+}
+
+void benchChainCf32(const BenchConfig &config) {
+    benchChain<cf32>(config, "chain cf32 (float acc)");
+}
+
+void benchChainCf64(const BenchConfig &config) {
+    benchChain<cf64>(config, "chain cf64 (double reference)");
+}
+
+void benchChainCi16(const BenchConfig &config) {
+    benchChain<ci16>(config, "chain ci16 (Q15 coeff, int64 acc)");
+}
+
+// The --arith fixed path: Q15 parse, integer NCO, saturating 32-bit MACs,
+// and float conversion only for the decimated output.
+void benchChainFixed(const BenchConfig &config) {
+    const auto payload = makeBenchPayload(kBenchBlockSamples);
+    const uint64_t totalSamples =
+        static_cast<uint64_t>(config.seconds * kBenchInputRateHz);
+
+    SampleBuffer<ci16> block;
+    FixedPointChain chain(kBenchInputRateHz, 10000.0);
+    uint64_t processed = 0;
+    std::size_t produced = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (processed < totalSamples) {
+        convertToComplex(payload.data(), payload.size(), block);
+        chain.shifter.mix(block);
+        produced += toFloatSamples(chain.stage3.process(chain.stage2.process(
+                                       chain.stage1.process(block))))
+                        .size();
+        processed += block.size();
+    }
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    if (produced == 0) {
+        throw std::runtime_error("benchmark chain produced no output");
+    }
+    printRow("chain fixed (Q15, sat int32 acc)", processed, elapsed);
+}
+
+// Stage 1 alone, sequential versus split across threads per block with
+// processSegmented(); the outputs are bit-identical, only the time differs.
+void benchStage1Parallel(const BenchConfig &config) {
+    const auto payload = makeBenchPayload(kBenchBlockSamples);
+    const uint64_t totalSamples =
+        static_cast<uint64_t>(config.seconds * kBenchInputRateHz);
+    SampleVector block;
+    convertToComplex(payload.data(), payload.size(), block);
+
+    std::vector<std::size_t> threadCounts = {1};
+    for (const std::size_t threads :
+         {std::size_t{2}, std::size_t{std::thread::hardware_concurrency()}}) {
+        if (threads > threadCounts.back()) {
+            threadCounts.push_back(threads);
+        }
+    }
+    for (const std::size_t threads : threadCounts) {
+        ForkJoinPool pool(threads);
+        FirDecimator stage1(8, 8 * 16, 0.45f / 8.0f);
+        const auto forEachSegment = [&pool](std::size_t outputs,
+                                            const auto &segment) {
+            const std::size_t parts = pool.threads();
+            pool.run(parts, [&](std::size_t part) {
+                segment(outputs * part / parts, outputs * (part + 1) / parts);
+            });
+        };
+        uint64_t processed = 0;
+        std::size_t produced = 0;
+        const auto start = std::chrono::steady_clock::now();
+        while (processed < totalSamples) {
+            produced += (threads == 1)
+                            ? stage1.process(block).size()
+                            : stage1
+                                  .processSegmented(block.data(), block.size(),
+                                                    forEachSegment)
+                                  .size();
+            processed += block.size();
+        }
+        const double elapsed = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+        if (produced == 0) {
+            throw std::runtime_error("benchmark stage 1 produced no output");
+        }
+        printRow("stage1 " + std::to_string(threads) + " thread(s)", processed,
+                 elapsed);
+    }
+}
+
+// The stage-1 engines alone and in the float chain: the 129-tap FIR
+// against three allpass halfbands (IirStage1Decimator).
+void benchStage1Iir(const BenchConfig &config) {
+    const auto payload = makeBenchPayload(kBenchBlockSamples);
+    const uint64_t totalSamples =
+        static_cast<uint64_t>(config.seconds * kBenchInputRateHz);
+    SampleVector source;
+    convertToComplex(payload.data(), payload.size(), source);
+
+    for (const bool iir : {false, true}) {
+        for (const bool chain : {false, true}) {
+            FirDecimator firStage1(8, 8 * 16, 0.45f / 8.0f);
+            IirStage1Decimator iirStage1;
+            FrequencyShifter shifter(kBenchInputRateHz, 10000.0);
+            FirDecimator stage2(5, 5 * 16, 0.45f / 5.0f);
+            FirDecimator stage3(5, 5 * 16, 0.45f / 5.0f);
+            SampleVector block = source;
+            uint64_t processed = 0;
+            std::size_t produced = 0;
+            const auto start = std::chrono::steady_clock::now();
+            while (processed < totalSamples) {
+                if (chain) {
+                    block = source;
+                    shifter.mix(block);
+                }
+                auto afterStage1 = iir ? iirStage1.process(block)
+                                       : firStage1.process(block);
+                produced += chain ? stage3.process(stage2.process(afterStage1))
+                                        .size()
+                                  : afterStage1.size();
+                processed += block.size();
+            }
+            const double elapsed = std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count();
+            if (produced == 0) {
+                throw std::runtime_error("benchmark stage 1 produced no output");
+            }
+            printRow(std::string(chain ? "chain" : "stage1") + " cf32 " +
+                         (iir ? "iir" : "fir") + " stage 1",
+                     processed, elapsed);
+        }
+    }
+}
+
+// Quiet or gated input: a tone decaying from 1e-30 through the subnormal
+// range to zero within each block, and exact silence. Each runs with
+// gradual underflow (ieee) and with FTZ/DAZ (flush).
+void benchDenormals(const BenchConfig &config) {
+    SampleVector decaying(kBenchBlockSamples);
+    for (std::size_t index = 0; index < decaying.size(); ++index) {
+        const double amplitude =
+            1e-30 * std::exp2(-53.0 * static_cast<double>(index) /
+                              static_cast<double>(decaying.size()));
+        const double phase = kTwoPi * -9000.0 * static_cast<double>(index) /
+                             kBenchInputRateHz;
+        decaying[index] = {static_cast<float>(amplitude * std::cos(phase)),
+                           static_cast<float>(amplitude * std::sin(phase))};
+    }
+    const SampleVector silent(kBenchBlockSamples);
+    if (!flushDenormalsSupported()) {
+        throw std::runtime_error("FTZ/DAZ is not supported on this target");
+    }
+    const uint64_t totalSamples =
+        static_cast<uint64_t>(config.seconds * kBenchInputRateHz);
+    const bool previousMode = flushDenormalsEnabled();
+
+    for (const auto &[inputName, source] :
+         {std::pair<const char *, const SampleVector *>{"decay", &decaying},
+          std::pair<const char *, const SampleVector *>{"silent", &silent}}) {
+        for (const bool flush : {false, true}) {
+            setFlushDenormals(flush);
+            SampleVector block;
+            FrequencyShifter shifter(kBenchInputRateHz, 10000.0);
+            FirDecimator stage1(8, 8 * 16, 0.45f / 8.0f);
+            FirDecimator stage2(5, 5 * 16, 0.45f / 5.0f);
+            FirDecimator stage3(5, 5 * 16, 0.45f / 5.0f);
+            uint64_t processed = 0;
+            std::size_t produced = 0;
+            const auto start = std::chrono::steady_clock::now();
+            while (processed < totalSamples) {
+                block.assign(source->begin(), source->end());
+                shifter.mix(block);
+                produced +=
+                    stage3.process(stage2.process(stage1.process(block)))
+                        .size();
+                processed += block.size();
+            }
+            const double elapsed =
+                std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+            if (produced == 0) {
+                throw std::runtime_error("benchmark chain produced no output");
+            }
+            printRow(std::string("denormals ") + inputName + " " +
+                         (flush ? "flush" : "ieee"),
+                     processed, elapsed);
+        }
+    }
+    setFlushDenormals(previousMode);
+}
+
+int64_t threadCpuNs() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Encodes one packet as `parts` message parts: the whole frame when parts
+// is 1, otherwise the header alone followed by parts - 1 payload pieces.
+std::vector<std::vector<uint8_t>> makeZmqBenchMessage(
+    const std::vector<uint8_t> &payload, std::size_t samples,
+    uint64_t sequence, std::size_t parts) {
+    std::vector<uint8_t> header(kZmqHeaderSizeBytes);
+    ttwf_zmq_iq_packet_header_t fields{};
+    fields.magic = kZmqMagic;
+    fields.version = kZmqVersion;
+    fields.header_size = kZmqHeaderSizeBytes;
+    fields.sequence = sequence;
+    fields.sample_rate = static_cast<uint32_t>(kBenchInputRateHz);
+    fields.sample_count = static_cast<uint32_t>(samples);
+    fields.payload_bytes = static_cast<uint32_t>(samples * kBytesPerIQ);
+    if (ttwf_encode_zmq_iq_header(header.data(), header.size(), &fields) !=
+        TTWF_ZMQ_OK) {
+        throw std::runtime_error("failed encoding benchmark ZMQ header");
+    }
+    const std::size_t bytes = samples * kBytesPerIQ;
+    const auto at = [&payload](std::size_t offset) {
+        return payload.begin() + static_cast<std::ptrdiff_t>(offset);
+    };
+    if (parts <= 1) {
+        header.insert(header.end(), at(0), at(bytes));
+        return {header};
+    }
+    std::vector<std::vector<uint8_t>> message = {header};
+    const std::size_t pieces = parts - 1;
+    for (std::size_t piece = 0; piece < pieces; ++piece) {
+        message.emplace_back(at(bytes * piece / pieces),
+                             at(bytes * (piece + 1) / pieces));
+    }
+    return message;
+}
+
+struct ZmqTransportResult {
+    uint64_t packets = 0;
+    double elapsedSec = 0.0;
+    int64_t cpuNs = 0;
+};
+
+// One transport/size/part-count point against an already bound PUB. The
+// sender keeps at most kWindow packets ahead of the receiver, so neither
+// the HWM nor the sender's speed decides the result, and the CPU time is
+// the receiving thread's alone.
+ZmqTransportResult runZmqTransportPoint(void *context, void *publisher,
+                                        const std::string &endpoint,
+                                        const std::vector<uint8_t> &payload,
+                                        std::size_t samples, std::size_t parts,
+                                        uint64_t packets) {
+    constexpr uint64_t kWarmupSequence = std::numeric_limits<uint64_t>::max();
+    constexpr uint64_t kWindow = 128;
+    const auto warmup =
+        makeZmqBenchMessage(payload, samples, kWarmupSequence, parts);
+    std::vector<std::vector<std::vector<uint8_t>>> messages;
+    for (uint64_t index = 0; index < kWindow; ++index) {
+        messages.push_back(makeZmqBenchMessage(payload, samples, index, parts));
+    }
+    const auto sendMessage =
+        [publisher](const std::vector<std::vector<uint8_t>> &message) {
+            for (std::size_t part = 0; part < message.size(); ++part) {
+                (void)zmq_send(publisher, message[part].data(),
+                               message[part].size(),
+                               (part + 1 < message.size()) ? ZMQ_SNDMORE : 0);
+            }
+        };
+
+    std::atomic<bool> synced{false};
+    std::atomic<uint64_t> received{0};
+    ZmqIqReceiver receiver(context, endpoint);
+    std::thread sender([&] {
+        // PUB drops until the subscription lands, so repeat a marked
+        // warm-up packet until the receiver has seen one.
+        while (!synced.load()) {
+            sendMessage(warmup);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        for (uint64_t sent = 0; sent < packets; ++sent) {
+            while (sent - received.load() >= kWindow) {
+                std::this_thread::yield();
+            }
+            sendMessage(messages[sent % kWindow]);
+        }
+    });
+
+    ZmqTransportResult result;
+    ZmqPacket packet;
+    bool timedOut = false;
+    int64_t cpuStart = 0;
+    auto wallStart = std::chrono::steady_clock::now();
+    std::string failure;
+    while (result.packets < packets) {
+        if (!receiver.receive(packet, timedOut)) {
+            failure = timedOut ? "timed out" : "malformed packet";
+            break;
+        }
+        if (packet.sequence == kWarmupSequence) {
+            if (!synced.load()) {
+                cpuStart = threadCpuNs();
+                wallStart = std::chrono::steady_clock::now();
+                synced.store(true);
+            }
+            continue;
+        }
+        if (packet.samples.size() != samples) {
+            failure = "short packet";
+            break;
+        }
+        received.store(++result.packets);
+    }
+    result.cpuNs = threadCpuNs() - cpuStart;
+    result.elapsedSec = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - wallStart)
+                            .count();
+    synced.store(true);
+    received.store(packets);
+    sender.join();
+    if (!failure.empty()) {
+        throw std::runtime_error(endpoint + ": " + failure + " after " +
+                                 std::to_string(result.packets) + " packets");
+    }
+    return result;
+}
+
+// ZmqIqReceiver::receive() plus parseZmqFrame() over tcp, ipc and inproc
+// for each packet size and part count.
+void benchZmqTransport(const BenchConfig &config) {
+    const std::size_t packetSizes[] = {1024, 4096, 16384};
+    const std::size_t partCounts[] = {1, 2, 4};
+    const auto payload = makeBenchPayload(packetSizes[2]);
+
+    std::printf("%-34s %10s %10s %12s\n", "zmq transport samples x parts",
+                "kpkt/s", "MB/s", "cpu ns/pkt");
+    // Link-event lines from the receiver would interleave with the table.
+    std::streambuf *const savedCerr = std::cerr.rdbuf(nullptr);
+    for (const std::string transport : {"tcp", "ipc", "inproc"}) {
+        for (const std::size_t samples : packetSizes) {
+            for (const std::size_t parts : partCounts) {
+                void *context = zmq_ctx_new();
+                void *publisher = zmq_socket(context, ZMQ_PUB);
+                if (publisher == nullptr) {
+                    zmq_ctx_term(context);
+                    throw std::runtime_error("failed creating PUB socket");
+                }
+                const int lingerMs = 0;
+                (void)zmq_setsockopt(publisher, ZMQ_LINGER, &lingerMs,
+                                     sizeof(lingerMs));
+                // Unlinked once the socket is closed; ZeroMQ leaves it.
+                const std::string ipcPath =
+                    "/tmp/airspyhf-decimator-bench-" +
+                    std::to_string(::getpid()) + ".ipc";
+                std::string endpoint;
+                if (transport == "tcp") {
+                    for (int port = 29700; port < 29800 && endpoint.empty();
+                         ++port) {
+                        const std::string candidate =
+                            "tcp://127.0.0.1:" + std::to_string(port);
+                        if (zmq_bind(publisher, candidate.c_str()) == 0) {
+                            endpoint = candidate;
+                        }
+                    }
+                } else {
+                    const std::string candidate =
+                        (transport == "ipc")
+                            ? "ipc://" + ipcPath
+                            : "inproc://airspyhf-decimator-bench";
+                    if (zmq_bind(publisher, candidate.c_str()) == 0) {
+                        endpoint = candidate;
+                    }
+                }
+
+                ZmqTransportResult result;
+                std::string failure;
+                if (endpoint.empty()) {
+                    failure = "failed binding " + transport + " publisher";
+                } else {
+                    const uint64_t packets = std::max<uint64_t>(
+                        1, static_cast<uint64_t>(config.seconds *
+                                                 kBenchInputRateHz) /
+                               samples);
+                    try {
+                        result = runZmqTransportPoint(context, publisher,
+                                                      endpoint, payload,
+                                                      samples, parts, packets);
+                    } catch (const std::exception &err) {
+                        failure = err.what();
+                    }
+                }
+                zmq_close(publisher);
+                zmq_ctx_term(context);
+                if (transport == "ipc") {
+                    (void)::unlink(ipcPath.c_str());
+                }
+                if (!failure.empty()) {
+                    std::cerr.rdbuf(savedCerr);
+                    throw std::runtime_error(failure);
+                }
+
+                const double packetsPerSec =
+                    static_cast<double>(result.packets) / result.elapsedSec;
+                const double bytesPerPacket = static_cast<double>(
+                    kZmqHeaderSizeBytes + samples * kBytesPerIQ);
+                const std::string name = "zmq " + transport + " " +
+                                         std::to_string(samples) + " x " +
+                                         std::to_string(parts);
+                std::printf("%-34s %10.1f %10.1f %12.0f\n", name.c_str(),
+                            packetsPerSec / 1e3,
+                            packetsPerSec * bytesPerPacket / 1e6,
+                            static_cast<double>(result.cpuNs) /
+                                static_cast<double>(result.packets));
+            }
+        }
+    }
+    std::cerr.rdbuf(savedCerr);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    struct Case {
+        const char *name;
+        void (*fn)(const BenchConfig &);
+    };
+
+    const std::vector<Case> cases = {
+        {"chain-cf32", benchChainCf32},
+        {"chain-cf64", benchChainCf64},
+        {"chain-ci16", benchChainCi16},
+        {"chain-fixed", benchChainFixed},
+        {"stage1-parallel", benchStage1Parallel},
+        {"stage1-iir", benchStage1Iir},
+        {"denormals", benchDenormals},
+        {"zmq-transport", benchZmqTransport},
+    };
+
+    BenchConfig config;
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--seconds" && i + 1 < argc) {
+            config.seconds = std::stod(argv[++i]);
+        } else if (arg == "--help") {
+            std::cout << "Usage: " << argv[0]
+                      << " [--seconds <stream seconds>] [case-filter]\n";
+            for (const auto &benchCase : cases) {
+                std::cout << "  " << benchCase.name << "\n";
+            }
+            return 0;
+        } else {
+            filter = arg;
+        }
+    }
+
+    int failures = 0;
+    for (const auto &benchCase : cases) {
+        if (!filter.empty() &&
+            std::string(benchCase.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        try {
+            benchCase.fn(config);
+        } catch (const std::exception &err) {
+            ++failures;
+            std::cerr << "[FAIL] " << benchCase.name << ": " << err.what()
+                      << "\n";
+        }
+    }
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,419 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define main airspyhf_decimator_program_main
+#include "../src/main.cpp"
+#undef main
+
+// End-to-end loopback: an in-process ZMQ publisher paces synthetic packets
+// into the decimator's real main() (receive, parse, DSP, UDP send) running
+// on its own thread, and an in-process UDP receiver collects the frames.
+// Each sweep point reports sustained throughput, delivered fraction and
+// publish-to-receive latency; the first rate that loses frames is the drop
+// onset for that packet/frame size.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct LoopbackConfig {
+    std::vector<uint32_t> rates = {768000, 3072000, 12288000};
+    std::vector<std::size_t> packetSamples = {4096, 16384};
+    std::vector<std::size_t> frames = {256, 1024};
+    double seconds = 2.0;
+    // Delivered fraction below this marks the drop onset.
+    double deliveredThreshold = 0.995;
+};
+
+struct PointResult {
+    double inputMsps = 0.0;
+    double delivered = 0.0;
+    double p50Ms = 0.0;
+    double p90Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+};
+
+template <typename T>
+std::vector<T> parseList(const std::string &value) {
+    std::vector<T> result;
+    std::stringstream stream(value);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        if (!token.empty()) {
+            result.push_back(static_cast<T>(std::stoull(token)));
+        }
+    }
+    if (result.empty()) {
+        throw std::runtime_error("empty list: " + value);
+    }
+    return result;
+}
+
+int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+class LoopbackPublisher {
+  public:
+    LoopbackPublisher(const LoopbackPublisher &) = delete;
+    LoopbackPublisher &operator=(const LoopbackPublisher &) = delete;
+
+    LoopbackPublisher() : context_(zmq_ctx_new()) {
+        socket_ = zmq_socket(context_, ZMQ_PUB);
+        if (socket_ == nullptr) {
+            throw std::runtime_error("Failed creating loopback PUB socket");
+        }
+        const int lingerMs = 0;
+        (void)zmq_setsockopt(socket_, ZMQ_LINGER, &lingerMs, sizeof(lingerMs));
+        for (int port = 29500; port < 29600; ++port) {
+            endpoint_ = "tcp://127.0.0.1:" + std::to_string(port);
+            if (zmq_bind(socket_, endpoint_.c_str()) == 0) {
+                return;
+            }
+        }
+        zmq_close(socket_);
+        zmq_ctx_term(context_);
+        throw std::runtime_error("Failed binding loopback PUB socket");
+    }
+
+    ~LoopbackPublisher() {
+        zmq_close(socket_);
+        zmq_ctx_term(context_);
+    }
+
+    const std::string &endpoint() const { return endpoint_; }
+
+    void send(const std::vector<uint8_t> &frame) {
+        (void)zmq_send(socket_, frame.data(), frame.size(), 0);
+    }
+
+  private:
+    void *context_;
+    void *socket_ = nullptr;
+    std::string endpoint_;
+};
+
+struct ReceivedFrame {
+    int64_t receivedNs;
+    int64_t headerNs;
+};
+
+class LoopbackUdpReceiver {
+  public:
+    LoopbackUdpReceiver(const LoopbackUdpReceiver &) = delete;
+    LoopbackUdpReceiver &operator=(const LoopbackUdpReceiver &) = delete;
+
+    explicit LoopbackUdpReceiver(std::size_t frameSamples)
+        : datagram_(frameSamples * sizeof(std::complex<float>)) {
+        fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        const int receiveBuffer = 8 << 20;
+        (void)::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receiveBuffer,
+                           sizeof(receiveBuffer));
+        timeval timeout{0, 100000};
+        (void)::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (fd_ < 0 ||
+            ::bind(fd_, reinterpret_cast<const sockaddr *>(&addr),
+                   sizeof(addr)) != 0 ||
+            ::getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &length) !=
+                0) {
+            throw std::runtime_error("Failed binding loopback UDP receiver");
+        }
+        port_ = ntohs(addr.sin_port);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~LoopbackUdpReceiver() {
+        stop();
+        ::close(fd_);
+    }
+
+    uint16_t port() const { return port_; }
+
+    // Joins the receive thread; frames() is stable afterwards.
+    void stop() {
+        stopping_.store(true);
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    const std::vector<ReceivedFrame> &frames() const { return frames_; }
+
+  private:
+    void run() {
+        while (!stopping_.load()) {
+            const ssize_t bytes =
+                ::recv(fd_, datagram_.data(), datagram_.size(), 0);
+            if (bytes != static_cast<ssize_t>(datagram_.size())) {
+                continue;
+            }
+            const int64_t now = steadyNs();
+            uint32_t seconds = 0;
+            uint32_t nanoseconds = 0;
+            std::memcpy(&seconds, datagram_.data(), sizeof(seconds));
+            std::memcpy(&nanoseconds, datagram_.data() + sizeof(float),
+                        sizeof(nanoseconds));
+            frames_.push_back(
+                {now, static_cast<int64_t>(seconds) * 1'000'000'000LL +
+                          nanoseconds});
+        }
+    }
+
+    int fd_ = -1;
+    uint16_t port_ = 0;
+    std::vector<uint8_t> datagram_;
+    std::vector<ReceivedFrame> frames_;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+std::vector<uint8_t> makeLoopbackPacket(std::size_t samples) {
+    std::vector<uint8_t> frame(kZmqHeaderSizeBytes + samples * kBytesPerIQ);
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    for (std::size_t index = 0; index < samples; ++index) {
+        const float iq[2] = {noise(rng), noise(rng)};
+        std::memcpy(frame.data() + kZmqHeaderSizeBytes + index * kBytesPerIQ,
+                    iq, sizeof(iq));
+    }
+    return frame;
+}
+
+PointResult runPoint(const LoopbackConfig &config, uint32_t rate,
+                     std::size_t packetSamples, std::size_t frameSamples) {
+    LoopbackPublisher publisher;
+    LoopbackUdpReceiver receiver(frameSamples);
+
+    std::vector<std::string> args = {
+        "airspyhf_decimator", "--zmq-endpoint", publisher.endpoint(),
+        "--ports", std::to_string(receiver.port()), "--frame",
+        std::to_string(frameSamples), "--input-rate", std::to_string(rate),
+        "--udp-sndbuf", std::to_string(4 << 20)};
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(arg.data());
+    }
+    gShouldStop = 0;
+    int exitCode = 0;
+    std::thread decimator([&] {
+        exitCode = airspyhf_decimator_program_main(
+            static_cast<int>(argv.size()), argv.data());
+    });
+    // Let the SUB side connect before anything is published.
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    auto packet = makeLoopbackPacket(packetSamples);
+    const auto totalPackets = static_cast<std::size_t>(std::ceil(
+        config.seconds * rate / static_cast<double>(packetSamples)));
+    const double packetNs = 1e9 * static_cast<double>(packetSamples) / rate;
+    std::vector<int64_t> publishedNs(totalPackets);
+    std::vector<int64_t> publishedRealtimeNs(totalPackets);
+    const int64_t startNs = steadyNs();
+    for (std::size_t index = 0; index < totalPackets; ++index) {
+        const auto due =
+            startNs + static_cast<int64_t>(packetNs * static_cast<double>(index));
+        while (steadyNs() < due) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ttwf_zmq_iq_packet_header_t header{};
+        header.magic = kZmqMagic;
+        header.version = kZmqVersion;
+        header.header_size = kZmqHeaderSizeBytes;
+        header.sequence = index;
+        publishedRealtimeNs[index] = realtimeNs();
+        header.timestamp_us =
+            static_cast<uint64_t>(publishedRealtimeNs[index] / 1000);
+        header.sample_rate = rate;
+        header.sample_count = static_cast<uint32_t>(packetSamples);
+        header.payload_bytes = static_cast<uint32_t>(packetSamples * kBytesPerIQ);
+        (void)ttwf_encode_zmq_iq_header(packet.data(), packet.size(), &header);
+        publishedNs[index] = steadyNs();
+        publisher.send(packet);
+    }
+    const int64_t publishEndNs = steadyNs();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    gShouldStop = 1;
+    decimator.join();
+    receiver.stop();
+    if (exitCode != 0) {
+        throw std::runtime_error("decimator exited with status " +
+                                 std::to_string(exitCode));
+    }
+
+    // Frame n completes once input sample (n + 1) * payload * 200 arrives,
+    // and its header is t0 + n * payload / outputRate, where t0 is the
+    // decimator's wall clock when it assembled frame 0. t0 follows the
+    // publication of frame 0's last packet by less than a frame period
+    // unless the decimator is overloaded, so flooring a header's offset
+    // from that publication gives n whether or not earlier datagrams,
+    // frame 0's included, were lost.
+    const auto &frames = receiver.frames();
+    const std::size_t payload = frameSamples - 1;
+    const double outputRate = static_cast<double>(rate) / kTotalDecimation;
+    const double framePeriodNs =
+        1e9 * static_cast<double>(payload) / outputRate;
+    const std::size_t expectedFrames = static_cast<std::size_t>(
+        static_cast<double>(totalPackets * packetSamples) / kTotalDecimation /
+        static_cast<double>(payload));
+    const auto completingPacket = [&](uint64_t frameIndex) {
+        const auto lastInput = static_cast<std::size_t>(
+            static_cast<double>(frameIndex + 1) *
+            static_cast<double>(payload) * kTotalDecimation);
+        return std::min(totalPackets - 1,
+                        (lastInput + packetSamples - 1) / packetSamples - 1);
+    };
+    const int64_t firstFramePublishedNs =
+        publishedRealtimeNs[completingPacket(0)];
+    std::vector<double> latenciesMs;
+    for (const auto &frame : frames) {
+        const double offsetNs =
+            static_cast<double>(frame.headerNs - firstFramePublishedNs);
+        if (offsetNs < 0.0) {
+            continue;
+        }
+        const std::size_t packetIndex = completingPacket(
+            static_cast<uint64_t>(std::floor(offsetNs / framePeriodNs)));
+        latenciesMs.push_back(
+            static_cast<double>(frame.receivedNs - publishedNs[packetIndex]) /
+            1e6);
+    }
+    std::sort(latenciesMs.begin(), latenciesMs.end());
+    const auto percentile = [&latenciesMs](double q) {
+        if (latenciesMs.empty()) {
+            return 0.0;
+        }
+        return latenciesMs[std::min(
+            latenciesMs.size() - 1,
+            static_cast<std::size_t>(q * static_cast<double>(latenciesMs.size())))];
+    };
+
+    PointResult result;
+    const double elapsedSec =
+        static_cast<double>((frames.empty() ? publishEndNs
+                                            : frames.back().receivedNs) -
+                            startNs) *
+        1e-9;
+    result.inputMsps = static_cast<double>(frames.size() * payload) *
+                       kTotalDecimation / elapsedSec / 1e6;
+    result.delivered = (expectedFrames > 0)
+                           ? static_cast<double>(frames.size()) /
+                                 static_cast<double>(expectedFrames)
+                           : 0.0;
+    result.p50Ms = percentile(0.5);
+    result.p90Ms = percentile(0.9);
+    result.p99Ms = percentile(0.99);
+    result.maxMs = latenciesMs.empty() ? 0.0 : latenciesMs.back();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    LoopbackConfig config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg(argv[i]);
+            if (arg == "--help") {
+                std::cout
+                    << "Usage: " << argv[0] << " [options]\n"
+                    << "  --rates <sps,...>      Input rates to sweep "
+                       "(default 768000,3072000,12288000)\n"
+                    << "  --packets <N,...>      ZMQ packet sizes in samples "
+                       "(default 4096,16384)\n"
+                    << "  --frames <N,...>       --frame values (default "
+                       "256,1024)\n"
+                    << "  --seconds <s>          Stream time per point "
+                       "(default 2)\n";
+                return 0;
+            }
+            if (i + 1 >= argc) {
+                throw std::runtime_error(arg + " requires a value");
+            }
+            const std::string value(argv[++i]);
+            if (arg == "--rates") {
+                config.rates = parseList<uint32_t>(value);
+            } else if (arg == "--packets") {
+                config.packetSamples = parseList<std::size_t>(value);
+            } else if (arg == "--frames") {
+                config.frames = parseList<std::size_t>(value);
+            } else if (arg == "--seconds") {
+                config.seconds = std::stod(value);
+            } else {
+                throw std::runtime_error("unknown option " + arg);
+            }
+        }
+    } catch (const std::exception &err) {
+        std::cerr << "[FAIL] " << err.what() << "\n";
+        return 64;
+    }
+    std::sort(config.rates.begin(), config.rates.end());
+
+    // main() logs every packet gap and perf line; keep the table readable.
+    std::streambuf *const savedCerr = std::cerr.rdbuf(nullptr);
+    std::printf("%10s %8s %6s %10s %10s %9s %9s %9s %9s\n", "rate_sps",
+                "packet", "frame", "in_Msps", "delivered", "p50_ms", "p90_ms",
+                "p99_ms", "max_ms");
+    int failures = 0;
+    for (const std::size_t packetSamples : config.packetSamples) {
+        for (const std::size_t frameSamples : config.frames) {
+            uint32_t onset = 0;
+            for (const uint32_t rate : config.rates) {
+                try {
+                    const PointResult result =
+                        runPoint(config, rate, packetSamples, frameSamples);
+                    std::printf(
+                        "%10u %8zu %6zu %10.2f %9.1f%% %9.2f %9.2f %9.2f "
+                        "%9.2f\n",
+                        rate, packetSamples, frameSamples, result.inputMsps,
+                        100.0 * result.delivered, result.p50Ms, result.p90Ms,
+                        result.p99Ms, result.maxMs);
+                    if (onset == 0 &&
+                        result.delivered < config.deliveredThreshold) {
+                        onset = rate;
+                    }
+                } catch (const std::exception &err) {
+                    ++failures;
+                    std::printf("%10u %8zu %6zu [FAIL] %s\n", rate,
+                                packetSamples, frameSamples, err.what());
+                }
+                std::fflush(stdout);
+            }
+            if (onset != 0) {
+                std::printf("drop onset packet=%zu frame=%zu rate_sps=%u\n",
+                            packetSamples, frameSamples, onset);
+            } else {
+                std::printf("drop onset packet=%zu frame=%zu none up to "
+                            "rate_sps=%u\n",
+                            packetSamples, frameSamples, config.rates.back());
+            }
+        }
+    }
+    std::cerr.rdbuf(savedCerr);
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#define main airspyhf_decimator_program_main
+#include "../src/main.cpp"
+#undef main
+
+// Accelerated soak: runs windows of real packets through the receive parse,
+// sequence tracking and a full DecimationPipeline, and fast-forwards the
+// stream between windows (sequence jump plus skipOutput) so a few minutes
+// of CPU cover days of stream time. Checks that the process stays flat
+// (RSS, throughput) and that frame timestamps and sequence accounting stay
+// exact across the whole span, including a 64-bit sequence wraparound.
+
+namespace {
+
+struct SoakConfig {
+    double streamDays = 2.0;
+    std::size_t windows = 200;
+    std::size_t windowPackets = 32;
+    std::size_t packetSamples = 16000;
+    double inputRate = 768000.0;
+    std::size_t frameSamples = 1024;
+    double maxRssGrowthKb = 4096.0;
+    double maxThroughputDrop = 0.3;
+};
+
+[[noreturn]] void usage(const char *argv0, int status) {
+    std::cout
+        << "Usage: " << argv0 << " [options]\n"
+        << "  --stream-days <d>      Stream time to cover (default 2)\n"
+        << "  --windows <N>          Processing windows (default 200)\n"
+        << "  --window-packets <N>   Packets processed per window (default 32)\n"
+        << "  --packet-samples <N>   IQ samples per ZMQ packet (default 16000)\n"
+        << "  --input-rate <Hz>      Synthetic input rate (default 768000)\n"
+        << "  --frame <samples>      Output frame size (default 1024)\n"
+        << "  --max-rss-growth-kb <kB>  Allowed RSS growth after warm-up "
+           "(default 4096)\n"
+        << "  --max-throughput-drop <f> Allowed fractional slowdown of the "
+           "last quarter versus the first (default 0.3)\n";
+    std::exit(status);
+}
+
+SoakConfig parseSoakArgs(int argc, char **argv) {
+    SoakConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--help") {
+            usage(argv[0], 0);
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0], 64);
+        }
+        const char *value = argv[++i];
+        if (arg == "--stream-days") {
+            config.streamDays = std::stod(value);
+        } else if (arg == "--windows") {
+            config.windows = std::stoul(value);
+        } else if (arg == "--window-packets") {
+            config.windowPackets = std::stoul(value);
+        } else if (arg == "--packet-samples") {
+            config.packetSamples = std::stoul(value);
+        } else if (arg == "--input-rate") {
+            config.inputRate = std::stod(value);
+        } else if (arg == "--frame") {
+            config.frameSamples = std::stoul(value);
+        } else if (arg == "--max-rss-growth-kb") {
+            config.maxRssGrowthKb = std::stod(value);
+        } else if (arg == "--max-throughput-drop") {
+            config.maxThroughputDrop = std::stod(value);
+        } else {
+            usage(argv[0], 64);
+        }
+    }
+    if (config.windows < 4 || config.windowPackets == 0 ||
+        config.packetSamples == 0 || !(config.inputRate > 0.0) ||
+        config.frameSamples < 2 || config.streamDays < 0.0) {
+        usage(argv[0], 64);
+    }
+    return config;
+}
+
+double residentKb() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t sizePages = 0;
+    uint64_t residentPages = 0;
+    statm >> sizePages >> residentPages;
+    return static_cast<double>(residentPages) *
+           static_cast<double>(::sysconf(_SC_PAGESIZE)) / 1024.0;
+}
+
+int64_t headerNs(const std::complex<float> &header) {
+    uint32_t seconds = 0;
+    uint32_t nanoseconds = 0;
+    const float real = header.real();
+    const float imag = header.imag();
+    std::memcpy(&seconds, &real, sizeof(seconds));
+    std::memcpy(&nanoseconds, &imag, sizeof(nanoseconds));
+    return static_cast<int64_t>(seconds) * 1'000'000'000LL + nanoseconds;
+}
+
+std::vector<uint8_t> makeSoakPacket(std::size_t samples, uint32_t sampleRate) {
+    std::vector<uint8_t> frame(kZmqHeaderSizeBytes + samples * kBytesPerIQ);
+    std::mt19937 rng(99);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    for (std::size_t index = 0; index < samples; ++index) {
+        const double phase = kTwoPi * -9000.0 * static_cast<double>(index) /
+                             static_cast<double>(sampleRate);
+        const float iq[2] = {
+            0.5f * static_cast<float>(std::cos(phase)) + noise(rng),
+            0.5f * static_cast<float>(std::sin(phase)) + noise(rng)};
+        std::memcpy(frame.data() + kZmqHeaderSizeBytes + index * kBytesPerIQ,
+                    iq, sizeof(iq));
+    }
+    return frame;
+}
+
+void encodeSoakHeader(std::vector<uint8_t> &frame, uint64_t sequence,
+                      uint64_t timestampUs, uint32_t sampleRate,
+                      std::size_t samples) {
+    ttwf_zmq_iq_packet_header_t header{};
+    header.magic = kZmqMagic;
+    header.version = kZmqVersion;
+    header.header_size = kZmqHeaderSizeBytes;
+    header.sequence = sequence;
+    header.timestamp_us = timestampUs;
+    header.sample_rate = sampleRate;
+    header.sample_count = static_cast<uint32_t>(samples);
+    header.payload_bytes = static_cast<uint32_t>(samples * kBytesPerIQ);
+    if (ttwf_encode_zmq_iq_header(frame.data(), frame.size(), &header) !=
+        TTWF_ZMQ_OK) {
+        throw std::runtime_error("Failed to encode soak packet header");
+    }
+}
+
+int runSoak(const SoakConfig &config) {
+    const auto sampleRate = static_cast<uint32_t>(std::lround(config.inputRate));
+    PipelineConfig pipelineConfig;
+    pipelineConfig.inputRate = config.inputRate;
+    pipelineConfig.shiftHz = 10000.0;
+    pipelineConfig.frameSamples = config.frameSamples;
+    DecimationPipeline pipeline(pipelineConfig);
+    const double outputRate = pipeline.outputRate();
+    const bool integerOutputRate =
+        std::abs(outputRate - std::round(outputRate)) < 1e-6;
+    // The double-precision encoder path (fractional rates) is allowed to
+    // round; the integer path must be exact to the nanosecond.
+    const int64_t timestampToleranceNs = integerOutputRate ? 0 : 1000;
+
+    const uint64_t windowInputSamples =
+        static_cast<uint64_t>(config.windowPackets) * config.packetSamples;
+    const double streamSamples =
+        config.streamDays * 86400.0 * config.inputRate;
+    const double realSamples =
+        static_cast<double>(windowInputSamples * config.windows);
+    // The chain emits one output per kTotalDecimation inputs. The
+    // fast-forward skips whole outputs, so it stands for an exact span of
+    // input samples.
+    const auto decimation = static_cast<uint64_t>(kTotalDecimation);
+    const uint64_t packetsPerWholeOutputs =
+        decimation / std::gcd<uint64_t>(config.packetSamples, decimation);
+    uint64_t skipPacketsPerWindow = static_cast<uint64_t>(std::max(
+        0.0, (streamSamples - realSamples) /
+                 (static_cast<double>(config.packetSamples) *
+                  static_cast<double>(config.windows))));
+    skipPacketsPerWindow -= skipPacketsPerWindow % packetsPerWholeOutputs;
+    const uint64_t skipInputPerWindow =
+        skipPacketsPerWindow * config.packetSamples;
+    const uint64_t skipOutputPerWindow = skipInputPerWindow / decimation;
+    const bool integerInputRate =
+        std::abs(config.inputRate - std::round(config.inputRate)) < 1e-6;
+
+    // Start so the 64-bit sequence wraps halfway through the run.
+    const uint64_t sequenceSpan =
+        (config.windowPackets + skipPacketsPerWindow) * config.windows;
+    uint64_t nextSequence = uint64_t{0} - sequenceSpan / 2;
+    uint64_t timestampUs = 1'700'000'000'000'000ULL;
+    const double packetUs =
+        1e6 * static_cast<double>(config.packetSamples) / config.inputRate;
+    double timestampCarryUs = 0.0;
+    const auto advanceTimestamp = [&](uint64_t packets) {
+        timestampCarryUs += packetUs * static_cast<double>(packets);
+        const double whole = std::floor(timestampCarryUs);
+        timestampUs += static_cast<uint64_t>(whole);
+        timestampCarryUs -= whole;
+    };
+
+    auto wire = makeSoakPacket(config.packetSamples, sampleRate);
+    ZmqPacket packet;
+    SequenceTracker tracker;
+    uint64_t expectedDropped = 0;
+    bool wrapped = false;
+
+    // Filtered and fast-forwarded input samples, and the output sample the
+    // next frame must start at given those counts.
+    uint64_t inputPushed = 0;
+    uint64_t inputSkipped = 0;
+    uint64_t frameStartOutput = 0;
+    const std::size_t payload = config.frameSamples - 1;
+    bool haveBase = false;
+    int64_t baseNs = 0;
+    int64_t previousNs = 0;
+    int64_t maxTimestampErrorNs = 0;
+    uint64_t nonMonotonic = 0;
+    uint64_t frames = 0;
+
+    std::vector<double> windowMsps;
+    double warmRssKb = 0.0;
+    double peakRssKb = 0.0;
+    const std::size_t warmupWindows = std::max<std::size_t>(1, config.windows / 10);
+    const std::size_t reportEvery = std::max<std::size_t>(1, config.windows / 10);
+
+    std::printf("%8s %12s %10s %10s %14s %10s\n", "window", "stream_h",
+                "Msps", "rss_kb", "max_ts_err_ns", "dropped");
+    for (std::size_t window = 0; window < config.windows; ++window) {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < config.windowPackets; ++index) {
+            encodeSoakHeader(wire, nextSequence, timestampUs, sampleRate,
+                             config.packetSamples);
+            if (!parseZmqFrame(wire.data(), wire.size(), packet)) {
+                throw std::runtime_error("Soak packet failed to parse");
+            }
+            const bool decreased = tracker.haveSequence() &&
+                                   packet.sequence < tracker.previous();
+            const auto step = tracker.observe(packet.sequence, false);
+            if (step == SequenceTracker::Step::Backward ||
+                step == SequenceTracker::Step::Restart) {
+                throw std::runtime_error(
+                    "Sequence " + std::to_string(packet.sequence) +
+                    " misclassified after " +
+                    std::to_string(nextSequence - 1));
+            }
+            // A forward step that decreases numerically is the wrap.
+            wrapped = wrapped || decreased;
+            ++nextSequence;
+            advanceTimestamp(1);
+
+            (void)pipeline.process(packet.samples);
+            inputPushed += packet.samples.size();
+            while (pipeline.frameReady()) {
+                const int64_t ns = headerNs(pipeline.frame()[0]);
+                if (!haveBase) {
+                    haveBase = true;
+                    baseNs = ns;
+                } else {
+                    if (ns <= previousNs) {
+                        ++nonMonotonic;
+                    }
+                    // The frame's first sample in input samples, at the
+                    // input rate: independent of the encoder's output-rate
+                    // arithmetic and of the pipeline's timeline.
+                    const uint64_t startInput = frameStartOutput * decimation;
+                    const int64_t offsetNs =
+                        integerInputRate
+                            ? static_cast<int64_t>(
+                                  static_cast<WideProduct>(startInput) *
+                                  1'000'000'000ULL /
+                                  static_cast<uint64_t>(
+                                      std::llround(config.inputRate)))
+                            : static_cast<int64_t>(std::llround(
+                                  static_cast<long double>(startInput) *
+                                  1e9L / config.inputRate));
+                    const int64_t error = std::abs(ns - (baseNs + offsetNs));
+                    maxTimestampErrorNs = std::max(maxTimestampErrorNs, error);
+                }
+                previousNs = ns;
+                pipeline.consumeFrame();
+                frameStartOutput += payload;
+                ++frames;
+            }
+        }
+        if (pipeline.outputSamples() != inputPushed / decimation) {
+            throw std::runtime_error(
+                "Output count " + std::to_string(pipeline.outputSamples()) +
+                " drifted from the input count " +
+                std::to_string(inputPushed));
+        }
+        const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+        windowMsps.push_back(static_cast<double>(windowInputSamples) /
+                             seconds / 1e6);
+
+        // Fast-forward: the publisher keeps counting while we skip ahead.
+        // The partial frame is dropped, so the next frame starts after
+        // every output the input so far has produced, plus the skip.
+        const uint64_t timelineOutputs =
+            (inputPushed / decimation) + (inputSkipped / decimation);
+        if (pipeline.skipOutput(skipOutputPerWindow) !=
+            timelineOutputs - frameStartOutput) {
+            throw std::runtime_error("Fast-forward dropped an unexpected "
+                                     "partial frame");
+        }
+        inputSkipped += skipInputPerWindow;
+        frameStartOutput = timelineOutputs + skipOutputPerWindow;
+        nextSequence += skipPacketsPerWindow;
+        expectedDropped += skipPacketsPerWindow;
+        advanceTimestamp(skipPacketsPerWindow);
+
+        const double rssKb = residentKb();
+        peakRssKb = std::max(peakRssKb, rssKb);
+        if (window + 1 == warmupWindows) {
+            warmRssKb = rssKb;
+        }
+        if ((window + 1) % reportEvery == 0 || window + 1 == config.windows) {
+            std::printf("%8zu %12.1f %10.2f %10.0f %14lld %10llu\n", window + 1,
+                        static_cast<double>(pipeline.samplesSent()) /
+                            outputRate / 3600.0,
+                        windowMsps.back(), rssKb,
+                        static_cast<long long>(maxTimestampErrorNs),
+                        static_cast<unsigned long long>(tracker.dropped()));
+        }
+    }
+    // The last window's skip has no packet after it to reveal the gap.
+    expectedDropped -= skipPacketsPerWindow;
+
+    const std::size_t quarter = windowMsps.size() / 4;
+    double firstQuarter = 0.0;
+    double lastQuarter = 0.0;
+    for (std::size_t index = 0; index < quarter; ++index) {
+        firstQuarter += windowMsps[index];
+        lastQuarter += windowMsps[windowMsps.size() - 1 - index];
+    }
+    firstQuarter /= static_cast<double>(quarter);
+    lastQuarter /= static_cast<double>(quarter);
+    const double rssGrowthKb = residentKb() - warmRssKb;
+
+    std::printf("stream_days=%.2f frames=%llu first_quarter_msps=%.2f "
+                "last_quarter_msps=%.2f rss_growth_kb=%.0f peak_rss_kb=%.0f "
+                "max_ts_err_ns=%lld sequence_wrapped=%s dropped=%llu "
+                "expected_dropped=%llu\n",
+                static_cast<double>(pipeline.samplesSent()) / outputRate /
+                    86400.0,
+                static_cast<unsigned long long>(frames), firstQuarter,
+                lastQuarter, rssGrowthKb, peakRssKb,
+                static_cast<long long>(maxTimestampErrorNs),
+                wrapped ? "true" : "false",
+                static_cast<unsigned long long>(tracker.dropped()),
+                static_cast<unsigned long long>(expectedDropped));
+
+    int failures = 0;
+    const auto fail = [&failures](const std::string &message) {
+        ++failures;
+        std::cerr << "[FAIL] " << message << "\n";
+    };
+    if (rssGrowthKb > config.maxRssGrowthKb) {
+        fail("RSS grew by " + std::to_string(rssGrowthKb) + " kB after warm-up");
+    }
+    if (frames < 2 * config.windows) {
+        fail("only " + std::to_string(frames) +
+             " frames; too few to check timestamps across the fast-forwards");
+    }
+    if (nonMonotonic != 0) {
+        fail(std::to_string(nonMonotonic) + " non-monotonic frame timestamps");
+    }
+    if (maxTimestampErrorNs > timestampToleranceNs) {
+        fail("frame timestamps drifted by " +
+             std::to_string(maxTimestampErrorNs) + " ns from the input count");
+    }
+    if (tracker.dropped() != expectedDropped || tracker.outOfOrder() != 0 ||
+        tracker.restarts() != 0) {
+        fail("sequence accounting wrong: dropped=" +
+             std::to_string(tracker.dropped()) +
+             " expected=" + std::to_string(expectedDropped));
+    }
+    if (!wrapped) {
+        fail("sequence never wrapped");
+    }
+    if (lastQuarter < (1.0 - config.maxThroughputDrop) * firstQuarter) {
+        fail("throughput fell from " + std::to_string(firstQuarter) + " to " +
+             std::to_string(lastQuarter) + " Msps");
+    }
+    return (failures == 0) ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    try {
+        return runSoak(parseSoakArgs(argc, argv));
+    } catch (const std::exception &err) {
+        std::cerr << "[FAIL] " << err.what() << "\n";
+        return 1;
+    }
+}
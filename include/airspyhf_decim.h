@@ -0,0 +1,119 @@
+/*
+ * airspyhf_decim: the decimator's shift + decimate + frame pipeline as an
+ * in-process library, so a radio driver can hand it IQ blocks directly
+ * instead of publishing them over ZMQ.
+ *
+ * Input is interleaved float32 IQ at the configured input rate. Output
+ * frames are interleaved float32 IQ at input_rate_hz / 200: one timestamp
+ * header sample followed by frame_samples - 1 payload samples, the same
+ * layout the airspyhf_decimator executable sends over UDP.
+ *
+ * A handle is not thread-safe; use one per thread or serialize calls.
+ * Processing uses the calling thread's floating-point mode; set FTZ/DAZ
+ * there to avoid slow subnormals on quiet input. Stage-1 helper threads
+ * copy the caller's mode on every push.
+ */
+#ifndef AIRSPYHF_DECIM_H
+#define AIRSPYHF_DECIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define AIRSPYHF_DECIM_API __attribute__((visibility("default")))
+#else
+#define AIRSPYHF_DECIM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 1: the first layout (through arithmetic).
+ * 2: appends stage1_threads; callers passing a version 1 struct_size get
+ *    one stage-1 thread.
+ */
+#define AIRSPYHF_DECIM_API_VERSION 2
+
+enum airspyhf_decim_status {
+    AIRSPYHF_DECIM_OK = 0,
+    AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT = -1,
+    AIRSPYHF_DECIM_ERROR_BUFFER_TOO_SMALL = -2,
+    AIRSPYHF_DECIM_ERROR_NO_MEMORY = -3,
+    AIRSPYHF_DECIM_ERROR_INTERNAL = -4
+};
+
+enum airspyhf_decim_arithmetic {
+    AIRSPYHF_DECIM_ARITH_FLOAT = 0,
+    AIRSPYHF_DECIM_ARITH_FIXED = 1
+};
+
+/*
+ * Initialize with airspyhf_decim_config_init(), which also sets struct_size,
+ * then override fields. Later API versions only append fields: a struct
+ * from an older header (struct_size down to the *_V1_SIZE values below) is
+ * accepted, fields beyond its struct_size take their defaults, and stats
+ * are filled only as far as the caller's struct_size reaches.
+ */
+typedef struct airspyhf_decim_config {
+    uint32_t struct_size;
+    double input_rate_hz;        /* required, > 0 */
+    double shift_hz;             /* default 0 */
+    uint32_t frame_samples;      /* header + payload, >= 2; default 1024 */
+    uint32_t max_pending_frames; /* oldest dropped beyond this; default 64 */
+    int32_t arithmetic;          /* airspyhf_decim_arithmetic */
+    uint32_t reserved0;          /* padding of the first layout; ignored */
+    uint32_t stage1_threads;     /* since API 2: stage-1 threads; default 1 */
+} airspyhf_decim_config;
+
+typedef struct airspyhf_decim_stats {
+    uint32_t struct_size; /* set to sizeof(airspyhf_decim_stats) */
+    uint64_t input_samples;
+    uint64_t output_samples;
+    uint64_t frames_pulled;
+    uint64_t frames_dropped;
+    uint64_t pending_frames;
+    uint64_t buffered_samples;
+} airspyhf_decim_stats;
+
+/* Sizes of the first published layouts. */
+#define AIRSPYHF_DECIM_CONFIG_V1_SIZE \
+    offsetof(airspyhf_decim_config, stage1_threads)
+#define AIRSPYHF_DECIM_STATS_V1_SIZE sizeof(airspyhf_decim_stats)
+
+typedef struct airspyhf_decim airspyhf_decim;
+
+AIRSPYHF_DECIM_API uint32_t airspyhf_decim_api_version(void);
+
+AIRSPYHF_DECIM_API void
+airspyhf_decim_config_init(airspyhf_decim_config *config);
+
+AIRSPYHF_DECIM_API int airspyhf_decim_create(const airspyhf_decim_config *config,
+                                             airspyhf_decim **decim);
+
+AIRSPYHF_DECIM_API void airspyhf_decim_destroy(airspyhf_decim *decim);
+
+/* Shifts and decimates sample_count complex samples (2 * sample_count
+ * floats). Completed frames are queued for airspyhf_decim_pull_frame(). */
+AIRSPYHF_DECIM_API int airspyhf_decim_push(airspyhf_decim *decim,
+                                           const float *iq,
+                                           size_t sample_count);
+
+/* Copies the oldest pending frame (2 * frame_samples floats) into iq.
+ * Returns 1 if a frame was copied, 0 if none is pending, or a negative
+ * airspyhf_decim_status. */
+AIRSPYHF_DECIM_API int airspyhf_decim_pull_frame(airspyhf_decim *decim,
+                                                 float *iq,
+                                                 size_t capacity_samples);
+
+AIRSPYHF_DECIM_API int airspyhf_decim_get_stats(const airspyhf_decim *decim,
+                                                airspyhf_decim_stats *stats);
+
+AIRSPYHF_DECIM_API const char *airspyhf_decim_status_string(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AIRSPYHF_DECIM_H */
@@ -0,0 +1,209 @@
+#include <airspyhf_decim.h>
+
+#include "dsp_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+
+namespace airspyhf_dsp {
+
+template class BasicFirDecimator<cf32>;
+template class BasicFirDecimator<cf64>;
+template class BasicFirDecimator<ci16>;
+template class BasicFirDecimator<ci16, SaturatingQ15Traits>;
+template class BasicFrequencyShifter<cf32>;
+template class BasicFrequencyShifter<cf64>;
+template class BasicFrequencyShifter<ci16>;
+
+} // namespace airspyhf_dsp
+
+using namespace airspyhf_dsp;
+
+struct airspyhf_decim {
+    airspyhf_decim(const PipelineConfig &config, uint32_t maxPending)
+        : pipeline(config), maxPendingFrames(maxPending) {}
+
+    DecimationPipeline pipeline;
+    SampleVector floatInput;
+    SampleBuffer<ci16> fixedInput;
+    uint32_t maxPendingFrames;
+    uint64_t framesPulled = 0;
+    uint64_t framesDropped = 0;
+};
+
+namespace {
+
+// The caller's struct as far as its struct_size reaches, over the current
+// layout's defaults.
+airspyhf_decim_config effectiveConfig(const airspyhf_decim_config &config) {
+    airspyhf_decim_config result;
+    airspyhf_decim_config_init(&result);
+    std::memcpy(static_cast<void *>(&result), &config,
+                std::min<std::size_t>(config.struct_size, sizeof(result)));
+    result.struct_size = sizeof(result);
+    return result;
+}
+
+// Exceptions must not cross the C boundary.
+template <typename Fn> int guarded(Fn &&fn) {
+    try {
+        return fn();
+    } catch (const std::bad_alloc &) {
+        return AIRSPYHF_DECIM_ERROR_NO_MEMORY;
+    } catch (...) {
+        return AIRSPYHF_DECIM_ERROR_INTERNAL;
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t airspyhf_decim_api_version(void) {
+    return AIRSPYHF_DECIM_API_VERSION;
+}
+
+void airspyhf_decim_config_init(airspyhf_decim_config *config) {
+    if (config == nullptr) {
+        return;
+    }
+    std::memset(config, 0, sizeof(*config));
+    config->struct_size = sizeof(*config);
+    config->frame_samples = 1024;
+    config->max_pending_frames = 64;
+    config->arithmetic = AIRSPYHF_DECIM_ARITH_FLOAT;
+    config->stage1_threads = 1;
+}
+
+int airspyhf_decim_create(const airspyhf_decim_config *requested,
+                          airspyhf_decim **decim) {
+    if (decim == nullptr) {
+        return AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT;
+    }
+    *decim = nullptr;
+    if (requested == nullptr ||
+        requested->struct_size < AIRSPYHF_DECIM_CONFIG_V1_SIZE) {
+        return AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT;
+    }
+    const airspyhf_decim_config effective = effectiveConfig(*requested);
+    const airspyhf_decim_config *config = &effective;
+    if (!(config->input_rate_hz > 0.0) || config->frame_samples < 2 ||
+        config->max_pending_frames == 0 || config->stage1_threads == 0 ||
+        config->stage1_threads > 256 ||
+        (config->arithmetic != AIRSPYHF_DECIM_ARITH_FLOAT &&
+         config->arithmetic != AIRSPYHF_DECIM_ARITH_FIXED)) {
+        return AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT;
+    }
+    return guarded([&] {
+        PipelineConfig pipelineConfig;
+        pipelineConfig.inputRate = config->input_rate_hz;
+        pipelineConfig.shiftHz = config->shift_hz;
+        pipelineConfig.frameSamples = config->frame_samples;
+        pipelineConfig.stage1Threads = config->stage1_threads;
+        pipelineConfig.arithmetic =
+            (config->arithmetic == AIRSPYHF_DECIM_ARITH_FIXED)
+                ? Arithmetic::Fixed
+                : Arithmetic::Float;
+        *decim = new airspyhf_decim(pipelineConfig, config->max_pending_frames);
+        return AIRSPYHF_DECIM_OK;
+    });
+}
+
+void airspyhf_decim_destroy(airspyhf_decim *decim) { delete decim; }
+
+int airspyhf_decim_push(airspyhf_decim *decim, const float *iq,
+                        size_t sample_count) {
+    if (decim == nullptr || (iq == nullptr && sample_count > 0)) {
+        return AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT;
+    }
+    return guarded([&] {
+        auto &pipeline = decim->pipeline;
+        if (pipeline.config().arithmetic == Arithmetic::Fixed) {
+            decim->fixedInput.resize(sample_count);
+            for (std::size_t index = 0; index < sample_count; ++index) {
+                decim->fixedInput[index] = SampleTraits<ci16>::fromFloat(
+                    iq[2 * index], iq[2 * index + 1]);
+            }
+            (void)pipeline.process(decim->fixedInput);
+        } else {
+            decim->floatInput.resize(sample_count);
+            if (sample_count > 0) {
+                std::memcpy(static_cast<void *>(decim->floatInput.data()), iq,
+                            sample_count * 2 * sizeof(float));
+            }
+            (void)pipeline.process(decim->floatInput);
+        }
+        // The frame timeline keeps advancing for dropped frames, so the
+        // next header still reflects the true sample time.
+        while (pipeline.pendingFrames() > decim->maxPendingFrames) {
+            pipeline.consumeFrame();
+            ++decim->framesDropped;
+        }
+        return AIRSPYHF_DECIM_OK;
+    });
+}
+
+int airspyhf_decim_pull_frame(airspyhf_decim *decim, float *iq,
+                              size_t capacity_samples) {
+    if (decim == nullptr || iq == nullptr) {
+        return AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT;
+    }
+    auto &pipeline = decim->pipeline;
+    if (!pipeline.frameReady()) {
+        return 0;
+    }
+    if (capacity_samples < pipeline.frameSamples()) {
+        return AIRSPYHF_DECIM_ERROR_BUFFER_TOO_SMALL;
+    }
+    return guarded([&] {
+        std::memcpy(iq, pipeline.frame(),
+                    pipeline.frameSamples() * 2 * sizeof(float));
+        pipeline.consumeFrame();
+        ++decim->framesPulled;
+        return 1;
+    });
+}
+
+int airspyhf_decim_get_stats(const airspyhf_decim *decim,
+                             airspyhf_decim_stats *stats) {
+    if (decim == nullptr || stats == nullptr ||
+        stats->struct_size < AIRSPYHF_DECIM_STATS_V1_SIZE) {
+        return AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT;
+    }
+    const auto &pipeline = decim->pipeline;
+    airspyhf_decim_stats current{};
+    current.struct_size = stats->struct_size;
+    current.input_samples = pipeline.inputSamples();
+    current.output_samples = pipeline.outputSamples();
+    current.frames_pulled = decim->framesPulled;
+    current.frames_dropped = decim->framesDropped;
+    current.pending_frames = pipeline.pendingFrames();
+    current.buffered_samples = pipeline.bufferedSamples();
+    // Only the prefix the caller's layout has room for.
+    std::memcpy(static_cast<void *>(stats), &current,
+                std::min<std::size_t>(stats->struct_size, sizeof(current)));
+    return AIRSPYHF_DECIM_OK;
+}
+
+const char *airspyhf_decim_status_string(int status) {
+    switch (status) {
+    case AIRSPYHF_DECIM_OK:
+        return "ok";
+    case AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case AIRSPYHF_DECIM_ERROR_BUFFER_TOO_SMALL:
+        return "buffer too small";
+    case AIRSPYHF_DECIM_ERROR_NO_MEMORY:
+        return "out of memory";
+    case AIRSPYHF_DECIM_ERROR_INTERNAL:
+        return "internal error";
+    default:
+        break;
+    }
+    return "unknown status";
+}
+
+} // extern "C"
@@ -0,0 +1,59 @@
+// Flush-to-zero / denormals-are-zero control. The mode is per thread, so
+// every thread that runs DSP code sets it; the pools in work_scheduler.h
+// copy it from the thread that creates or drives them.
+#pragma once
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define AIRSPYHF_HAVE_FTZ_DAZ 1
+#elif defined(__aarch64__)
+#include <cstdint>
+#define AIRSPYHF_HAVE_FTZ_DAZ 1
+#else
+#define AIRSPYHF_HAVE_FTZ_DAZ 0
+#endif
+
+namespace airspyhf_dsp {
+
+#if defined(__SSE2__) || defined(__x86_64__)
+constexpr unsigned kMxcsrFlushToZero = 0x8000U;
+constexpr unsigned kMxcsrDenormalsAreZero = 0x0040U;
+constexpr unsigned kMxcsrFlushBits = kMxcsrFlushToZero | kMxcsrDenormalsAreZero;
+#elif defined(__aarch64__)
+// FPCR.FZ flushes both subnormal inputs and results.
+constexpr uint64_t kFpcrFlushToZero = uint64_t{1} << 24;
+#endif
+
+// Whether this build can change the mode at all.
+constexpr bool flushDenormalsSupported() { return AIRSPYHF_HAVE_FTZ_DAZ != 0; }
+
+inline bool flushDenormalsEnabled() {
+#if defined(__SSE2__) || defined(__x86_64__)
+    return (_mm_getcsr() & kMxcsrFlushBits) == kMxcsrFlushBits;
+#elif defined(__aarch64__)
+    uint64_t fpcr = 0;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    return (fpcr & kFpcrFlushToZero) != 0;
+#else
+    return false;
+#endif
+}
+
+// Sets the calling thread's mode; returns false where unsupported.
+inline bool setFlushDenormals(bool enable) {
+#if defined(__SSE2__) || defined(__x86_64__)
+    const unsigned csr = _mm_getcsr();
+    _mm_setcsr(enable ? (csr | kMxcsrFlushBits) : (csr & ~kMxcsrFlushBits));
+    return true;
+#elif defined(__aarch64__)
+    uint64_t fpcr = 0;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr = enable ? (fpcr | kFpcrFlushToZero) : (fpcr & ~kFpcrFlushToZero);
+    __asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+    return true;
+#else
+    return !enable;
+#endif
+}
+
+} // namespace airspyhf_dsp
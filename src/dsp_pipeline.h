@@ -0,0 +1,1838 @@
+// Shift + decimate + frame pipeline shared by the decimator executable and
+// the embeddable airspyhf_decim library. Everything here is header-only so
+// the executable and its tests keep compiling as a single translation unit.
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "work_scheduler.h"
+
+namespace airspyhf_dsp {
+
+constexpr double kTotalDecimation = 8.0 * 5.0 * 5.0;
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kTwoPi = 6.28318530717958647692;
+
+enum class HugePageMode { Off, Transparent, Explicit };
+enum class Arithmetic { Float, Fixed };
+enum class Stage1Engine { Fir, Iir };
+
+constexpr std::size_t kSampleAlignment = 64;
+constexpr std::size_t kHugePageBytes = 2U * 1024U * 1024U;
+
+// Checkpoint fields are written one scalar at a time in host (little-endian)
+// order, the same assumption the float32 IQ payload already makes.
+class StateWriter {
+  public:
+    template <typename T> void put(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "checkpoint fields must be trivially copyable");
+        const auto *raw = reinterpret_cast<const uint8_t *>(&value);
+        bytes_.insert(bytes_.end(), raw, raw + sizeof(T));
+    }
+
+    template <typename T, typename Alloc>
+    void putSamples(const std::vector<T, Alloc> &samples) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "checkpoint samples must be trivially copyable");
+        put(static_cast<uint64_t>(samples.size()));
+        const auto *raw = reinterpret_cast<const uint8_t *>(samples.data());
+        bytes_.insert(bytes_.end(), raw, raw + samples.size() * sizeof(T));
+    }
+
+    const std::vector<uint8_t> &bytes() const { return bytes_; }
+
+  private:
+    std::vector<uint8_t> bytes_;
+};
+
+class StateReader {
+  public:
+    explicit StateReader(const std::vector<uint8_t> &bytes) : bytes_(bytes) {}
+
+    template <typename T> T get() {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "checkpoint fields must be trivially copyable");
+        require(sizeof(T));
+        T value{};
+        std::memcpy(&value, bytes_.data() + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return value;
+    }
+
+    template <typename T = std::complex<float>> std::vector<T> getSamples() {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "checkpoint samples must be trivially copyable");
+        const auto count = get<uint64_t>();
+        if (count > (bytes_.size() - offset_) / sizeof(T)) {
+            throw std::runtime_error("Checkpoint sample block truncated");
+        }
+        std::vector<T> samples(static_cast<std::size_t>(count));
+        const std::size_t bytes = samples.size() * sizeof(T);
+        if (bytes > 0U) {
+            std::memcpy(samples.data(), bytes_.data() + offset_, bytes);
+        }
+        offset_ += bytes;
+        return samples;
+    }
+
+    bool atEnd() const { return offset_ == bytes_.size(); }
+
+  private:
+    void require(std::size_t bytes) const {
+        if (bytes > bytes_.size() - offset_) {
+            throw std::runtime_error("Checkpoint truncated");
+        }
+    }
+
+    const std::vector<uint8_t> &bytes_;
+    std::size_t offset_ = 0;
+};
+
+// Hamming-windowed sinc low-pass, normalized to unity DC gain. The design
+// runs in Real so the double-precision chain gets a double-precision filter.
+template <typename Real = float>
+std::vector<Real> designLowpass(std::size_t taps, Real cutoff) {
+    if (taps < 3) {
+        taps = 3;
+    }
+    if ((taps % 2) == 0) {
+        ++taps;
+    }
+    constexpr Real pi = static_cast<Real>(3.14159265358979323846);
+    std::vector<Real> coeffs(taps);
+    const Real M = static_cast<Real>(taps - 1);
+    for (std::size_t n = 0; n < taps; ++n) {
+        const Real m = static_cast<Real>(n) - M / Real(2);
+        const Real window =
+            Real(0.54) -
+            Real(0.46) * std::cos(Real(2) * pi * static_cast<Real>(n) / M);
+        Real sinc = Real(0);
+        if (std::abs(m) < Real(1e-6)) {
+            sinc = Real(2) * cutoff;
+        } else {
+            sinc = std::sin(Real(2) * pi * cutoff * m) / (pi * m);
+        }
+        coeffs[n] = window * sinc;
+    }
+    Real sum = Real(0);
+    for (Real c : coeffs) {
+        sum += c;
+    }
+    if (sum != Real(0)) {
+        for (Real &c : coeffs) {
+            c /= sum;
+        }
+    }
+    return coeffs;
+}
+
+// Allpass coefficients of a polyphase IIR halfband low-pass (elliptic
+// design, after Valenzuela and Constantinides): passband up to
+// (0.25 - transition / 2) fs and stopband from (0.25 + transition / 2) fs.
+// Even-indexed coefficients belong to the branch fed the newer sample of
+// each input pair, odd ones to the other. Attenuation grows with the
+// coefficient count and the transition width.
+inline std::vector<double> designAllpassHalfband(std::size_t coefficients,
+                                                 double transition) {
+    if (coefficients == 0 || !(transition > 0.0) || !(transition < 0.5)) {
+        throw std::runtime_error("Invalid allpass halfband specification");
+    }
+    constexpr double pi = 3.14159265358979323846;
+    double k = std::tan((1.0 - transition * 2.0) * pi / 4.0);
+    k *= k;
+    const double kRoot = std::pow(1.0 - k * k, 0.25);
+    const double e = 0.5 * (1.0 - kRoot) / (1.0 + kRoot);
+    const double e4 = e * e * e * e;
+    // Nome of the elliptic modulus, from its series in e.
+    const double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+    const double order = static_cast<double>(coefficients * 2 + 1);
+
+    std::vector<double> result;
+    for (std::size_t index = 0; index < coefficients; ++index) {
+        const double c = static_cast<double>(index + 1);
+        double numerator = 0.0;
+        double term = 0.0;
+        double sign = 1.0;
+        for (int i = 0; i == 0 || std::abs(term) > 1e-100; ++i, sign = -sign) {
+            term = sign * std::pow(q, i * (i + 1)) *
+                   std::sin((i * 2 + 1) * c * pi / order);
+            numerator += term;
+        }
+        double denominator = 0.0;
+        sign = -1.0;
+        for (int i = 1; i == 1 || std::abs(term) > 1e-100; ++i, sign = -sign) {
+            term = sign * std::pow(q, i * i) * std::cos(i * 2 * c * pi / order);
+            denominator += term;
+        }
+        const double w = numerator * std::pow(q, 0.25) / (denominator + 0.5);
+        const double w2 = w * w;
+        const double x =
+            std::sqrt((1.0 - w2 * k) * (1.0 - w2 / k)) / (1.0 + w2);
+        result.push_back((1.0 - x) / (1.0 + x));
+    }
+    return result;
+}
+
+inline std::atomic<HugePageMode> gHugePageMode{HugePageMode::Off};
+
+inline const char *hugePageModeName(HugePageMode mode) {
+    switch (mode) {
+    case HugePageMode::Transparent:
+        return "thp";
+    case HugePageMode::Explicit:
+        return "explicit";
+    case HugePageMode::Off:
+        break;
+    }
+    return "off";
+}
+
+// Sample storage is 64-byte aligned so vector loads never split a cache line.
+// Blocks of at least kHugePageBytes may additionally be placed on huge pages
+// (per --hugepages); a small prefix records how each block was obtained so it
+// is released the same way regardless of later mode changes.
+template <typename T> struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) noexcept {}
+
+    T *allocate(std::size_t count) {
+        if (count > (std::numeric_limits<std::size_t>::max() - kPrefixBytes) /
+                        sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        const std::size_t userBytes = count * sizeof(T);
+        const HugePageMode mode = gHugePageMode.load(std::memory_order_relaxed);
+        Kind kind = Kind::Heap;
+        std::size_t total = roundUp(userBytes + kPrefixBytes, kSampleAlignment);
+        void *raw = nullptr;
+
+        if (mode == HugePageMode::Explicit && userBytes >= kHugePageBytes) {
+            total = roundUp(userBytes + kPrefixBytes, kHugePageBytes);
+            raw = ::mmap(nullptr, total, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (raw == MAP_FAILED) {
+                raw = nullptr;
+            } else {
+                kind = Kind::HugeTlb;
+            }
+        }
+        if (raw == nullptr && mode != HugePageMode::Off &&
+            userBytes >= kHugePageBytes) {
+            total = roundUp(userBytes + kPrefixBytes, kHugePageBytes);
+            raw = std::aligned_alloc(kHugePageBytes, total);
+            if (raw != nullptr) {
+                (void)::madvise(raw, total, MADV_HUGEPAGE);
+            }
+        }
+        if (raw == nullptr) {
+            total = roundUp(userBytes + kPrefixBytes, kSampleAlignment);
+            raw = std::aligned_alloc(kSampleAlignment, total);
+        }
+        if (raw == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        auto *prefix = static_cast<Prefix *>(raw);
+        prefix->kind = kind;
+        prefix->totalBytes = total;
+        return reinterpret_cast<T *>(static_cast<uint8_t *>(raw) +
+                                     kPrefixBytes);
+    }
+
+    void deallocate(T *pointer, std::size_t) noexcept {
+        if (pointer == nullptr) {
+            return;
+        }
+        void *raw = reinterpret_cast<uint8_t *>(pointer) - kPrefixBytes;
+        const auto *prefix = static_cast<const Prefix *>(raw);
+        if (prefix->kind == Kind::HugeTlb) {
+            ::munmap(raw, prefix->totalBytes);
+        } else {
+            std::free(raw);
+        }
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U> &) const {
+        return true;
+    }
+    template <typename U> bool operator!=(const AlignedAllocator<U> &) const {
+        return false;
+    }
+
+  private:
+    enum class Kind : uint32_t { Heap, HugeTlb };
+    struct Prefix {
+        Kind kind;
+        std::size_t totalBytes;
+    };
+    static constexpr std::size_t kPrefixBytes = kSampleAlignment;
+    static_assert(sizeof(Prefix) <= kPrefixBytes, "allocator prefix too big");
+
+    static std::size_t roundUp(std::size_t value, std::size_t multiple) {
+        return ((value + multiple - 1) / multiple) * multiple;
+    }
+};
+
+using SampleVector =
+    std::vector<std::complex<float>, AlignedAllocator<std::complex<float>>>;
+// Ring buffer whose backing pages are mapped twice, back to back, so the
+// element at index i is also visible at i + capacity(). Any window of up to
+// capacity() elements starting inside the ring is therefore contiguous and
+// can be read without wraparound handling.
+template <typename T> class MirroredRing {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "MirroredRing elements must be trivially copyable");
+
+  public:
+    explicit MirroredRing(std::size_t minCapacity) {
+        const std::size_t pageSize =
+            static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        if (pageSize % sizeof(T) != 0) {
+            throw std::invalid_argument(
+                "MirroredRing element size must divide the page size");
+        }
+        const std::size_t minBytes = std::max<std::size_t>(minCapacity, 1) *
+                                     sizeof(T);
+        bytes_ = ((minBytes + pageSize - 1) / pageSize) * pageSize;
+        capacity_ = bytes_ / sizeof(T);
+        map();
+    }
+
+    MirroredRing(const MirroredRing &other)
+        : bytes_(other.bytes_), capacity_(other.capacity_) {
+        map();
+        std::memcpy(base_, other.base_, bytes_);
+    }
+
+    MirroredRing(MirroredRing &&other) noexcept
+        : base_(std::exchange(other.base_, nullptr)),
+          bytes_(std::exchange(other.bytes_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {}
+
+    MirroredRing &operator=(MirroredRing other) noexcept {
+        std::swap(base_, other.base_);
+        std::swap(bytes_, other.bytes_);
+        std::swap(capacity_, other.capacity_);
+        return *this;
+    }
+
+    ~MirroredRing() {
+        if (base_ != nullptr) {
+            ::munmap(base_, bytes_ * 2);
+        }
+    }
+
+    std::size_t capacity() const { return capacity_; }
+
+    // Valid for indices in [0, 2 * capacity()).
+    T *data() { return static_cast<T *>(base_); }
+    const T *data() const { return static_cast<const T *>(base_); }
+    T &operator[](std::size_t index) { return data()[index]; }
+    const T &operator[](std::size_t index) const { return data()[index]; }
+
+  private:
+    void map() {
+        const int fd = ::memfd_create("airspyhf_ring", MFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("memfd_create failed for ring buffer");
+        }
+        if (::ftruncate(fd, static_cast<off_t>(bytes_)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("ftruncate failed for ring buffer");
+        }
+        void *reserved = ::mmap(nullptr, bytes_ * 2, PROT_NONE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("mmap reservation failed for ring buffer");
+        }
+        auto *base = static_cast<uint8_t *>(reserved);
+        void *first = ::mmap(base, bytes_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_FIXED, fd, 0);
+        void *second = ::mmap(base + bytes_, bytes_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_FIXED, fd, 0);
+        ::close(fd);
+        if (first == MAP_FAILED || second == MAP_FAILED) {
+            ::munmap(reserved, bytes_ * 2);
+            throw std::runtime_error("mmap mirror failed for ring buffer");
+        }
+        base_ = reserved;
+    }
+
+    void *base_ = nullptr;
+    std::size_t bytes_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+using cf32 = std::complex<float>;
+using cf64 = std::complex<double>;
+
+// Interleaved int16 IQ, full scale +/-32767 corresponding to +/-1.0f.
+struct ci16 {
+    int16_t i = 0;
+    int16_t q = 0;
+};
+
+inline bool operator==(const ci16 &left, const ci16 &right) {
+    return left.i == right.i && left.q == right.q;
+}
+inline bool operator!=(const ci16 &left, const ci16 &right) {
+    return !(left == right);
+}
+
+inline int16_t saturateToInt16(double value) {
+    const double rounded = std::nearbyint(value);
+    if (rounded > 32767.0) {
+        return 32767;
+    }
+    if (rounded < -32768.0) {
+        return -32768;
+    }
+    return static_cast<int16_t>(rounded);
+}
+
+// Per-sample-type arithmetic for the DSP chain: the real type the filter is
+// designed in, how coefficients are stored, and how products accumulate.
+template <typename Sample> struct SampleTraits;
+
+template <> struct SampleTraits<cf32> {
+    using Real = float;
+    using Coeff = float;
+    using Accumulator = cf32;
+
+    static Coeff coefficient(Real value) { return value; }
+    static Accumulator zero() { return {0.0f, 0.0f}; }
+    static void mac(Accumulator &acc, const cf32 &sample, Coeff coeff) {
+        acc += sample * coeff;
+    }
+    static cf32 finish(const Accumulator &acc) { return acc; }
+    static cf32 fromFloat(float i, float q) { return {i, q}; }
+    static cf32 rotate(const cf32 &sample, double c, double s) {
+        return sample * cf32(static_cast<float>(c), static_cast<float>(s));
+    }
+};
+
+template <> struct SampleTraits<cf64> {
+    using Real = double;
+    using Coeff = double;
+    using Accumulator = cf64;
+
+    static Coeff coefficient(Real value) { return value; }
+    static Accumulator zero() { return {0.0, 0.0}; }
+    static void mac(Accumulator &acc, const cf64 &sample, Coeff coeff) {
+        acc += sample * coeff;
+    }
+    static cf64 finish(const Accumulator &acc) { return acc; }
+    static cf64 fromFloat(float i, float q) {
+        return {static_cast<double>(i), static_cast<double>(q)};
+    }
+    static cf64 rotate(const cf64 &sample, double c, double s) {
+        return sample * cf64(c, s);
+    }
+};
+
+// Q15 coefficients against int16 samples; products are Q30 and accumulate
+// exactly in 64 bits before rounding back to int16.
+template <> struct SampleTraits<ci16> {
+    using Real = double;
+    using Coeff = int16_t;
+    struct Accumulator {
+        int64_t i = 0;
+        int64_t q = 0;
+    };
+
+    static Coeff coefficient(Real value) {
+        return saturateToInt16(value * 32768.0);
+    }
+    static Accumulator zero() { return {}; }
+    static void mac(Accumulator &acc, const ci16 &sample, Coeff coeff) {
+        acc.i += static_cast<int64_t>(sample.i) * coeff;
+        acc.q += static_cast<int64_t>(sample.q) * coeff;
+    }
+    static ci16 finish(const Accumulator &acc) {
+        return {saturateToInt16(static_cast<double>(acc.i) / 32768.0),
+                saturateToInt16(static_cast<double>(acc.q) / 32768.0)};
+    }
+    static ci16 fromFloat(float i, float q) {
+        return {saturateToInt16(static_cast<double>(i) * 32767.0),
+                saturateToInt16(static_cast<double>(q) * 32767.0)};
+    }
+    static ci16 rotate(const ci16 &sample, double c, double s) {
+        const double i = static_cast<double>(sample.i);
+        const double q = static_cast<double>(sample.q);
+        return {saturateToInt16(i * c - q * s), saturateToInt16(i * s + q * c)};
+    }
+};
+
+inline int32_t saturatingAdd(int32_t left, int32_t right) {
+    int32_t result = 0;
+    if (__builtin_add_overflow(left, right, &result)) {
+        return (right > 0) ? std::numeric_limits<int32_t>::max()
+                           : std::numeric_limits<int32_t>::min();
+    }
+    return result;
+}
+
+// Rounds a Q30 value back to Q15 with int16 saturation.
+inline int16_t roundQ30ToQ15(int64_t value) {
+    const int64_t rounded = (value + (int64_t{1} << 14)) >> 15;
+    return static_cast<int16_t>(
+        std::clamp<int64_t>(rounded, std::numeric_limits<int16_t>::min(),
+                            std::numeric_limits<int16_t>::max()));
+}
+
+// Fixed-point arithmetic for FPU-weak targets: the Q15 coefficients of the
+// ci16 chain, but with 32-bit accumulators that saturate instead of wrapping.
+// A unity-gain design keeps the sum of |coefficients| near 1, so saturation
+// only triggers on near-full-scale input.
+struct SaturatingQ15Traits : SampleTraits<ci16> {
+    struct Accumulator {
+        int32_t i = 0;
+        int32_t q = 0;
+    };
+
+    static Accumulator zero() { return {}; }
+    static void mac(Accumulator &acc, const ci16 &sample, Coeff coeff) {
+        acc.i = saturatingAdd(acc.i, static_cast<int32_t>(sample.i) * coeff);
+        acc.q = saturatingAdd(acc.q, static_cast<int32_t>(sample.q) * coeff);
+    }
+    static ci16 finish(const Accumulator &acc) {
+        return {roundQ30ToQ15(acc.i), roundQ30ToQ15(acc.q)};
+    }
+};
+
+template <typename Sample>
+using SampleBuffer = std::vector<Sample, AlignedAllocator<Sample>>;
+
+template <typename Sample, typename Traits = SampleTraits<Sample>>
+class BasicFirDecimator {
+  public:
+    using Real = typename Traits::Real;
+    using Coeff = typename Traits::Coeff;
+
+    BasicFirDecimator(int factor, std::size_t taps, float cutoff)
+        : factor_(factor), history_(designedTapCount(taps)) {
+        const auto design =
+            designLowpass<Real>(taps, static_cast<Real>(cutoff));
+        // Stored oldest-first so each output is a forward dot product over
+        // the contiguous history window.
+        taps_.reserve(design.size());
+        for (auto it = design.rbegin(); it != design.rend(); ++it) {
+            taps_.push_back(Traits::coefficient(*it));
+        }
+        std::fill(history_.data(), history_.data() + history_.capacity(),
+                  Sample{});
+    }
+
+    template <typename Alloc>
+    SampleBuffer<Sample> process(const std::vector<Sample, Alloc> &input) {
+        return process(input.data(), input.size());
+    }
+
+    SampleBuffer<Sample> process(const Sample *input, std::size_t count) {
+        SampleBuffer<Sample> output;
+        if (factor_ <= 0 || taps_.empty()) {
+            return output;
+        }
+        output.reserve(count / factor_ + 1);
+        const std::size_t capacity = history_.capacity();
+        const std::size_t tapCount = taps_.size();
+        for (std::size_t index = 0; index < count; ++index) {
+            history_[writeIndex_] = input[index];
+            if (++writeIndex_ == capacity) {
+                writeIndex_ = 0;
+            }
+            phase_ = (phase_ + 1) % factor_;
+            if (phase_ == 0) {
+                output.push_back(
+                    dot(history_.data() + writeIndex_ + capacity - tapCount));
+            }
+        }
+        return output;
+    }
+
+    // Outputs a process() call over count samples would produce.
+    std::size_t outputCount(std::size_t count) const {
+        return (static_cast<std::size_t>(phase_) + count) /
+               static_cast<std::size_t>(factor_);
+    }
+
+    // Zeroes the history, keeping the decimation phase, so later outputs
+    // carry nothing from earlier input.
+    void clearHistory() {
+        std::fill(history_.data(), history_.data() + history_.capacity(),
+                  Sample{});
+    }
+
+    // Stands in for count samples of discarded input without filtering
+    // them: clears the history and advances the phase. Returns the outputs
+    // that span covers, which the caller treats as silence.
+    std::size_t blank(std::size_t count) {
+        const std::size_t outputs = outputCount(count);
+        clearHistory();
+        phase_ = static_cast<int>((static_cast<std::size_t>(phase_) + count) %
+                                  static_cast<std::size_t>(factor_));
+        return outputs;
+    }
+
+    // Same outputs and end state as process(), but the outputs are computed
+    // in independent segments. forEachSegment(outputs, segment) must call
+    // segment(begin, end) over a partition of [0, outputs), possibly
+    // concurrently, and return once every call has finished. Each segment
+    // reads the tapCount - 1 samples before its first output as overlap;
+    // for the first segment those come from the history.
+    template <typename ForEachSegment>
+    SampleBuffer<Sample> processSegmented(const Sample *input,
+                                          std::size_t count,
+                                          ForEachSegment &&forEachSegment) {
+        SampleBuffer<Sample> output;
+        if (factor_ <= 0 || taps_.empty()) {
+            return output;
+        }
+        const std::size_t overlap = taps_.size() - 1;
+        const std::size_t factor = static_cast<std::size_t>(factor_);
+        // Windows that straddle the block start read from the history tail
+        // followed by the first inputs.
+        const Sample *historyTail =
+            history_.data() + writeIndex_ + history_.capacity() - overlap;
+        head_.resize(overlap + std::min(count, overlap));
+        std::copy(historyTail, historyTail + overlap, head_.begin());
+        std::copy(input, input + std::min(count, overlap),
+                  head_.begin() + overlap);
+
+        output.resize(outputCount(count));
+        const std::size_t firstInput =
+            factor - 1 - static_cast<std::size_t>(phase_);
+        const Sample *head = head_.data();
+        Sample *out = output.data();
+        forEachSegment(output.size(), [&, input, head, out](std::size_t begin,
+                                                            std::size_t end) {
+            for (std::size_t index = begin; index < end; ++index) {
+                const std::size_t newest = firstInput + index * factor;
+                out[index] = dot((newest >= overlap)
+                                     ? input + (newest - overlap)
+                                     : head + newest);
+            }
+        });
+        advance(input, count);
+        return output;
+    }
+
+    void save(StateWriter &writer) const {
+        const std::size_t tapCount = taps_.size();
+        const Sample *window =
+            history_.data() + writeIndex_ + history_.capacity() - tapCount;
+        writer.put(static_cast<int32_t>(factor_));
+        writer.put(static_cast<uint64_t>(tapCount));
+        writer.put(static_cast<int32_t>(phase_));
+        writer.putSamples(std::vector<Sample>(window, window + tapCount));
+    }
+
+    void restore(StateReader &reader) {
+        const auto factor = reader.get<int32_t>();
+        const auto taps = reader.get<uint64_t>();
+        const auto phase = reader.get<int32_t>();
+        const auto window = reader.getSamples<Sample>();
+        if (factor != factor_ || taps != taps_.size() ||
+            window.size() != taps_.size() || phase < 0 || phase >= factor_) {
+            throw std::runtime_error(
+                "Checkpoint FIR stage does not match configured design");
+        }
+        std::copy(window.begin(), window.end(), history_.data());
+        writeIndex_ = window.size() % history_.capacity();
+        phase_ = phase;
+    }
+
+  private:
+    static std::size_t designedTapCount(std::size_t taps) {
+        taps = std::max<std::size_t>(taps, 3);
+        return ((taps % 2) == 0) ? taps + 1 : taps;
+    }
+
+    // Shared by process() and processSegmented() so both accumulate in
+    // exactly the same order.
+    Sample dot(const Sample *window) const {
+        auto acc = Traits::zero();
+        for (std::size_t k = 0; k < taps_.size(); ++k) {
+            Traits::mac(acc, window[k], taps_[k]);
+        }
+        return Traits::finish(acc);
+    }
+
+    // Leaves the history and phase as process() would after count samples.
+    void advance(const Sample *input, std::size_t count) {
+        const std::size_t capacity = history_.capacity();
+        const std::size_t kept = std::min(count, capacity);
+        std::size_t position = (writeIndex_ + count - kept) % capacity;
+        for (std::size_t index = count - kept; index < count; ++index) {
+            history_[position] = input[index];
+            if (++position == capacity) {
+                position = 0;
+            }
+        }
+        writeIndex_ = position;
+        phase_ = static_cast<int>((static_cast<std::size_t>(phase_) + count) %
+                                  static_cast<std::size_t>(factor_));
+    }
+
+    int factor_;
+    std::vector<Coeff> taps_;
+    MirroredRing<Sample> history_;
+    std::size_t writeIndex_ = 0;
+    int phase_ = 0;
+    SampleBuffer<Sample> head_;
+};
+
+template <typename Sample> class BasicFrequencyShifter {
+  public:
+    using Traits = SampleTraits<Sample>;
+
+    BasicFrequencyShifter(double sampleRate, double shiftHz)
+        : shiftHz_(shiftHz) {
+        if (sampleRate <= 0.0) {
+            sampleRate = 1.0;
+        }
+        step_ = (shiftHz_ == 0.0) ? 0.0 : (kTwoPi * shiftHz_ / sampleRate);
+    }
+
+    template <typename Alloc> void mix(std::vector<Sample, Alloc> &samples) {
+        mix(samples.data(), samples.size());
+    }
+
+    void mix(Sample *samples, std::size_t count) {
+        if (shiftHz_ == 0.0 || count == 0) {
+            return;
+        }
+        for (std::size_t index = 0; index < count; ++index) {
+            samples[index] = Traits::rotate(samples[index], std::cos(phase_),
+                                            std::sin(phase_));
+            phase_ += step_;
+            if (phase_ > kPi) {
+                phase_ -= kTwoPi;
+            } else if (phase_ < -kPi) {
+                phase_ += kTwoPi;
+            }
+        }
+    }
+
+    // Moves the phase on as if count samples had been mixed.
+    void advance(std::size_t count) {
+        phase_ = std::remainder(phase_ + step_ * static_cast<double>(count),
+                                kTwoPi);
+    }
+
+    void resetPhase() { phase_ = 0.0; }
+
+    void save(StateWriter &writer) const { writer.put(phase_); }
+
+    void restore(StateReader &reader) {
+        const auto phase = reader.get<double>();
+        if (!std::isfinite(phase) || std::abs(phase) > kTwoPi) {
+            throw std::runtime_error("Checkpoint mixer phase out of range");
+        }
+        phase_ = phase;
+    }
+
+  private:
+    double shiftHz_ = 0.0;
+    double step_ = 0.0;
+    double phase_ = 0.0;
+};
+
+// Integer NCO for the fixed-point pipeline: a 32-bit phase accumulator
+// indexing a Q15 sine table, so the shift needs no floating point per sample.
+// The 4096-entry table keeps phase-truncation spurs near -72 dBc.
+class IntegerNcoShifter {
+  public:
+    IntegerNcoShifter(double sampleRate, double shiftHz) {
+        if (sampleRate <= 0.0) {
+            sampleRate = 1.0;
+        }
+        const double cycles = std::fmod(shiftHz / sampleRate, 1.0);
+        step_ = static_cast<uint32_t>(
+            static_cast<int64_t>(std::llround(cycles * 4294967296.0)));
+    }
+
+    template <typename Alloc> void mix(std::vector<ci16, Alloc> &samples) {
+        mix(samples.data(), samples.size());
+    }
+
+    void mix(ci16 *samples, std::size_t count) {
+        if (step_ == 0) {
+            return;
+        }
+        const auto &table = sineTable();
+        for (std::size_t index = 0; index < count; ++index) {
+            const uint32_t entry = phase_ >> (32 - kTableBits);
+            const int32_t s = table[entry];
+            const int32_t c = table[(entry + kTableSize / 4) & (kTableSize - 1)];
+            const int32_t i = samples[index].i;
+            const int32_t q = samples[index].q;
+            samples[index] = {roundQ30ToQ15(int64_t{i} * c - int64_t{q} * s),
+                              roundQ30ToQ15(int64_t{i} * s + int64_t{q} * c)};
+            phase_ += step_;
+        }
+    }
+
+    void advance(std::size_t count) {
+        phase_ += step_ * static_cast<uint32_t>(count);
+    }
+
+    void resetPhase() { phase_ = 0; }
+
+  private:
+    static constexpr uint32_t kTableBits = 12;
+    static constexpr uint32_t kTableSize = 1U << kTableBits;
+
+    static const std::vector<int16_t> &sineTable() {
+        static const std::vector<int16_t> table = [] {
+            std::vector<int16_t> values(kTableSize);
+            for (uint32_t k = 0; k < kTableSize; ++k) {
+                values[k] = saturateToInt16(
+                    32767.0 * std::sin(kTwoPi * k / kTableSize));
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    uint32_t step_ = 0;
+    uint32_t phase_ = 0;
+};
+
+using FirDecimator = BasicFirDecimator<cf32>;
+using FrequencyShifter = BasicFrequencyShifter<cf32>;
+using FixedFirDecimator = BasicFirDecimator<ci16, SaturatingQ15Traits>;
+
+// Decimate-by-2 polyphase IIR halfband. Each input pair feeds two chains
+// of first-order allpass sections (a + z^-1) / (1 + a z^-1) running at the
+// output rate, and the output is their average: two multiplies per
+// coefficient per output, a fraction of a halfband FIR of the same
+// attenuation, at the price of a non-linear phase.
+template <std::size_t Coefficients> class AllpassHalfbandDecimator {
+  public:
+    explicit AllpassHalfbandDecimator(double transition) {
+        const auto design = designAllpassHalfband(Coefficients, transition);
+        for (std::size_t index = 0; index < Coefficients; ++index) {
+            a_[index] = static_cast<float>(design[index]);
+        }
+    }
+
+    // Appends the outputs for count inputs.
+    void process(const cf32 *input, std::size_t count, SampleVector &output) {
+        const std::size_t first = output.size();
+        output.resize(first + outputCount(count));
+        cf32 *out = output.data() + first;
+        // Local copies let the section states live in registers.
+        auto x = x_;
+        auto y = y_;
+        std::size_t index = 0;
+        if (pending_ && count > 0) {
+            *out++ = pair(older_, input[0], x, y);
+            pending_ = false;
+            index = 1;
+        }
+        for (; index + 1 < count; index += 2) {
+            *out++ = pair(input[index], input[index + 1], x, y);
+        }
+        if (index < count) {
+            older_ = input[index];
+            pending_ = true;
+        }
+        x_ = x;
+        y_ = y;
+    }
+
+    std::size_t outputCount(std::size_t count) const {
+        return ((pending_ ? 1U : 0U) + count) / 2;
+    }
+
+    // Zeroes the section states and any held sample, keeping the phase.
+    void clearHistory() {
+        x_.fill({});
+        y_.fill({});
+        older_ = {};
+    }
+
+    // As BasicFirDecimator::blank().
+    std::size_t blank(std::size_t count) {
+        const std::size_t outputs = outputCount(count);
+        clearHistory();
+        pending_ = (((pending_ ? 1U : 0U) + count) % 2) != 0;
+        return outputs;
+    }
+
+  private:
+    using States = std::array<cf32, Coefficients>;
+
+    // Even coefficients filter the newer sample of the pair, odd ones the
+    // older. Each section computes a x + x' - a y', so its recursion runs
+    // through one multiply and one subtract.
+    cf32 pair(cf32 older, cf32 newer, States &x, States &y) const {
+        for (std::size_t section = 0; section < Coefficients; section += 2) {
+            const cf32 result =
+                (newer * a_[section] + x[section]) - y[section] * a_[section];
+            x[section] = newer;
+            y[section] = result;
+            newer = result;
+        }
+        for (std::size_t section = 1; section < Coefficients; section += 2) {
+            const cf32 result =
+                (older * a_[section] + x[section]) - y[section] * a_[section];
+            x[section] = older;
+            y[section] = result;
+            older = result;
+        }
+        return 0.5f * (newer + older);
+    }
+
+    std::array<float, Coefficients> a_{};
+    States x_{};
+    States y_{};
+    cf32 older_{};
+    bool pending_ = false;
+};
+
+// The IIR stage-1 engine: decimation by 8 as three allpass halfbands. Each
+// passes the 0.4 x 96 kHz band that the FIR stage 1 keeps, and puts every
+// alias landing in it about 100 dB down, with 5 multiplies per input
+// sample against the FIR's 16 multiply-adds. The group delay is about
+// 19 input samples near DC, rising to about 39 at the band edge; see the
+// README for the full curve.
+class IirStage1Decimator {
+  public:
+    IirStage1Decimator() : halfband1_(0.4), halfband2_(0.3), halfband3_(0.1) {}
+
+    SampleVector process(const SampleVector &input) {
+        scratch1_.clear();
+        halfband1_.process(input.data(), input.size(), scratch1_);
+        scratch2_.clear();
+        halfband2_.process(scratch1_.data(), scratch1_.size(), scratch2_);
+        SampleVector output;
+        halfband3_.process(scratch2_.data(), scratch2_.size(), output);
+        return output;
+    }
+
+    std::size_t outputCount(std::size_t count) const {
+        return halfband3_.outputCount(
+            halfband2_.outputCount(halfband1_.outputCount(count)));
+    }
+
+    void clearHistory() {
+        halfband1_.clearHistory();
+        halfband2_.clearHistory();
+        halfband3_.clearHistory();
+    }
+
+    std::size_t blank(std::size_t count) {
+        return halfband3_.blank(halfband2_.blank(halfband1_.blank(count)));
+    }
+
+  private:
+    AllpassHalfbandDecimator<2> halfband1_;
+    AllpassHalfbandDecimator<3> halfband2_;
+    AllpassHalfbandDecimator<6> halfband3_;
+    SampleVector scratch1_;
+    SampleVector scratch2_;
+};
+
+// The --arith fixed chain. Samples stay Q15 from parse to stage 3; the only
+// conversion back to float is toFloatSamples() at frame assembly.
+struct FixedPointChain {
+    FixedPointChain(double inputRate, double shiftHz)
+        : shifter(inputRate, shiftHz), stage1(8, 8 * 16, 0.45f / 8.0f),
+          stage2(5, 5 * 16, 0.45f / 5.0f), stage3(5, 5 * 16, 0.45f / 5.0f) {}
+
+    IntegerNcoShifter shifter;
+    FixedFirDecimator stage1;
+    FixedFirDecimator stage2;
+    FixedFirDecimator stage3;
+};
+
+template <typename Alloc>
+SampleVector toFloatSamples(const std::vector<ci16, Alloc> &samples) {
+    constexpr float scale = 1.0f / 32767.0f;
+    SampleVector result(samples.size());
+    for (std::size_t index = 0; index < samples.size(); ++index) {
+        result[index] = {static_cast<float>(samples[index].i) * scale,
+                         static_cast<float>(samples[index].q) * scale};
+    }
+    return result;
+}
+
+// Straight-line fit of a reference clock against the input sample index
+// over a sliding window, e.g. the publisher's packet timestamps against
+// the samples received. The slope gives the sample clock's true rate in
+// the reference clock, and the line maps a sample index to its reference
+// time with the per-packet timestamp jitter averaged out.
+class DriftEstimator {
+  public:
+    static constexpr double kWindowSeconds = 60.0;
+    // Shortest span fitted before ready(); timestamps jitter by around a
+    // millisecond, so this bounds the first estimate to a few hundred ppm
+    // at worst and it tightens as the window fills.
+    static constexpr double kMinSpanSeconds = 5.0;
+
+    explicit DriftEstimator(double nominalRate,
+                            double windowSeconds = kWindowSeconds)
+        : nominalRate_(nominalRate), windowUs_(windowSeconds * 1e6) {}
+
+    // One point per packet: the index of its first sample and its
+    // timestamp. Time running backwards starts a new fit.
+    void observe(uint64_t sampleIndex, uint64_t referenceUs) {
+        if (!points_.empty() && (referenceUs < points_.back().referenceUs ||
+                                 sampleIndex < points_.back().sampleIndex)) {
+            restart();
+        }
+        points_.push_back({sampleIndex, referenceUs});
+        while (static_cast<double>(referenceUs -
+                                   points_.front().referenceUs) > windowUs_) {
+            points_.pop_front();
+        }
+        fit();
+    }
+
+    // The index and the timestamps no longer line up, e.g. after lost
+    // packets: drops the window but keeps the last estimate in ppm().
+    void restart() {
+        points_.clear();
+        ready_ = false;
+    }
+
+    bool ready() const { return ready_; }
+
+    // Sample clock error against the reference; positive when the sample
+    // clock runs fast. The last fitted value while not ready().
+    double ppm() const {
+        return 1e6 * (1e6 / (slopeUs_ * nominalRate_) - 1.0);
+    }
+
+    double referenceUsAt(double sampleIndex) const {
+        return originUs_ + meanUs_ + slopeUs_ * (sampleIndex - originIndex_ -
+                                                 meanIndex_);
+    }
+
+  private:
+    struct Point {
+        uint64_t sampleIndex;
+        uint64_t referenceUs;
+    };
+
+    // Least squares around the first point of the window, so the sums
+    // stay small enough for double precision.
+    void fit() {
+        ready_ = false;
+        const double spanUs = static_cast<double>(points_.back().referenceUs -
+                                                  points_.front().referenceUs);
+        if (points_.size() < 3 || spanUs < kMinSpanSeconds * 1e6) {
+            return;
+        }
+        const uint64_t index0 = points_.front().sampleIndex;
+        const uint64_t time0 = points_.front().referenceUs;
+        double sumX = 0.0;
+        double sumY = 0.0;
+        for (const Point &point : points_) {
+            sumX += static_cast<double>(point.sampleIndex - index0);
+            sumY += static_cast<double>(point.referenceUs - time0);
+        }
+        const double count = static_cast<double>(points_.size());
+        const double meanX = sumX / count;
+        const double meanY = sumY / count;
+        double sumXX = 0.0;
+        double sumXY = 0.0;
+        for (const Point &point : points_) {
+            const double x =
+                static_cast<double>(point.sampleIndex - index0) - meanX;
+            const double y =
+                static_cast<double>(point.referenceUs - time0) - meanY;
+            sumXX += x * x;
+            sumXY += x * y;
+        }
+        if (!(sumXX > 0.0) || !(sumXY > 0.0)) {
+            return;
+        }
+        slopeUs_ = sumXY / sumXX;
+        originIndex_ = static_cast<double>(index0);
+        originUs_ = static_cast<double>(time0);
+        meanIndex_ = meanX;
+        meanUs_ = meanY;
+        ready_ = true;
+    }
+
+    double nominalRate_;
+    double windowUs_;
+    std::deque<Point> points_;
+    double slopeUs_ = 1e6 / nominalRate_;
+    double originIndex_ = 0.0;
+    double originUs_ = 0.0;
+    double meanIndex_ = 0.0;
+    double meanUs_ = 0.0;
+    bool ready_ = false;
+};
+
+// Cubic Lagrange interpolator in Farrow form for rate changes within a
+// fraction of a percent of 1: each output is one polynomial in the
+// fractional position evaluated over four inputs, so the ratio can change
+// between any two samples without redesigning a filter. step is the input
+// samples advanced per output sample. Output lags input by two samples.
+class FarrowResampler {
+  public:
+    FarrowResampler() { reset(); }
+
+    void setStep(double step) { step_ = step; }
+    double step() const { return step_; }
+
+    // Input index, counted from the first sample after reset(), at which
+    // the next output is interpolated.
+    double nextPosition() const {
+        return static_cast<double>(consumed_) - kHistory + position_;
+    }
+    uint64_t outputs() const { return outputs_; }
+
+    void reset() {
+        window_.assign(kHistory, {});
+        position_ = kHistory;
+        consumed_ = 0;
+        outputs_ = 0;
+    }
+
+    // Replaces output with the samples due up to the end of input.
+    void process(const SampleVector &input, SampleVector &output) {
+        output.clear();
+        window_.resize(kHistory);
+        window_.insert(window_.end(), input.begin(), input.end());
+        const double limit = static_cast<double>(window_.size() - 2);
+        while (position_ < limit) {
+            const auto n = static_cast<std::size_t>(position_);
+            const auto mu = static_cast<float>(position_ - n);
+            const std::complex<float> before = window_[n - 1];
+            const std::complex<float> x0 = window_[n];
+            const std::complex<float> x1 = window_[n + 1];
+            const std::complex<float> x2 = window_[n + 2];
+            const std::complex<float> c1 =
+                x1 - before * (1.0f / 3.0f) - x0 * 0.5f - x2 * (1.0f / 6.0f);
+            const std::complex<float> c2 = (before + x1) * 0.5f - x0;
+            const std::complex<float> c3 =
+                (x2 - before) * (1.0f / 6.0f) + (x0 - x1) * 0.5f;
+            output.push_back(((c3 * mu + c2) * mu + c1) * mu + x0);
+            position_ += step_;
+        }
+        outputs_ += output.size();
+        consumed_ += input.size();
+        position_ -= static_cast<double>(input.size());
+        std::copy(window_.end() - kHistory, window_.end(), window_.begin());
+    }
+
+  private:
+    // Inputs kept from the previous block: the interpolation at n needs
+    // n - 1 through n + 2.
+    static constexpr std::size_t kHistory = 3;
+
+    SampleVector window_;
+    double step_ = 1.0;
+    // Position of the next output in window_.
+    double position_ = 0.0;
+    uint64_t consumed_ = 0;
+    uint64_t outputs_ = 0;
+};
+
+// Puts a decimated channel onto the nominal output grid of a reference
+// clock: output k lands at reference time anchor + k / outputRate. The
+// estimated drift sets the resampler step and a slow proportional term
+// removes the time error left while the estimate settles or wanders.
+class DriftCompensator {
+  public:
+    // The proportional term would take this long to remove a time error.
+    static constexpr double kSettleSeconds = 30.0;
+    // Bounds on the step's drift and correction terms.
+    static constexpr double kMaxDriftPpm = 1000.0;
+    static constexpr double kMaxCorrectionPpm = 100.0;
+
+    DriftCompensator(double inputRate, double decimation)
+        : estimator_(inputRate), decimation_(decimation),
+          outputRate_(inputRate / decimation) {}
+
+    // The reference time of input sample inputIndex, normally the first
+    // sample of the next block; contiguous is false when samples went
+    // missing since the last call.
+    void observe(uint64_t inputIndex, uint64_t referenceUs, bool contiguous) {
+        if (!contiguous) {
+            estimator_.restart();
+            locked_ = false;
+        }
+        estimator_.observe(inputIndex, referenceUs);
+        if (!estimator_.ready()) {
+            return;
+        }
+        const double outputUs = static_cast<double>(resampler_.outputs()) *
+                                1e6 / outputRate_;
+        const double referenceNowUs = estimator_.referenceUsAt(
+            resampler_.nextPosition() * decimation_);
+        if (!locked_) {
+            anchorUs_ = referenceNowUs - outputUs;
+            locked_ = true;
+        }
+        // Positive when the input being interpolated is later than its
+        // output slot, i.e. input is being consumed too fast.
+        timeErrorUs_ = referenceNowUs - (anchorUs_ + outputUs);
+        const double drift =
+            std::clamp(estimator_.ppm(), -kMaxDriftPpm, kMaxDriftPpm) * 1e-6;
+        const double correction =
+            std::clamp(timeErrorUs_ * 1e-6 / kSettleSeconds,
+                       -kMaxCorrectionPpm * 1e-6, kMaxCorrectionPpm * 1e-6);
+        resampler_.setStep(1.0 + drift - correction);
+    }
+
+    const SampleVector &process(const SampleVector &input) {
+        resampler_.process(input, output_);
+        return output_;
+    }
+
+    bool locked() const { return locked_; }
+    double driftPpm() const { return estimator_.ppm(); }
+    double timeErrorUs() const { return timeErrorUs_; }
+    double step() const { return resampler_.step(); }
+
+  private:
+    DriftEstimator estimator_;
+    FarrowResampler resampler_;
+    SampleVector output_;
+    double decimation_;
+    double outputRate_;
+    double anchorUs_ = 0.0;
+    double timeErrorUs_ = 0.0;
+    bool locked_ = false;
+};
+
+// Holds sample index × 1e9 without overflow. __extension__ keeps the GCC
+// builtin quiet under -Wpedantic.
+__extension__ typedef unsigned __int128 WideProduct;
+
+class TimestampEncoder {
+  public:
+    explicit TimestampEncoder(double sampleRate) : sampleRate_(sampleRate) {
+        if (sampleRate_ > 0.0) {
+            const double rounded = std::round(sampleRate_);
+            if (std::abs(sampleRate_ - rounded) < 1e-6) {
+                sampleRateHz_ = static_cast<uint64_t>(rounded);
+            }
+        }
+    }
+
+    void reset() { anchored_ = false; }
+
+    // Anchors sample 0 at a given Unix time instead of the wall clock at
+    // the first header.
+    void anchorAt(uint64_t unixNs) {
+        baseSec_ = static_cast<uint32_t>(unixNs / 1000000000ULL);
+        baseNsec_ = static_cast<uint32_t>(unixNs % 1000000000ULL);
+        baseSeconds_ = static_cast<double>(baseSec_) +
+                       static_cast<double>(baseNsec_) * 1e-9;
+        anchored_ = true;
+    }
+
+    std::complex<float> headerForSample(uint64_t sampleIndex) {
+        if (!anchored_) {
+            anchorToWallClock();
+        }
+        uint32_t seconds = 0;
+        uint32_t nanoseconds = 0;
+
+        if (sampleRateHz_ > 0) {
+            const WideProduct nsNumerator =
+                static_cast<WideProduct>(sampleIndex) * 1000000000ULL;
+            const uint64_t nsOffset =
+                static_cast<uint64_t>(nsNumerator / sampleRateHz_);
+            const uint64_t nsecTotal =
+                static_cast<uint64_t>(baseNsec_) + nsOffset;
+
+            seconds =
+                baseSec_ + static_cast<uint32_t>(nsecTotal / 1000000000ULL);
+            nanoseconds = static_cast<uint32_t>(nsecTotal % 1000000000ULL);
+        } else {
+            double absolute =
+                baseSeconds_ + static_cast<double>(sampleIndex) / sampleRate_;
+            seconds = static_cast<uint32_t>(absolute);
+            double fractional = absolute - static_cast<double>(seconds);
+            nanoseconds =
+                static_cast<uint32_t>(std::round(fractional * 1'000'000'000.0));
+            if (nanoseconds >= 1'000'000'000U) {
+                nanoseconds -= 1'000'000'000U;
+                ++seconds;
+            }
+        }
+
+        float secBits = 0.0f;
+        float nsecBits = 0.0f;
+        std::memcpy(&secBits, &seconds, sizeof(uint32_t));
+        std::memcpy(&nsecBits, &nanoseconds, sizeof(uint32_t));
+        return {secBits, nsecBits};
+    }
+
+    void save(StateWriter &writer) const {
+        writer.put(static_cast<uint8_t>(anchored_ ? 1U : 0U));
+        writer.put(baseSec_);
+        writer.put(baseNsec_);
+        writer.put(baseSeconds_);
+    }
+
+    void restore(StateReader &reader) {
+        const bool anchored = reader.get<uint8_t>() != 0U;
+        const auto baseSec = reader.get<uint32_t>();
+        const auto baseNsec = reader.get<uint32_t>();
+        const auto baseSeconds = reader.get<double>();
+        if (baseNsec >= 1'000'000'000U) {
+            throw std::runtime_error("Checkpoint timestamp anchor invalid");
+        }
+        anchored_ = anchored;
+        baseSec_ = baseSec;
+        baseNsec_ = baseNsec;
+        baseSeconds_ = baseSeconds;
+    }
+
+  private:
+    void anchorToWallClock() {
+        timespec ts{};
+        clock_gettime(CLOCK_REALTIME, &ts);
+        baseSec_ = static_cast<uint32_t>(ts.tv_sec);
+        baseNsec_ = static_cast<uint32_t>(ts.tv_nsec);
+        baseSeconds_ = static_cast<double>(ts.tv_sec) +
+                       static_cast<double>(ts.tv_nsec) * 1e-9;
+        anchored_ = true;
+    }
+
+    double sampleRate_;
+    uint64_t sampleRateHz_ = 0;
+    uint32_t baseSec_ = 0;
+    uint32_t baseNsec_ = 0;
+    double baseSeconds_ = 0.0;
+    bool anchored_ = false;
+};
+
+// Accumulates decimated samples in a mirrored ring and hands out complete
+// timestamp+payload frames in place. The header is written into the slot
+// just before the payload, which always holds an already-sent sample, so a
+// frame is one contiguous span with no per-frame copy or front erase.
+//
+// Further readers frame the same samples with their own payload sizes. The
+// ring keeps each sample once, until the slowest reader has consumed it;
+// those readers take the header separately (payload() is contiguous), since
+// the slot before one reader's payload may still be unread by another.
+class FrameAssembler {
+  public:
+    explicit FrameAssembler(std::size_t payloadSamples)
+        : ring_(payloadSamples * 4 + 1) {
+        readers_.push_back({payloadSamples, 0});
+    }
+
+    // Adds a reader starting at the current write position; returns its
+    // index. Reader 0 is the one given to the constructor.
+    std::size_t addReader(std::size_t payloadSamples) {
+        readers_.push_back({payloadSamples, head_});
+        return readers_.size() - 1;
+    }
+
+    std::size_t readers() const { return readers_.size(); }
+
+    std::size_t size(std::size_t reader = 0) const {
+        return static_cast<std::size_t>(head_ - readers_[reader].position);
+    }
+    std::size_t payloadSamples(std::size_t reader = 0) const {
+        return readers_[reader].payloadSamples;
+    }
+    // Samples the reader has consumed since construction.
+    uint64_t position(std::size_t reader) const {
+        return readers_[reader].position;
+    }
+
+    void append(const std::complex<float> *samples, std::size_t count) {
+        reserveFor(count);
+        std::copy(samples, samples + count, ring_.data() + ringIndex(head_));
+        head_ += count;
+    }
+
+    template <typename Alloc>
+    void append(const std::vector<std::complex<float>, Alloc> &samples) {
+        append(samples.data(), samples.size());
+    }
+
+    void appendZeros(std::size_t count) {
+        reserveFor(count);
+        std::complex<float> *write = ring_.data() + ringIndex(head_);
+        std::fill(write, write + count, std::complex<float>{0.0f, 0.0f});
+        head_ += count;
+    }
+
+    bool frameReady(std::size_t reader = 0) const {
+        return size(reader) >= readers_[reader].payloadSamples;
+    }
+
+    // Returns payloadSamples() + 1 contiguous samples starting with header.
+    // Single-reader assemblers only.
+    const std::complex<float> *frame(const std::complex<float> &header) {
+        if (readers_.size() > 1) {
+            throw std::logic_error(
+                "In-place frame header needs a single-reader assembler");
+        }
+        const std::size_t readIndex = ringIndex(readers_[0].position);
+        const std::size_t headerIndex =
+            (readIndex == 0) ? ring_.capacity() - 1 : readIndex - 1;
+        ring_[headerIndex] = header;
+        return ring_.data() + headerIndex;
+    }
+
+    // The payloadSamples(reader) samples of the reader's next frame.
+    const std::complex<float> *payload(std::size_t reader = 0) const {
+        return ring_.data() + ringIndex(readers_[reader].position);
+    }
+
+    void consumeFrame(std::size_t reader = 0) {
+        readers_[reader].position += readers_[reader].payloadSamples;
+    }
+
+    // Drops every reader's unsent samples.
+    void clear() {
+        for (auto &reader : readers_) {
+            reader.position = head_;
+        }
+    }
+
+    std::vector<std::complex<float>> contents() const {
+        const std::complex<float> *read = payload(0);
+        return std::vector<std::complex<float>>(read, read + size(0));
+    }
+
+  private:
+    struct Reader {
+        std::size_t payloadSamples;
+        uint64_t position;
+    };
+
+    std::size_t ringIndex(uint64_t position) const {
+        return static_cast<std::size_t>((position - origin_) %
+                                        ring_.capacity());
+    }
+
+    uint64_t tail() const {
+        uint64_t oldest = head_;
+        for (const auto &reader : readers_) {
+            oldest = std::min(oldest, reader.position);
+        }
+        return oldest;
+    }
+
+    // One slot stays free for the in-place frame header.
+    void reserveFor(std::size_t count) {
+        const uint64_t oldest = tail();
+        const auto retained = static_cast<std::size_t>(head_ - oldest);
+        if (retained + count + 1 <= ring_.capacity()) {
+            return;
+        }
+        MirroredRing<std::complex<float>> grown((retained + count + 1) * 2);
+        const std::complex<float> *read = ring_.data() + ringIndex(oldest);
+        std::copy(read, read + retained, grown.data());
+        ring_ = std::move(grown);
+        origin_ = oldest;
+    }
+
+    MirroredRing<std::complex<float>> ring_;
+    std::vector<Reader> readers_;
+    // Samples appended since construction, and the position stored at
+    // ring index 0.
+    uint64_t head_ = 0;
+    uint64_t origin_ = 0;
+};
+
+struct PipelineConfig {
+    double inputRate = 0.0;
+    double shiftHz = 0.0;
+    // Samples per frame including the timestamp header.
+    std::size_t frameSamples = 1024;
+    Arithmetic arithmetic = Arithmetic::Float;
+    // Keep a float copy of each stage-1 block for stage1Output().
+    bool keepStage1Output = false;
+    // Threads sharing each block's stage-1 FIR; 1 runs it sequentially.
+    std::size_t stage1Threads = 1;
+    // The IIR engine is float-only and runs sequentially.
+    Stage1Engine stage1Engine = Stage1Engine::Fir;
+    // Frame sizes of further outputs cut from the same samples, numbered
+    // from 1; output 0 is frameSamples.
+    std::vector<std::size_t> extraFrameSamples;
+    // Resample the output onto the nominal grid of the reference clock fed
+    // to observeReferenceTime(), compensating sample clock drift.
+    bool driftCompensation = false;
+};
+
+// One channel of the decimator: frequency shift, the 8/5/5 FIR cascade and
+// timestamped framing. Each frame is a timestamp header followed by
+// frameSamples - 1 payload samples, exactly what goes out on UDP.
+class DecimationPipeline {
+  public:
+    explicit DecimationPipeline(const PipelineConfig &config)
+        : config_(validated(config)), stage1_(8, 8 * 16, 0.45f / 8.0f),
+          stage2_(5, 5 * 16, 0.45f / 5.0f), stage3_(5, 5 * 16, 0.45f / 5.0f),
+          shifter_(config.inputRate, config.shiftHz),
+          encoder_(config.inputRate / kTotalDecimation),
+          assembler_(config.frameSamples - 1) {
+        if (config_.arithmetic == Arithmetic::Fixed) {
+            fixedChain_ = std::make_unique<FixedPointChain>(config_.inputRate,
+                                                            config_.shiftHz);
+        }
+        if (config_.stage1Engine == Stage1Engine::Iir) {
+            stage1Iir_ = std::make_unique<IirStage1Decimator>();
+        }
+        if (config_.stage1Threads > 1) {
+            stage1Pool_ = std::make_unique<ForkJoinPool>(config_.stage1Threads);
+        }
+        for (const std::size_t frameSamples : config_.extraFrameSamples) {
+            (void)assembler_.addReader(frameSamples - 1);
+        }
+        if (config_.driftCompensation) {
+            drift_ = std::make_unique<DriftCompensator>(config_.inputRate,
+                                                        kTotalDecimation);
+        }
+    }
+
+    const PipelineConfig &config() const { return config_; }
+    double outputRate() const { return config_.inputRate / kTotalDecimation; }
+    std::size_t frameSamples() const { return config_.frameSamples; }
+    std::size_t payloadSamples() const { return config_.frameSamples - 1; }
+    std::size_t frameOutputs() const { return assembler_.readers(); }
+    std::size_t frameSamples(std::size_t output) const {
+        return assembler_.payloadSamples(output) + 1;
+    }
+
+    // Float input is mixed in place. The returned block stays valid until
+    // the next process() call.
+    const SampleVector &process(SampleVector &input) {
+        if (fixedChain_) {
+            throw std::runtime_error(
+                "Float input pushed to a fixed-point pipeline");
+        }
+        inputSamples_ += input.size();
+        shifter_.mix(input);
+        auto afterStage1 =
+            stage1Iir_ ? stage1Iir_->process(input) : runStage1(stage1_, input);
+        output_ = stage3_.process(stage2_.process(afterStage1));
+        if (config_.keepStage1Output) {
+            stage1Output_ = std::move(afterStage1);
+        }
+        return appendOutput();
+    }
+
+    const SampleVector &process(SampleBuffer<ci16> &input) {
+        if (!fixedChain_) {
+            throw std::runtime_error(
+                "Fixed-point input pushed to a float pipeline");
+        }
+        inputSamples_ += input.size();
+        fixedChain_->shifter.mix(input);
+        const auto afterStage1 = runStage1(fixedChain_->stage1, input);
+        output_ = toFloatSamples(
+            fixedChain_->stage3.process(fixedChain_->stage2.process(afterStage1)));
+        if (config_.keepStage1Output) {
+            stage1Output_ = toFloatSamples(afterStage1);
+        }
+        return appendOutput();
+    }
+
+    // With driftCompensation: the reference time (e.g. the publisher's
+    // packet timestamp) of the first sample of the next process() block.
+    // contiguous is false when input went missing since the last call.
+    void observeReferenceTime(uint64_t referenceUs, bool contiguous) {
+        if (drift_) {
+            drift_->observe(inputSamples_, referenceUs, contiguous);
+        }
+    }
+
+    // The compensator, or null without driftCompensation.
+    const DriftCompensator *driftCompensator() const { return drift_.get(); }
+
+    // Stage-1 output of the last process() call, if keepStage1Output is set.
+    const SampleVector &stage1Output() const { return stage1Output_; }
+
+    bool frameReady() const { return assembler_.frameReady(); }
+    std::size_t pendingFrames() const {
+        return assembler_.size() / assembler_.payloadSamples();
+    }
+
+    // Returns frameSamples() contiguous samples, valid until the next
+    // consumeFrame() or process() call.
+    const std::complex<float> *frame() {
+        return assembler_.frame(encoder_.headerForSample(samplesSent_));
+    }
+
+    // The payload of frame() without a header, for callers that timestamp
+    // frames themselves. Same lifetime as frame().
+    const std::complex<float> *framePayload() const {
+        return assembler_.payload();
+    }
+
+    // Per-output framing for pipelines with extraFrameSamples: the header
+    // comes separately and the payload is contiguous, valid until the next
+    // process() call. Outputs share one copy of the samples and one
+    // timeline, so frames of different sizes carry consistent timestamps.
+    bool frameReady(std::size_t output) const {
+        return assembler_.frameReady(output);
+    }
+
+    std::complex<float> frameHeader(std::size_t output) {
+        return encoder_.headerForSample(samplesSent_ -
+                                        assembler_.position(0) +
+                                        assembler_.position(output));
+    }
+
+    const std::complex<float> *framePayload(std::size_t output) const {
+        return assembler_.payload(output);
+    }
+
+    void consumeFrame(std::size_t output) {
+        if (output == 0) {
+            consumeFrame();
+        } else {
+            assembler_.consumeFrame(output);
+        }
+    }
+
+    // Timestamps output sample 0 at a fixed Unix time rather than the wall
+    // clock at the first frame, e.g. to replay a capture reproducibly.
+    void anchorTimestamps(uint64_t unixNs) { encoder_.anchorAt(unixNs); }
+
+    void consumeFrame() {
+        assembler_.consumeFrame();
+        samplesSent_ += assembler_.payloadSamples();
+        ++framesProduced_;
+    }
+
+    // Pads the output timeline with silence, e.g. across an input gap.
+    void insertSilence(std::size_t count) {
+        assembler_.appendZeros(count);
+    }
+
+    // Known-bad input such as an ADC overflow: count input samples become
+    // silence on the output timeline without being filtered, and the
+    // histories are cleared so the bad span leaves no transient. The mixer
+    // phase moves on as if the samples had been mixed. Returns the output
+    // samples of silence appended.
+    std::size_t blankInput(std::size_t count) {
+        inputSamples_ += count;
+        std::size_t outputs = 0;
+        if (fixedChain_) {
+            fixedChain_->shifter.advance(count);
+            outputs = fixedChain_->stage3.blank(
+                fixedChain_->stage2.blank(fixedChain_->stage1.blank(count)));
+        } else {
+            shifter_.advance(count);
+            const std::size_t afterStage1 = stage1Iir_
+                                                ? stage1Iir_->blank(count)
+                                                : stage1_.blank(count);
+            outputs = stage3_.blank(stage2_.blank(afterStage1));
+        }
+        if (drift_) {
+            output_.assign(outputs, {});
+            outputs = drift_->process(output_).size();
+        }
+        outputSamples_ += outputs;
+        assembler_.appendZeros(outputs);
+        return outputs;
+    }
+
+    // The input before and after this point is unrelated, e.g. across a
+    // retune: clears the filter histories, restarts the mixer phase and
+    // drops the partly assembled frame, moving the timeline over it, so
+    // the next frame starts here. Returns the output samples dropped.
+    uint64_t restartAtDiscontinuity() {
+        restartFilters();
+        return skipOutput(0);
+    }
+
+    // The filter and mixer half of restartAtDiscontinuity(): the output
+    // timeline and any partly assembled frame are kept, for callers that
+    // must stay sample-aligned with other pipelines.
+    void restartFilters() {
+        if (fixedChain_) {
+            fixedChain_->shifter.resetPhase();
+        } else {
+            shifter_.resetPhase();
+        }
+        clearHistories();
+    }
+
+    // Input that never arrived, e.g. between a checkpoint and the resumed
+    // stream: as in blankInput(), the mixer phase moves on over the missing
+    // input and the histories are cleared, but the timeline skips the
+    // outputs samples instead of filling them. Returns the samples
+    // discarded from the partly assembled frame.
+    uint64_t skipGap(uint64_t outputs) {
+        const auto inputs = static_cast<std::size_t>(
+            static_cast<double>(outputs) * kTotalDecimation);
+        if (fixedChain_) {
+            fixedChain_->shifter.advance(inputs);
+        } else {
+            shifter_.advance(inputs);
+        }
+        clearHistories();
+        return skipOutput(outputs);
+    }
+
+    // Drops any partially assembled frame and moves the timeline forward by
+    // skipped samples without emitting them. Returns the samples discarded.
+    uint64_t skipOutput(uint64_t skipped) {
+        const uint64_t discarded = assembler_.size();
+        samplesSent_ += discarded + skipped;
+        assembler_.clear();
+        return discarded;
+    }
+
+    uint64_t inputSamples() const { return inputSamples_; }
+    uint64_t outputSamples() const { return outputSamples_; }
+    uint64_t framesProduced() const { return framesProduced_; }
+    uint64_t samplesSent() const { return samplesSent_; }
+    std::size_t bufferedSamples() const { return assembler_.size(); }
+
+    void save(StateWriter &writer) const {
+        if (fixedChain_) {
+            throw std::runtime_error(
+                "Fixed-point pipeline state cannot be checkpointed");
+        }
+        if (drift_) {
+            throw std::runtime_error(
+                "Drift-compensated pipeline state cannot be checkpointed");
+        }
+        if (stage1Iir_) {
+            throw std::runtime_error(
+                "IIR stage-1 pipeline state cannot be checkpointed");
+        }
+        writer.put(samplesSent_);
+        writer.putSamples(assembler_.contents());
+        stage1_.save(writer);
+        stage2_.save(writer);
+        stage3_.save(writer);
+        shifter_.save(writer);
+        encoder_.save(writer);
+    }
+
+    void restore(StateReader &reader) {
+        if (fixedChain_) {
+            throw std::runtime_error(
+                "Fixed-point pipeline state cannot be checkpointed");
+        }
+        samplesSent_ = reader.get<uint64_t>();
+        const auto buffered = reader.getSamples();
+        assembler_.clear();
+        assembler_.append(buffered);
+        stage1_.restore(reader);
+        stage2_.restore(reader);
+        stage3_.restore(reader);
+        shifter_.restore(reader);
+        encoder_.restore(reader);
+    }
+
+  private:
+    // Smallest stage-1 segment worth handing to another thread.
+    static constexpr std::size_t kMinSegmentOutputs = 256;
+
+    void clearHistories() {
+        if (fixedChain_) {
+            fixedChain_->stage1.clearHistory();
+            fixedChain_->stage2.clearHistory();
+            fixedChain_->stage3.clearHistory();
+        } else {
+            stage1_.clearHistory();
+            if (stage1Iir_) {
+                stage1Iir_->clearHistory();
+            }
+            stage2_.clearHistory();
+            stage3_.clearHistory();
+        }
+    }
+
+    template <typename Stage, typename Block>
+    SampleBuffer<typename Block::value_type> runStage1(Stage &stage,
+                                                       const Block &input) {
+        if (!stage1Pool_) {
+            return stage.process(input);
+        }
+        return stage.processSegmented(
+            input.data(), input.size(),
+            [this](std::size_t outputs, const auto &segment) {
+                const std::size_t parts = std::max<std::size_t>(
+                    1, std::min(stage1Pool_->threads(),
+                                outputs / kMinSegmentOutputs));
+                stage1Pool_->run(parts, [&](std::size_t part) {
+                    segment(outputs * part / parts,
+                            outputs * (part + 1) / parts);
+                });
+            });
+    }
+
+    static const PipelineConfig &validated(const PipelineConfig &config) {
+        if (!(config.inputRate > 0.0)) {
+            throw std::runtime_error("Pipeline input rate must be positive");
+        }
+        if (config.frameSamples < 2 ||
+            std::any_of(config.extraFrameSamples.begin(),
+                        config.extraFrameSamples.end(),
+                        [](std::size_t samples) { return samples < 2; })) {
+            throw std::runtime_error(
+                "Pipeline frame must hold a header and at least one sample");
+        }
+        if (config.stage1Engine == Stage1Engine::Iir &&
+            (config.arithmetic == Arithmetic::Fixed ||
+             config.stage1Threads > 1)) {
+            throw std::runtime_error("The IIR stage 1 is float-only and "
+                                     "cannot be split across threads");
+        }
+        return config;
+    }
+
+    const SampleVector &appendOutput() {
+        const SampleVector &output = drift_ ? drift_->process(output_) : output_;
+        outputSamples_ += output.size();
+        assembler_.append(output);
+        return output;
+    }
+
+    PipelineConfig config_;
+    FirDecimator stage1_;
+    FirDecimator stage2_;
+    FirDecimator stage3_;
+    FrequencyShifter shifter_;
+    std::unique_ptr<FixedPointChain> fixedChain_;
+    std::unique_ptr<IirStage1Decimator> stage1Iir_;
+    std::unique_ptr<ForkJoinPool> stage1Pool_;
+    std::unique_ptr<DriftCompensator> drift_;
+    TimestampEncoder encoder_;
+    FrameAssembler assembler_;
+    SampleVector stage1Output_;
+    SampleVector output_;
+    uint64_t inputSamples_ = 0;
+    uint64_t outputSamples_ = 0;
+    uint64_t framesProduced_ = 0;
+    uint64_t samplesSent_ = 0;
+};
+
+} // namespace airspyhf_dsp
@@ -1,14 +1,31 @@
 #include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/perf_event.h>
+#include <netdb.h>
 #include <netinet/in.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <zmq.h>
 
 #include <tagtracker_wireformat/zmq_iq_packet.h>
 
+#include "denormals.h"
+#include "dsp_pipeline.h"
+#include "numa_topology.h"
+#include "work_scheduler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cerrno>
 #include <cmath>
 #include <complex>
+#include <condition_variable>
 #include <csignal>
 #include <cstdint>
 #include <cstdio>
@@ -16,23 +33,52 @@
 #include <cstring>
 #include <ctime>
 #include <deque>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 namespace {
 
-constexpr double kTotalDecimation = 8.0 * 5.0 * 5.0;
+using namespace airspyhf_dsp;
+
 constexpr std::size_t kBytesPerIQ = TTWF_ZMQ_IQ_BYTES_PER_COMPLEX_SAMPLE;
-constexpr double kPi = 3.14159265358979323846;
-constexpr double kTwoPi = 6.28318530717958647692;
 constexpr uint32_t kZmqMagic = TTWF_ZMQ_IQ_MAGIC;
 constexpr uint16_t kZmqVersion = TTWF_ZMQ_IQ_VERSION;
 constexpr uint16_t kZmqHeaderSizeBytes = TTWF_ZMQ_IQ_HEADER_SIZE;
+// Proposed bits of the packet header's flags field: the ADC overflowed
+// within this packet, or the receiver was retuned just before it. The
+// publisher does not define them yet, so they are honoured only with
+// --packet-flags.
+constexpr uint32_t kZmqFlagOverflow = 1U << 0;
+constexpr uint32_t kZmqFlagRetune = 1U << 1;
+constexpr uint32_t kSpectrumMagic = 0x4D505341U; // "ASPM" little-endian
+constexpr uint16_t kSpectrumVersion = 1;
+constexpr uint16_t kSpectrumHeaderSizeBytes = 48;
+constexpr uint32_t kCheckpointMagic = 0x53445341U; // "ASDS" little-endian
+constexpr uint16_t kCheckpointVersion = 3;
+constexpr double kMaxResumeZeroFillSeconds = 1.0;
+
+enum class SpectrumSource { Stage1, Stage3 };
+enum class NumaPolicy { Off, Auto, Node };
+
+constexpr std::size_t kMaxWorkers = 256;
+constexpr std::size_t kMaxQueuedBlocksPerChannel = 32;
+
+struct ChannelSpec {
+    double shiftKhz = 10.0;
+    std::vector<uint16_t> ports;
+    // Frame size per port, parallel to ports; 0 uses --frame.
+    std::vector<std::size_t> frameSamples;
+};
 
 struct Options {
     double inputRate = 0.0;
@@ -42,7 +88,45 @@ struct Options {
     double rateTolerancePpm = 5000.0;
     std::string ip = "127.0.0.1";
     std::vector<uint16_t> ports = {10000, 10001};
+    std::vector<std::size_t> portFrameSamples = {0, 0};
     double shiftKhz = 10.0;
+    uint16_t spectrumPort = 0;
+    std::size_t spectrumFftSize = 512;
+    std::size_t spectrumAverages = 16;
+    SpectrumSource spectrumSource = SpectrumSource::Stage3;
+    double spectrumIntervalMs = 1000.0;
+    std::string stateFile;
+    HugePageMode hugePages = HugePageMode::Off;
+    bool perfCounters = false;
+    Arithmetic arithmetic = Arithmetic::Float;
+    // Filled from --shift-khz/--ports when no --channel is given.
+    std::vector<ChannelSpec> channels;
+    std::size_t workers = 0;
+    std::size_t stage1Threads = 1;
+    Stage1Engine stage1Engine = Stage1Engine::Fir;
+    // SO_SNDBUF per UDP output socket; 0 keeps the kernel default.
+    int udpSendBufferBytes = 0;
+    // Kernel TX timestamp on every Nth frame per UDP port; 0 disables.
+    std::size_t udpTxTimestampEvery = 0;
+    // Flush subnormal floats to zero on every DSP thread.
+    bool flushDenormals = true;
+    // React to the overflow and retune bits of the header flags field.
+    bool packetFlags = false;
+    // Resample each channel onto the nominal rate in the publisher's
+    // timestamp clock.
+    bool driftCompensation = false;
+    // Further publishers merged with --zmq-endpoint into one interleaved,
+    // time-aligned stream.
+    std::vector<std::string> mergeEndpoints;
+    // Coordinator mode: bind here and hand --channel definitions to
+    // workers instead of processing them.
+    std::string coordinatorEndpoint;
+    // Worker mode: process the channels this coordinator assigns.
+    std::string shardOf;
+    // Node for the receive thread, DSP threads and buffers; numaNode is
+    // used with NumaPolicy::Node.
+    NumaPolicy numaPolicy = NumaPolicy::Off;
+    int numaNode = -1;
 };
 
 struct ArgsError : public std::runtime_error {
@@ -61,15 +145,137 @@ void printUsage(const char *argv0) {
                  "packet, including the timestamp (default 1024)\n"
               << "  --zmq-endpoint <uri>  ZeroMQ SUB endpoint (default "
                  "tcp://127.0.0.1:5555)\n"
+              << "  --merge-zmq <uri>     Also subscribe to this publisher and "
+                 "send time-aligned frames interleaving every stream; "
+                 "repeatable\n"
+              << "  --coordinator <uri>   Bind here and spread the --channel "
+                 "list over --shard-of workers by measured load\n"
+              << "  --shard-of <uri>      Run as a worker for the coordinator "
+                 "at this endpoint, processing only assigned channels\n"
               << "  --rate-tol-ppm <ppm>  Allowed sample-rate error before "
                  "warning (default 5000)\n"
               << "  --ip <addr>           Destination IPv4 address (default "
                  "127.0.0.1)\n"
               << "  --ports <p0,p1,...>   Comma-separated UDP ports (default "
                  "10000,10001)\n"
+              << "  --spectrum-port <p>   Publish averaged power spectra to "
+                 "this UDP port on --ip; 0 disables (default 0)\n"
+              << "  --spectrum-fft <N>    Spectrum FFT size, power of two "
+                 "(default 512)\n"
+              << "  --spectrum-avg <N>    Welch segments averaged per "
+                 "spectrum (default 16)\n"
+              << "  --spectrum-source <s> Spectrum tap point: stage1 or "
+                 "stage3 (default stage3)\n"
+              << "  --spectrum-interval-ms <ms>  Minimum time between "
+                 "published spectra (default 1000)\n"
+              << "  --state-file <path>   Save DSP state here on shutdown "
+                 "and warm-restart from it on startup\n"
+              << "  --hugepages <mode>    Back large sample buffers with "
+                 "huge pages: off, thp or explicit (default off)\n"
+              << "  --perf-counters       Report hardware counters (dTLB "
+                 "misses per sample) in perf logs\n"
+              << "  --arith <mode>        DSP arithmetic: float, or fixed "
+                 "for the Q15 integer pipeline (default float)\n"
+              << "  --channel <kHz@p0,p1> Add an output channel with its own "
+                 "shift and UDP ports; repeatable, replaces --shift-khz/--ports\n"
+              << "  --workers <N>         Process channels on N work-stealing "
+                 "threads; 0 runs them on the receive thread (default 0)\n"
+              << "  --stage1-threads <N>  Split each block's stage-1 FIR "
+                 "across N threads, bit-exact with 1 (default 1)\n"
+              << "  --stage1-engine <e>   Stage-1 decimator: fir (linear "
+                 "phase), or iir for allpass halfbands at a fraction of the "
+                 "CPU (default fir)\n"
+              << "  --udp-sndbuf <bytes>  Send buffer per UDP output socket; "
+                 "0 keeps the kernel default (default 0)\n"
+              << "  --udp-tx-timestamp-every <N>  Sample kernel TX timestamps "
+                 "on every Nth frame per port and log send latency; 0 "
+                 "disables (default 0)\n"
+              << "  --denormals <mode>    flush sets FTZ/DAZ on DSP threads; "
+                 "ieee keeps gradual underflow (default flush)\n"
+              << "  --packet-flags        Blank overflowed packets and "
+                 "restart on retunes from the header flags bits (needs a "
+                 "publisher that sets them)\n"
+              << "  --drift-comp          Resample output onto the nominal "
+                 "rate of the publisher's timestamp clock, correcting sample "
+                 "clock drift\n"
+              << "  --numa <policy>       Keep the receive and DSP threads and "
+                 "their buffers on one NUMA node: off, auto (the node of the "
+                 "ZeroMQ interface) or a node number (default off)\n"
               << "  --help                Show this message\n";
 }
 
+// Each entry is <port> or <port>/<frame>; frameSamples gets the frame
+// size per port, 0 where none was given.
+std::vector<uint16_t> parsePortList(const std::string &value,
+                                    const std::string &flag,
+                                    std::vector<std::size_t> &frameSamples) {
+    std::vector<uint16_t> ports;
+    frameSamples.clear();
+    std::size_t start = 0;
+    while (start < value.size()) {
+        std::size_t comma = value.find(',', start);
+        auto token = value.substr(start, comma == std::string::npos
+                                             ? std::string::npos
+                                             : comma - start);
+        if (!token.empty()) {
+            const std::size_t slash = token.find('/');
+            const unsigned long parsedPort =
+                std::stoul(token.substr(0, slash));
+            if (parsedPort == 0UL || parsedPort > 65535UL) {
+                throw ArgsError(flag + " values must be in range 1..65535");
+            }
+            std::size_t frame = 0;
+            if (slash != std::string::npos) {
+                frame = static_cast<std::size_t>(
+                    std::stoul(token.substr(slash + 1)));
+                if (frame < 2) {
+                    throw ArgsError(flag + " frame sizes must be at least 2 "
+                                           "samples (timestamp + payload)");
+                }
+            }
+            ports.push_back(static_cast<uint16_t>(parsedPort));
+            frameSamples.push_back(frame);
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+    if (ports.empty()) {
+        throw ArgsError(flag + " requires at least one port number");
+    }
+    return ports;
+}
+
+// <shift_khz>@<port>[/<frame>][,...], as given to --channel and sent to
+// shard workers.
+ChannelSpec parseChannelSpec(const std::string &value) {
+    const std::size_t at = value.find('@');
+    if (at == 0 || at == std::string::npos) {
+        throw ArgsError(
+            "--channel must be <shift_khz>@<port>[/<frame>][,...]");
+    }
+    ChannelSpec channel;
+    channel.shiftKhz = std::stod(value.substr(0, at));
+    channel.ports = parsePortList(value.substr(at + 1), "--channel",
+                                  channel.frameSamples);
+    return channel;
+}
+
+std::string formatChannelSpec(const ChannelSpec &channel) {
+    std::ostringstream out;
+    out.precision(17);
+    out << channel.shiftKhz << '@';
+    for (std::size_t index = 0; index < channel.ports.size(); ++index) {
+        out << (index == 0 ? "" : ",") << channel.ports[index];
+        if (index < channel.frameSamples.size() &&
+            channel.frameSamples[index] != 0) {
+            out << '/' << channel.frameSamples[index];
+        }
+    }
+    return out.str();
+}
+
 Options parseArgs(int argc, char **argv) {
     Options opts;
     for (int i = 1; i < argc; ++i) {
@@ -94,6 +300,21 @@ Options parseArgs(int argc, char **argv) {
                 throw ArgsError("--zmq-endpoint requires a value");
             }
             opts.zmqEndpoint = argv[i];
+        } else if (arg == "--merge-zmq") {
+            if (++i >= argc) {
+                throw ArgsError("--merge-zmq requires a value");
+            }
+            opts.mergeEndpoints.push_back(argv[i]);
+        } else if (arg == "--coordinator") {
+            if (++i >= argc) {
+                throw ArgsError("--coordinator requires a value");
+            }
+            opts.coordinatorEndpoint = argv[i];
+        } else if (arg == "--shard-of") {
+            if (++i >= argc) {
+                throw ArgsError("--shard-of requires a value");
+            }
+            opts.shardOf = argv[i];
         } else if (arg == "--rate-tol-ppm") {
             if (++i >= argc) {
                 throw ArgsError("--rate-tol-ppm requires a value");
@@ -113,29 +334,156 @@ Options parseArgs(int argc, char **argv) {
             if (++i >= argc) {
                 throw ArgsError("--ports requires a value");
             }
-            opts.ports.clear();
-            std::string value(argv[i]);
-            std::size_t start = 0;
-            while (start < value.size()) {
-                std::size_t comma = value.find(',', start);
-                auto token = value.substr(start, comma == std::string::npos
-                                                     ? std::string::npos
-                                                     : comma - start);
-                if (!token.empty()) {
-                        const unsigned long parsedPort = std::stoul(token);
-                        if (parsedPort == 0UL || parsedPort > 65535UL) {
-                            throw ArgsError("--ports values must be in range 1..65535");
-                        }
-                        opts.ports.push_back(static_cast<uint16_t>(parsedPort));
-                }
-                if (comma == std::string::npos) {
-                    break;
-                }
-                start = comma + 1;
+            opts.ports =
+                parsePortList(argv[i], "--ports", opts.portFrameSamples);
+        } else if (arg == "--spectrum-port") {
+            if (++i >= argc) {
+                throw ArgsError("--spectrum-port requires a value");
+            }
+            const unsigned long parsedPort = std::stoul(argv[i]);
+            if (parsedPort > 65535UL) {
+                throw ArgsError("--spectrum-port must be in range 0..65535");
+            }
+            opts.spectrumPort = static_cast<uint16_t>(parsedPort);
+        } else if (arg == "--spectrum-fft") {
+            if (++i >= argc) {
+                throw ArgsError("--spectrum-fft requires a value");
+            }
+            opts.spectrumFftSize =
+                static_cast<std::size_t>(std::stoul(argv[i]));
+        } else if (arg == "--spectrum-avg") {
+            if (++i >= argc) {
+                throw ArgsError("--spectrum-avg requires a value");
+            }
+            opts.spectrumAverages =
+                static_cast<std::size_t>(std::stoul(argv[i]));
+        } else if (arg == "--spectrum-source") {
+            if (++i >= argc) {
+                throw ArgsError("--spectrum-source requires a value");
+            }
+            const std::string_view value(argv[i]);
+            if (value == "stage1") {
+                opts.spectrumSource = SpectrumSource::Stage1;
+            } else if (value == "stage3") {
+                opts.spectrumSource = SpectrumSource::Stage3;
+            } else {
+                throw ArgsError("--spectrum-source must be stage1 or stage3");
+            }
+        } else if (arg == "--spectrum-interval-ms") {
+            if (++i >= argc) {
+                throw ArgsError("--spectrum-interval-ms requires a value");
+            }
+            opts.spectrumIntervalMs = std::stod(argv[i]);
+        } else if (arg == "--state-file") {
+            if (++i >= argc) {
+                throw ArgsError("--state-file requires a value");
+            }
+            opts.stateFile = argv[i];
+        } else if (arg == "--hugepages") {
+            if (++i >= argc) {
+                throw ArgsError("--hugepages requires a value");
+            }
+            const std::string_view value(argv[i]);
+            if (value == "off") {
+                opts.hugePages = HugePageMode::Off;
+            } else if (value == "thp") {
+                opts.hugePages = HugePageMode::Transparent;
+            } else if (value == "explicit") {
+                opts.hugePages = HugePageMode::Explicit;
+            } else {
+                throw ArgsError("--hugepages must be off, thp or explicit");
+            }
+        } else if (arg == "--drift-comp") {
+            opts.driftCompensation = true;
+        } else if (arg == "--packet-flags") {
+            opts.packetFlags = true;
+        } else if (arg == "--perf-counters") {
+            opts.perfCounters = true;
+        } else if (arg == "--arith") {
+            if (++i >= argc) {
+                throw ArgsError("--arith requires a value");
+            }
+            const std::string_view value(argv[i]);
+            if (value == "float") {
+                opts.arithmetic = Arithmetic::Float;
+            } else if (value == "fixed") {
+                opts.arithmetic = Arithmetic::Fixed;
+            } else {
+                throw ArgsError("--arith must be float or fixed");
+            }
+        } else if (arg == "--denormals") {
+            if (++i >= argc) {
+                throw ArgsError("--denormals requires a value");
+            }
+            const std::string_view value(argv[i]);
+            if (value == "flush") {
+                opts.flushDenormals = true;
+            } else if (value == "ieee") {
+                opts.flushDenormals = false;
+            } else {
+                throw ArgsError("--denormals must be flush or ieee");
+            }
+        } else if (arg == "--numa") {
+            if (++i >= argc) {
+                throw ArgsError("--numa requires a value");
+            }
+            const std::string value(argv[i]);
+            if (value == "off") {
+                opts.numaPolicy = NumaPolicy::Off;
+            } else if (value == "auto") {
+                opts.numaPolicy = NumaPolicy::Auto;
+            } else if (!value.empty() &&
+                       value.find_first_not_of("0123456789") ==
+                           std::string::npos &&
+                       value.size() <= 4) {
+                opts.numaPolicy = NumaPolicy::Node;
+                opts.numaNode = std::stoi(value);
+            } else {
+                throw ArgsError("--numa must be off, auto or a node number");
+            }
+        } else if (arg == "--channel") {
+            if (++i >= argc) {
+                throw ArgsError("--channel requires a value");
+            }
+            opts.channels.push_back(parseChannelSpec(argv[i]));
+        } else if (arg == "--stage1-threads") {
+            if (++i >= argc) {
+                throw ArgsError("--stage1-threads requires a value");
+            }
+            opts.stage1Threads = static_cast<std::size_t>(std::stoul(argv[i]));
+        } else if (arg == "--stage1-engine") {
+            if (++i >= argc) {
+                throw ArgsError("--stage1-engine requires a value");
             }
-            if (opts.ports.empty()) {
-                throw ArgsError("--ports requires at least one port number");
+            const std::string_view value(argv[i]);
+            if (value == "fir") {
+                opts.stage1Engine = Stage1Engine::Fir;
+            } else if (value == "iir") {
+                opts.stage1Engine = Stage1Engine::Iir;
+            } else {
+                throw ArgsError("--stage1-engine must be fir or iir");
             }
+        } else if (arg == "--udp-sndbuf") {
+            if (++i >= argc) {
+                throw ArgsError("--udp-sndbuf requires a value");
+            }
+            const unsigned long parsedBytes = std::stoul(argv[i]);
+            if (parsedBytes > static_cast<unsigned long>(
+                                  std::numeric_limits<int>::max() / 2)) {
+                throw ArgsError("--udp-sndbuf is too large");
+            }
+            opts.udpSendBufferBytes = static_cast<int>(parsedBytes);
+        } else if (arg == "--udp-tx-timestamp-every") {
+            if (++i >= argc) {
+                throw ArgsError("--udp-tx-timestamp-every requires a value");
+            }
+            opts.udpTxTimestampEvery =
+                static_cast<std::size_t>(std::stoul(argv[i]));
+        } else if (arg == "--workers") {
+            if (++i >= argc) {
+                throw ArgsError("--workers requires a value");
+            }
+            opts.workers = static_cast<std::size_t>(std::stoul(argv[i]));
         } else {
             throw ArgsError("Unknown option: " + std::string(arg));
         }
@@ -153,406 +501,2476 @@ Options parseArgs(int argc, char **argv) {
     if (opts.rateTolerancePpm <= 0.0) {
         throw ArgsError("rate-tol-ppm must be positive");
     }
-    return opts;
-}
-
-std::vector<float> designLowpass(std::size_t taps, float cutoff) {
-    if (taps < 3) {
-        taps = 3;
+    if (opts.spectrumFftSize < 16 ||
+        (opts.spectrumFftSize & (opts.spectrumFftSize - 1)) != 0) {
+        throw ArgsError("spectrum-fft must be a power of two >= 16");
     }
-    if ((taps % 2) == 0) {
-        ++taps;
+    if (opts.spectrumAverages == 0) {
+        throw ArgsError("spectrum-avg must be at least 1");
     }
-    constexpr float pi = 3.14159265358979323846f;
-    std::vector<float> coeffs(taps);
-    const float M = static_cast<float>(taps - 1);
-    for (std::size_t n = 0; n < taps; ++n) {
-        const float m = static_cast<float>(n) - M / 2.0f;
-        const float window =
-            0.54f - 0.46f * std::cos(2.0f * pi * static_cast<float>(n) / M);
-        float sinc = 0.0f;
-        if (std::abs(m) < 1e-6f) {
-            sinc = 2.0f * cutoff;
-        } else {
-            sinc = std::sin(2.0f * pi * cutoff * m) / (pi * m);
+    if (opts.spectrumIntervalMs < 0.0) {
+        throw ArgsError("spectrum-interval-ms must be >= 0");
+    }
+    if (opts.arithmetic == Arithmetic::Fixed && !opts.stateFile.empty()) {
+        throw ArgsError("--state-file is not supported with --arith fixed");
+    }
+    if (opts.workers > kMaxWorkers) {
+        throw ArgsError("workers must be at most " +
+                        std::to_string(kMaxWorkers));
+    }
+    if (opts.stage1Threads == 0 || opts.stage1Threads > kMaxWorkers) {
+        throw ArgsError("stage1-threads must be in range 1.." +
+                        std::to_string(kMaxWorkers));
+    }
+    // Each channel pipeline has its own stage-1 team, so with workers the
+    // helpers would multiply by the channel count and oversubscribe cores.
+    if (opts.workers > 0 && opts.stage1Threads > 1) {
+        throw ArgsError("--stage1-threads above 1 excludes --workers; use "
+                        "one to parallelise per channel, the other within");
+    }
+    if (opts.stage1Engine == Stage1Engine::Iir &&
+        (opts.arithmetic == Arithmetic::Fixed || opts.stage1Threads > 1 ||
+         !opts.stateFile.empty())) {
+        throw ArgsError("--stage1-engine iir excludes --arith fixed, "
+                        "--stage1-threads above 1 and --state-file");
+    }
+    if (!opts.coordinatorEndpoint.empty()) {
+        if (opts.channels.empty() || !opts.shardOf.empty() ||
+            !opts.mergeEndpoints.empty()) {
+            throw ArgsError("--coordinator needs --channel definitions and "
+                            "excludes --shard-of and --merge-zmq");
+        }
+        return opts;
+    }
+    if (!opts.shardOf.empty()) {
+        if (!opts.channels.empty() || !opts.stateFile.empty() ||
+            opts.spectrumPort != 0 || !opts.mergeEndpoints.empty()) {
+            throw ArgsError("--shard-of takes its channels from the "
+                            "coordinator and excludes --channel, "
+                            "--state-file, --spectrum-port and --merge-zmq");
         }
-        coeffs[n] = window * sinc;
+        return opts;
+    }
+    if (opts.channels.empty()) {
+        opts.channels.push_back(
+            {opts.shiftKhz, opts.ports, opts.portFrameSamples});
+    } else if (!opts.stateFile.empty() && opts.channels.size() > 1) {
+        throw ArgsError("--state-file supports a single channel");
     }
-    float sum = 0.0f;
-    for (float c : coeffs) {
-        sum += c;
+    const bool perPortFrames = std::any_of(
+        opts.channels.begin(), opts.channels.end(),
+        [&opts](const ChannelSpec &channel) {
+            return std::any_of(channel.frameSamples.begin(),
+                               channel.frameSamples.end(),
+                               [&opts](std::size_t frame) {
+                                   return frame != 0 &&
+                                          frame != opts.packetSamples;
+                               });
+        });
+    if (perPortFrames &&
+        (!opts.stateFile.empty() || !opts.mergeEndpoints.empty())) {
+        throw ArgsError("per-port frame sizes are not supported with "
+                        "--state-file or --merge-zmq");
     }
-    if (sum != 0.0f) {
-        for (float &c : coeffs) {
-            c /= sum;
+    if (opts.driftCompensation &&
+        (!opts.stateFile.empty() || !opts.mergeEndpoints.empty())) {
+        throw ArgsError("--drift-comp is not supported with --state-file or "
+                        "--merge-zmq");
+    }
+    if (!opts.mergeEndpoints.empty()) {
+        const std::size_t streams = opts.mergeEndpoints.size() + 1;
+        if (opts.channels.size() > 1 || !opts.stateFile.empty() ||
+            opts.workers > 0 || opts.spectrumPort != 0) {
+            throw ArgsError("--merge-zmq supports one channel and no "
+                            "--state-file, --workers or --spectrum-port");
+        }
+        if ((opts.packetSamples - 1) % streams != 0) {
+            throw ArgsError("with --merge-zmq, frame - 1 must be a multiple "
+                            "of the " + std::to_string(streams) +
+                            " merged streams");
         }
     }
-    return coeffs;
+    return opts;
 }
 
-class FirDecimator {
+// Hardware counters read through perf_event_open. The counter is inherited,
+// so opening it before the scheduler, stage-1 helpers and spectrum thread
+// start makes read() sum every decimator thread, not only the receive loop.
+// Unavailable counters (no PMU, perf_event_paranoid) leave the group
+// disabled rather than failing the run.
+class PerfCounters {
   public:
-    FirDecimator(int factor, std::size_t taps, float cutoff)
-        : factor_(factor), taps_(designLowpass(taps, cutoff)),
-          state_(taps_.size()) {}
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
 
-    std::vector<std::complex<float>>
-    process(const std::vector<std::complex<float>> &input) {
-        std::vector<std::complex<float>> output;
-        if (factor_ <= 0 || taps_.empty()) {
-            return output;
-        }
-        output.reserve(input.size() / factor_ + 1);
-        for (const auto &sample : input) {
-            state_[writeIndex_] = sample;
-            writeIndex_ = (writeIndex_ + 1) % state_.size();
-            phase_ = (phase_ + 1) % factor_;
-            if (phase_ == 0) {
-                std::complex<float> acc{0.0f, 0.0f};
-                std::size_t idx = writeIndex_;
-                for (std::size_t k = 0; k < taps_.size(); ++k) {
-                    idx = (idx == 0) ? state_.size() - 1 : idx - 1;
-                    acc += state_[idx] * taps_[k];
-                }
-                output.push_back(acc);
-            }
+    PerfCounters() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(
+            ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd_ >= 0) {
+            (void)::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            (void)::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
         }
-        return output;
     }
 
-  private:
-    int factor_;
-    std::vector<float> taps_;
-    std::vector<std::complex<float>> state_;
-    std::size_t writeIndex_ = 0;
-    int phase_ = 0;
-};
-
-class FrequencyShifter {
-  public:
-    FrequencyShifter(double sampleRate, double shiftHz) : shiftHz_(shiftHz) {
-        if (sampleRate <= 0.0) {
-            sampleRate = 1.0;
+    ~PerfCounters() {
+        if (fd_ >= 0) {
+            ::close(fd_);
         }
-        step_ = (shiftHz_ == 0.0) ? 0.0 : (kTwoPi * shiftHz_ / sampleRate);
     }
 
-    void mix(std::vector<std::complex<float>> &samples) {
-        if (shiftHz_ == 0.0 || samples.empty()) {
-            return;
-        }
-        for (auto &sample : samples) {
-            const auto c = static_cast<float>(std::cos(phase_));
-            const auto s = static_cast<float>(std::sin(phase_));
-            sample *= std::complex<float>(c, s);
-            phase_ += step_;
-            if (phase_ > kPi) {
-                phase_ -= kTwoPi;
-            } else if (phase_ < -kPi) {
-                phase_ += kTwoPi;
-            }
+    bool available() const { return fd_ >= 0; }
+
+    uint64_t dtlbLoadMisses() const {
+        uint64_t value = 0;
+        if (fd_ < 0 || ::read(fd_, &value, sizeof(value)) !=
+                           static_cast<ssize_t>(sizeof(value))) {
+            return 0;
         }
+        return value;
     }
 
   private:
-    double shiftHz_ = 0.0;
-    double step_ = 0.0;
-    double phase_ = 0.0;
+    int fd_ = -1;
 };
 
-class TimestampEncoder {
+// Log2 histogram of latencies: bucket 0 counts values under 1 us, bucket k
+// values in [2^(k-1), 2^k) us, and the last bucket everything above. Atomic
+// so the perf log can read it while a worker records.
+class LatencyHistogram {
   public:
-    explicit TimestampEncoder(double sampleRate) : sampleRate_(sampleRate) {
-        if (sampleRate_ > 0.0) {
-            const double rounded = std::round(sampleRate_);
-            if (std::abs(sampleRate_ - rounded) < 1e-6) {
-                sampleRateHz_ = static_cast<uint64_t>(rounded);
-            }
-        }
-    }
+    static constexpr std::size_t kBuckets = 24;
 
-    void reset() { anchored_ = false; }
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> counts{};
+        uint64_t samples = 0;
+        int64_t maxNs = 0;
 
-    std::complex<float> headerForSample(uint64_t sampleIndex) {
-        if (!anchored_) {
-            anchorToWallClock();
+        // Upper bound in us of the bucket holding quantile q.
+        uint64_t quantileUs(double q) const {
+            if (samples == 0) {
+                return 0;
+            }
+            const auto rank = static_cast<uint64_t>(
+                std::ceil(q * static_cast<double>(samples)));
+            uint64_t seen = 0;
+            for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+                seen += counts[bucket];
+                if (seen >= rank && seen > 0) {
+                    return upperBoundUs(bucket);
+                }
+            }
+            return upperBoundUs(kBuckets - 1);
         }
-        uint32_t seconds = 0;
-        uint32_t nanoseconds = 0;
+    };
 
-        if (sampleRateHz_ > 0) {
-            const unsigned __int128 nsNumerator =
-                static_cast<unsigned __int128>(sampleIndex) * 1000000000ULL;
-            const uint64_t nsOffset =
-                static_cast<uint64_t>(nsNumerator / sampleRateHz_);
-            const uint64_t nsecTotal =
-                static_cast<uint64_t>(baseNsec_) + nsOffset;
+    static uint64_t upperBoundUs(std::size_t bucket) {
+        return uint64_t{1} << bucket;
+    }
 
-            seconds =
-                baseSec_ + static_cast<uint32_t>(nsecTotal / 1000000000ULL);
-            nanoseconds = static_cast<uint32_t>(nsecTotal % 1000000000ULL);
-        } else {
-            double absolute =
-                baseSeconds_ + static_cast<double>(sampleIndex) / sampleRate_;
-            seconds = static_cast<uint32_t>(absolute);
-            double fractional = absolute - static_cast<double>(seconds);
-            nanoseconds =
-                static_cast<uint32_t>(std::round(fractional * 1'000'000'000.0));
-            if (nanoseconds >= 1'000'000'000U) {
-                nanoseconds -= 1'000'000'000U;
-                ++seconds;
-            }
+    void record(int64_t latencyNs) {
+        latencyNs = std::max<int64_t>(latencyNs, 0);
+        uint64_t us = static_cast<uint64_t>(latencyNs) / 1000U;
+        std::size_t bucket = 0;
+        while (us > 0 && bucket + 1 < kBuckets) {
+            us >>= 1U;
+            ++bucket;
         }
+        counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+        samples_.fetch_add(1, std::memory_order_relaxed);
+        int64_t previous = maxNs_.load(std::memory_order_relaxed);
+        while (latencyNs > previous &&
+               !maxNs_.compare_exchange_weak(previous, latencyNs,
+                                             std::memory_order_relaxed)) {
+        }
+    }
 
-        float secBits = 0.0f;
-        float nsecBits = 0.0f;
-        std::memcpy(&secBits, &seconds, sizeof(uint32_t));
-        std::memcpy(&nsecBits, &nanoseconds, sizeof(uint32_t));
-        return {secBits, nsecBits};
+    Snapshot snapshot() const {
+        Snapshot result;
+        for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            result.counts[bucket] =
+                counts_[bucket].load(std::memory_order_relaxed);
+        }
+        result.samples = samples_.load(std::memory_order_relaxed);
+        result.maxNs = maxNs_.load(std::memory_order_relaxed);
+        return result;
     }
 
   private:
-    void anchorToWallClock() {
-        timespec ts{};
-        clock_gettime(CLOCK_REALTIME, &ts);
-        baseSec_ = static_cast<uint32_t>(ts.tv_sec);
-        baseNsec_ = static_cast<uint32_t>(ts.tv_nsec);
-        baseSeconds_ = static_cast<double>(ts.tv_sec) +
-                       static_cast<double>(ts.tv_nsec) * 1e-9;
-        anchored_ = true;
-    }
+    std::array<std::atomic<uint64_t>, kBuckets> counts_{};
+    std::atomic<uint64_t> samples_{0};
+    std::atomic<int64_t> maxNs_{0};
+};
 
-    double sampleRate_;
-    uint64_t sampleRateHz_ = 0;
-    uint32_t baseSec_ = 0;
-    uint32_t baseNsec_ = 0;
-    double baseSeconds_ = 0.0;
-    bool anchored_ = false;
+int64_t realtimeNs() {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000LL + ts.tv_nsec;
+}
+
+// Counters for one UDP destination. wouldBlock counts frames dropped
+// because that socket's send buffer was full; errors are every other failure.
+struct UdpDestinationStats {
+    uint16_t port = 0;
+    uint64_t sent = 0;
+    uint64_t errors = 0;
+    uint64_t wouldBlock = 0;
+    uint64_t partial = 0;
 };
 
+// Sends each frame to every configured port on non-blocking sockets, so a
+// consumer that falls behind loses its own frames instead of stalling the
+// DSP thread and every other destination.
 class UdpStreamer {
   public:
-    UdpStreamer(std::string ip, const std::vector<uint16_t> &ports) {
+    // txTimestampEvery > 0 requests a kernel software TX timestamp on every
+    // Nth frame per destination, with at most one outstanding at a time.
+    // outputs, parallel to ports, names the pipeline frame output each port
+    // is sent from (see sendOutput); empty sends every port output 0.
+    UdpStreamer(std::string ip, const std::vector<uint16_t> &ports,
+                int sendBufferBytes = 0, std::size_t txTimestampEvery = 0,
+                const std::vector<std::size_t> &outputs = {})
+        : txTimestampEvery_(txTimestampEvery) {
         sockaddr_in templateAddr{};
         templateAddr.sin_family = AF_INET;
         if (inet_pton(AF_INET, ip.c_str(), &templateAddr.sin_addr) != 1) {
             throw std::runtime_error("Invalid IPv4 address");
         }
-        for (auto port : ports) {
+        for (std::size_t index = 0; index < ports.size(); ++index) {
+            const uint16_t port = ports[index];
             if (port == 0) {
                 continue;
             }
-            int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+            int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
             if (fd < 0) {
+                closeAll();
                 throw std::runtime_error("Failed to create UDP socket");
             }
-            sockaddr_in addr = templateAddr;
-            addr.sin_port = htons(port);
-            sockets_.push_back({fd, addr});
+            Destination &destination = destinations_.emplace_back();
+            destination.fd = fd;
+            destination.addr = templateAddr;
+            destination.addr.sin_port = htons(port);
+            destination.port = port;
+            destination.output = (index < outputs.size()) ? outputs[index] : 0;
+            if (sendBufferBytes > 0 &&
+                ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBufferBytes,
+                             sizeof(sendBufferBytes)) != 0) {
+                const std::string error = std::strerror(errno);
+                closeAll();
+                throw std::runtime_error("Failed to set UDP SO_SNDBUF: " +
+                                         error);
+            }
+            // Reporting flags only; generation is requested per frame with
+            // a control message so untimed frames cost nothing extra.
+            const int timestampFlags =
+                SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+            if (txTimestampEvery_ > 0 &&
+                ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &timestampFlags,
+                             sizeof(timestampFlags)) != 0) {
+                const std::string error = std::strerror(errno);
+                closeAll();
+                throw std::runtime_error(
+                    "Failed to enable UDP SO_TIMESTAMPING: " + error);
+            }
         }
-        if (sockets_.empty()) {
+        if (destinations_.empty()) {
             throw std::runtime_error("No valid UDP ports configured");
         }
+        socklen_t length = sizeof(sendBufferBytes_);
+        if (::getsockopt(destinations_.front().fd, SOL_SOCKET, SO_SNDBUF,
+                         &sendBufferBytes_, &length) != 0) {
+            sendBufferBytes_ = 0;
+        }
+    }
+
+    ~UdpStreamer() { closeAll(); }
+
+    // Kernel send buffer per socket as reported by SO_SNDBUF (Linux doubles
+    // the requested value and clamps it to net.core.wmem_max).
+    int sendBufferBytes() const { return sendBufferBytes_; }
+
+    void send(const std::vector<std::complex<float>> &frame) const {
+        send(frame.data(), frame.size());
+    }
+
+    // assembledNs is CLOCK_REALTIME when the frame was completed; the TX
+    // latency histogram measures from there to the kernel's timestamp.
+    void send(const std::complex<float> *frame, std::size_t samples,
+              int64_t assembledNs = 0) const {
+        iovec iov{const_cast<std::complex<float> *>(frame),
+                  samples * sizeof(std::complex<float>)};
+        countPacket();
+        for (auto &destination : destinations_) {
+            sendTo(destination, &iov, 1, assembledNs);
+        }
     }
 
-    ~UdpStreamer() {
-        for (const auto &socket : sockets_) {
-            if (socket.fd >= 0) {
-                ::close(socket.fd);
+    // Sends one frame of a pipeline output to the ports taking it, gathered
+    // from the header and the payload where they lie, without a copy.
+    void sendOutput(std::size_t output, const std::complex<float> &header,
+                    const std::complex<float> *payload,
+                    std::size_t payloadSamples, int64_t assembledNs = 0) const {
+        iovec iov[2] = {
+            {const_cast<std::complex<float> *>(&header), sizeof(header)},
+            {const_cast<std::complex<float> *>(payload),
+             payloadSamples * sizeof(std::complex<float>)}};
+        countPacket();
+        for (auto &destination : destinations_) {
+            if (destination.output == output) {
+                sendTo(destination, iov, 2, assembledNs);
             }
         }
     }
 
-    void send(const std::vector<std::complex<float>> &frame) const {
-        const auto *raw = reinterpret_cast<const char *>(frame.data());
-        const std::size_t bytes = frame.size() * sizeof(std::complex<float>);
+    // Frame assembly to kernel transmit, over the sampled frames.
+    LatencyHistogram::Snapshot txLatency() const {
+        return txLatency_.snapshot();
+    }
+
+    // Sampled frames whose timestamp never arrived.
+    uint64_t txTimestampsLost() const { return txTimestampsLost_.load(); }
+
+    bool txTimestamping() const { return txTimestampEvery_ > 0; }
+
+    // Empties every socket's error queue without recording anything, as if
+    // the kernel never delivered the timestamps; lets the tests drive the
+    // give-up path deterministically.
+    void discardTxTimestamps() const {
+        for (auto &destination : destinations_) {
+            alignas(cmsghdr) char control[512];
+            char payload[1];
+            iovec iov{payload, sizeof(payload)};
+            msghdr message{};
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            while (::recvmsg(destination.fd, &message,
+                             MSG_ERRQUEUE | MSG_DONTWAIT) >= 0) {
+                message.msg_controllen = sizeof(control);
+            }
+        }
+    }
+
+    // Safe to call from another thread while send() runs.
+    std::vector<UdpDestinationStats> destinationStats() const {
+        std::vector<UdpDestinationStats> result;
+        result.reserve(destinations_.size());
+        for (const auto &destination : destinations_) {
+            UdpDestinationStats stats;
+            stats.port = destination.port;
+            stats.sent = destination.sent.load();
+            stats.errors = destination.errors.load();
+            stats.wouldBlock = destination.wouldBlock.load();
+            stats.partial = destination.partial.load();
+            result.push_back(stats);
+        }
+        return result;
+    }
+
+  private:
+    struct Destination {
+        int fd = -1;
+        sockaddr_in addr{};
+        uint16_t port = 0;
+        std::size_t output = 0;
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> wouldBlock{0};
+        std::atomic<uint64_t> partial{0};
+        uint64_t frames = 0;
+        bool timestampPending = false;
+        int64_t timedAssembledNs = 0;
+        uint64_t timedSentAtFrame = 0;
+    };
+
+    // Frames sent after a timed one before its timestamp is given up on.
+    static constexpr uint64_t kTimestampGiveUpFrames = 1000;
+
+    void countPacket() const {
         ++packetsSent_;
         if (packetsSent_ == 1 || (packetsSent_ % 500) == 0) {
             std::cerr << "airspyhf_decimator: sent packets=" << packetsSent_
-                      << " send_errors=" << sendErrors_ << "\n";
+                      << " send_errors=" << sendErrors_
+                      << " send_eagain=" << sendWouldBlock_ << "\n";
+        }
+    }
+
+    void sendTo(Destination &destination, iovec *iov, std::size_t iovCount,
+                int64_t assembledNs) const {
+        std::size_t bytes = 0;
+        for (std::size_t index = 0; index < iovCount; ++index) {
+            bytes += iov[index].iov_len;
+        }
+        if (destination.timestampPending) {
+            pollTxTimestamp(destination);
+        }
+        // Counted whether or not a timestamp is pending, so the give-up
+        // in pollTxTimestamp() sees frames go by.
+        const uint64_t frame = destination.frames++;
+        const bool timed = txTimestampEvery_ > 0 &&
+                           !destination.timestampPending &&
+                           (frame % txTimestampEvery_) == 0;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint32_t))] = {};
+        msghdr message{};
+        message.msg_name = &destination.addr;
+        message.msg_namelen = sizeof(sockaddr_in);
+        message.msg_iov = iov;
+        message.msg_iovlen = iovCount;
+        if (timed) {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SO_TIMESTAMPING;
+            header->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+            const uint32_t flags = SOF_TIMESTAMPING_TX_SOFTWARE;
+            std::memcpy(CMSG_DATA(header), &flags, sizeof(flags));
+        }
+        const ssize_t sent = ::sendmsg(destination.fd, &message, 0);
+        if (timed && sent >= 0) {
+            destination.timestampPending = true;
+            destination.timedAssembledNs =
+                (assembledNs > 0) ? assembledNs : realtimeNs();
+            destination.timedSentAtFrame = destination.frames;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            ++sendWouldBlock_;
+            const uint64_t count = destination.wouldBlock.fetch_add(1) + 1;
+            if (count == 1 || (count % 1000) == 0) {
+                std::cerr << "airspyhf_decimator: UDP send buffer full port="
+                          << destination.port << " eagain=" << count << "\n";
+            }
+        } else if (sent < 0) {
+            const int error = errno;
+            ++sendErrors_;
+            const uint64_t count = destination.errors.fetch_add(1) + 1;
+            if (count == 1 || (count % 100) == 0) {
+                std::cerr << "airspyhf_decimator: UDP send failed port="
+                          << destination.port
+                          << " error=" << std::strerror(error)
+                          << " errors=" << count << "\n";
+            }
+        } else if (static_cast<std::size_t>(sent) != bytes) {
+            ++sendErrors_;
+            const uint64_t count = destination.partial.fetch_add(1) + 1;
+            if (count == 1 || (count % 100) == 0) {
+                std::cerr << "airspyhf_decimator: UDP partial send port="
+                          << destination.port << " sent_bytes=" << sent
+                          << " expected_bytes=" << bytes
+                          << " partial=" << count << "\n";
+            }
+        } else {
+            destination.sent.fetch_add(1);
         }
-        for (const auto &socket : sockets_) {
-            ssize_t sent =
-                ::sendto(socket.fd, raw, bytes, 0,
-                         reinterpret_cast<const sockaddr *>(&socket.addr),
-                         sizeof(sockaddr_in));
-            if (sent < 0) {
-                ++sendErrors_;
-                std::perror("sendto");
-                if (sendErrors_ == 1 || (sendErrors_ % 100) == 0) {
-                    std::cerr << "UDP send failures: " << sendErrors_ << " of "
-                              << packetsSent_ << " packets\n";
+    }
+
+    // Drains the socket's error queue and records the software TX
+    // timestamp of the outstanding timed frame, if it has arrived.
+    void pollTxTimestamp(Destination &destination) const {
+        for (;;) {
+            alignas(cmsghdr) char control[512];
+            char payload[1];
+            iovec iov{payload, sizeof(payload)};
+            msghdr message{};
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            if (::recvmsg(destination.fd, &message,
+                          MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                break;
+            }
+            for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+                 header = CMSG_NXTHDR(&message, header)) {
+                if (header->cmsg_level != SOL_SOCKET ||
+                    header->cmsg_type != SCM_TIMESTAMPING ||
+                    !destination.timestampPending) {
+                    continue;
                 }
-            } else if (static_cast<std::size_t>(sent) != bytes) {
-                ++sendErrors_;
-                std::cerr << "Partial UDP send: sent " << sent
-                          << " bytes, expected " << bytes << "\n";
+                scm_timestamping stamps{};
+                std::memcpy(&stamps, CMSG_DATA(header), sizeof(stamps));
+                const int64_t transmitNs =
+                    static_cast<int64_t>(stamps.ts[0].tv_sec) *
+                        1'000'000'000LL +
+                    stamps.ts[0].tv_nsec;
+                txLatency_.record(transmitNs - destination.timedAssembledNs);
+                destination.timestampPending = false;
             }
         }
+        if (destination.timestampPending &&
+            destination.frames - destination.timedSentAtFrame >
+                kTimestampGiveUpFrames) {
+            destination.timestampPending = false;
+            txTimestampsLost_.fetch_add(1);
+        }
     }
 
-  private:
-    struct SocketSlot {
-        int fd;
-        sockaddr_in addr;
-    };
+    void closeAll() {
+        for (auto &destination : destinations_) {
+            if (destination.fd >= 0) {
+                ::close(destination.fd);
+                destination.fd = -1;
+            }
+        }
+    }
 
-    std::vector<SocketSlot> sockets_;
+    // A deque so the atomics never move.
+    mutable std::deque<Destination> destinations_;
+    int sendBufferBytes_ = 0;
+    const std::size_t txTimestampEvery_;
+    mutable LatencyHistogram txLatency_;
+    mutable std::atomic<uint64_t> txTimestampsLost_{0};
     mutable uint64_t packetsSent_ = 0;
     mutable uint64_t sendErrors_ = 0;
+    mutable uint64_t sendWouldBlock_ = 0;
 };
 
-std::vector<std::complex<float>> convertToComplex(const uint8_t *bytes,
-                                                  std::size_t size) {
-    if ((bytes == nullptr && size != 0U) || (size % kBytesPerIQ) != 0U) {
-        throw std::runtime_error("Unaligned IQ byte stream");
+class Radix2Fft {
+  public:
+    explicit Radix2Fft(std::size_t size) : size_(size), twiddles_(size / 2),
+                                           bitReverse_(size) {
+        if (size_ < 2 || (size_ & (size_ - 1)) != 0) {
+            throw std::invalid_argument("FFT size must be a power of two");
+        }
+        for (std::size_t k = 0; k < size_ / 2; ++k) {
+            const double angle =
+                -kTwoPi * static_cast<double>(k) / static_cast<double>(size_);
+            twiddles_[k] = {static_cast<float>(std::cos(angle)),
+                            static_cast<float>(std::sin(angle))};
+        }
+        std::size_t bits = 0;
+        while ((std::size_t{1} << bits) < size_) {
+            ++bits;
+        }
+        for (std::size_t index = 0; index < size_; ++index) {
+            std::size_t reversed = 0;
+            for (std::size_t bit = 0; bit < bits; ++bit) {
+                if ((index & (std::size_t{1} << bit)) != 0) {
+                    reversed |= std::size_t{1} << (bits - 1 - bit);
+                }
+            }
+            bitReverse_[index] = reversed;
+        }
     }
-    std::vector<std::complex<float>> result;
-    result.reserve(size / kBytesPerIQ);
-    for (std::size_t offset = 0; offset + kBytesPerIQ <= size;
-         offset += kBytesPerIQ) {
-        float i = 0.0f;
-        float q = 0.0f;
-        std::memcpy(&i, bytes + offset, sizeof(float));
-        std::memcpy(&q, bytes + offset + sizeof(float), sizeof(float));
-        result.emplace_back(i, q);
+
+    std::size_t size() const { return size_; }
+
+    void forward(std::vector<std::complex<float>> &data) const {
+        if (data.size() != size_) {
+            throw std::invalid_argument("FFT input size mismatch");
+        }
+        for (std::size_t index = 0; index < size_; ++index) {
+            if (index < bitReverse_[index]) {
+                std::swap(data[index], data[bitReverse_[index]]);
+            }
+        }
+        for (std::size_t span = 2; span <= size_; span *= 2) {
+            const std::size_t half = span / 2;
+            const std::size_t stride = size_ / span;
+            for (std::size_t start = 0; start < size_; start += span) {
+                for (std::size_t k = 0; k < half; ++k) {
+                    const auto odd = data[start + k + half] * twiddles_[k * stride];
+                    data[start + k + half] = data[start + k] - odd;
+                    data[start + k] += odd;
+                }
+            }
+        }
     }
-    return result;
-}
 
-struct ZmqPacket {
-    uint64_t sequence = 0;
-    uint64_t timestampUs = 0;
-    uint32_t sampleRate = 0;
-    uint32_t sampleCount = 0;
-    uint32_t flags = 0;
-    uint32_t payloadBytes = 0;
-    std::vector<std::complex<float>> samples;
+  private:
+    std::size_t size_;
+    std::vector<std::complex<float>> twiddles_;
+    std::vector<std::size_t> bitReverse_;
 };
 
-bool parseZmqFrame(const std::vector<uint8_t> &frame, ZmqPacket &packet) {
-    ttwf_zmq_iq_packet_header_t header{};
-    const int validateRc =
-        ttwf_validate_zmq_iq_frame(frame.data(), frame.size(), &header);
-    if (validateRc != TTWF_ZMQ_OK) {
-        return false;
+// Welch power-spectrum estimator: Hann-windowed segments with 50% overlap,
+// averaged until the configured segment count is reached. Output bins are
+// ordered from -Fs/2 to +Fs/2 and scaled so a full-scale complex tone centered
+// on a bin reads 0 dB.
+class WelchAverager {
+  public:
+    WelchAverager(std::size_t fftSize, std::size_t averages)
+        : fft_(fftSize), averages_(averages), window_(fftSize),
+          accumulated_(fftSize, 0.0), scratch_(fftSize) {
+        if (averages_ == 0) {
+            averages_ = 1;
+        }
+        double windowSum = 0.0;
+        for (std::size_t n = 0; n < fftSize; ++n) {
+            window_[n] = static_cast<float>(
+                0.5 - 0.5 * std::cos(kTwoPi * static_cast<double>(n) /
+                                     static_cast<double>(fftSize)));
+            windowSum += window_[n];
+        }
+        coherentGain_ = windowSum * windowSum;
+        pending_.reserve(fftSize * 2);
     }
 
-    const std::size_t headerSize = static_cast<std::size_t>(header.header_size);
-    const std::size_t payloadBytes =
-        static_cast<std::size_t>(header.payload_bytes);
+    void reset() {
+        pending_.clear();
+        std::fill(accumulated_.begin(), accumulated_.end(), 0.0);
+        segments_ = 0;
+    }
 
-    packet.sequence = header.sequence;
-    packet.timestampUs = header.timestamp_us;
-    packet.sampleRate = header.sample_rate;
-    packet.sampleCount = header.sample_count;
-    packet.flags = header.flags;
-    packet.payloadBytes = header.payload_bytes;
-    packet.samples =
-        convertToComplex(frame.data() + headerSize, payloadBytes);
-    return true;
+    // Consumes samples until the average completes; returns the number of
+    // input samples used so callers can tell where the estimate ended.
+    std::size_t push(const std::complex<float> *samples, std::size_t count) {
+        const std::size_t hop = fft_.size() / 2;
+        std::size_t used = 0;
+        while (used < count && !complete()) {
+            const std::size_t take =
+                std::min(count - used, fft_.size() - pending_.size());
+            pending_.insert(pending_.end(), samples + used,
+                            samples + used + take);
+            used += take;
+            if (pending_.size() == fft_.size()) {
+                for (std::size_t n = 0; n < fft_.size(); ++n) {
+                    scratch_[n] = pending_[n] * window_[n];
+                }
+                fft_.forward(scratch_);
+                for (std::size_t k = 0; k < fft_.size(); ++k) {
+                    accumulated_[k] += static_cast<double>(std::norm(scratch_[k]));
+                }
+                ++segments_;
+                pending_.erase(pending_.begin(), pending_.begin() + hop);
+            }
+        }
+        return used;
+    }
+
+    bool complete() const { return segments_ >= averages_; }
+
+    std::size_t fftSize() const { return fft_.size(); }
+    std::size_t averages() const { return averages_; }
+
+    std::vector<float> powerDb() const {
+        const std::size_t size = fft_.size();
+        std::vector<float> power(size, 0.0f);
+        if (segments_ == 0) {
+            return power;
+        }
+        const double scale =
+            1.0 / (coherentGain_ * static_cast<double>(segments_));
+        for (std::size_t k = 0; k < size; ++k) {
+            const double value =
+                std::max(accumulated_[(k + size / 2) % size] * scale, 1e-20);
+            power[k] = static_cast<float>(10.0 * std::log10(value));
+        }
+        return power;
+    }
+
+  private:
+    Radix2Fft fft_;
+    std::size_t averages_;
+    std::vector<float> window_;
+    std::vector<double> accumulated_;
+    std::vector<std::complex<float>> scratch_;
+    std::vector<std::complex<float>> pending_;
+    double coherentGain_ = 1.0;
+    std::size_t segments_ = 0;
+};
+
+struct SpectrumHeader {
+    uint64_t sequence = 0;
+    uint64_t firstSampleIndex = 0;
+    double sampleRateHz = 0.0;
+    double shiftHz = 0.0;
+    uint32_t fftSize = 0;
+    uint32_t averages = 0;
+};
+
+std::vector<uint8_t> encodeSpectrumPacket(const SpectrumHeader &header,
+                                          const std::vector<float> &powerDb) {
+    std::vector<uint8_t> packet(kSpectrumHeaderSizeBytes +
+                                powerDb.size() * sizeof(float));
+    uint8_t *out = packet.data();
+    const auto put = [&out](const void *value, std::size_t bytes) {
+        std::memcpy(out, value, bytes);
+        out += bytes;
+    };
+    put(&kSpectrumMagic, sizeof(kSpectrumMagic));
+    put(&kSpectrumVersion, sizeof(kSpectrumVersion));
+    put(&kSpectrumHeaderSizeBytes, sizeof(kSpectrumHeaderSizeBytes));
+    put(&header.sequence, sizeof(header.sequence));
+    put(&header.firstSampleIndex, sizeof(header.firstSampleIndex));
+    put(&header.sampleRateHz, sizeof(header.sampleRateHz));
+    put(&header.shiftHz, sizeof(header.shiftHz));
+    put(&header.fftSize, sizeof(header.fftSize));
+    put(&header.averages, sizeof(header.averages));
+    if (!powerDb.empty()) {
+        put(powerDb.data(), powerDb.size() * sizeof(float));
+    }
+    return packet;
 }
 
-class ZmqIqReceiver {
+// Computes averaged spectra on a background thread so the decimation loop
+// only pays for a block copy. Averaging is armed once per publish interval,
+// so the FFT work scales with the publish rate rather than the stream rate.
+class SpectrumMonitor {
+  public:
+    SpectrumMonitor(const SpectrumMonitor &) = delete;
+    SpectrumMonitor &operator=(const SpectrumMonitor &) = delete;
+
+    SpectrumMonitor(const std::string &ip, uint16_t port, std::size_t fftSize,
+                    std::size_t averages, double sampleRate, double shiftHz,
+                    std::chrono::milliseconds minInterval)
+        : averager_(fftSize, averages), sampleRate_(sampleRate),
+          shiftHz_(shiftHz), minInterval_(minInterval) {
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(port);
+        if (inet_pton(AF_INET, ip.c_str(), &addr_.sin_addr) != 1) {
+            throw std::runtime_error("Invalid IPv4 address");
+        }
+        fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd_ < 0) {
+            throw std::runtime_error("Failed to create spectrum UDP socket");
+        }
+        worker_ = std::thread([this] { run(); });
+    }
+
+    ~SpectrumMonitor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    void push(const SampleVector &samples) {
+        if (samples.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!armed_) {
+                sampleIndex_ += samples.size();
+                return;
+            }
+            if (queue_.size() >= kMaxQueuedBlocks) {
+                ++droppedBlocks_;
+                sampleIndex_ += samples.size();
+                return;
+            }
+            queue_.push_back({sampleIndex_, samples});
+            sampleIndex_ += samples.size();
+        }
+        wake_.notify_one();
+    }
+
+    uint64_t spectraSent() const { return spectraSent_.load(); }
+    uint64_t droppedBlocks() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return droppedBlocks_;
+    }
+
+  private:
+    static constexpr std::size_t kMaxQueuedBlocks = 64;
+
+    struct Block {
+        uint64_t firstSampleIndex;
+        SampleVector samples;
+    };
+
+    void run() {
+        bool collecting = false;
+        uint64_t windowStart = 0;
+        for (;;) {
+            Block block;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                block = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            if (!collecting) {
+                averager_.reset();
+                collecting = true;
+                windowStart = block.firstSampleIndex;
+            }
+            (void)averager_.push(block.samples.data(), block.samples.size());
+            if (!averager_.complete()) {
+                continue;
+            }
+
+            publish(windowStart);
+            collecting = false;
+            std::unique_lock<std::mutex> lock(mutex_);
+            armed_ = false;
+            queue_.clear();
+            const bool stop = wake_.wait_for(lock, minInterval_,
+                                             [this] { return stopping_; });
+            if (stop) {
+                return;
+            }
+            armed_ = true;
+        }
+    }
+
+    void publish(uint64_t windowStart) {
+        SpectrumHeader header;
+        header.sequence = spectraSent_.load();
+        header.firstSampleIndex = windowStart;
+        header.sampleRateHz = sampleRate_;
+        header.shiftHz = shiftHz_;
+        header.fftSize = static_cast<uint32_t>(averager_.fftSize());
+        header.averages = static_cast<uint32_t>(averager_.averages());
+        const auto packet = encodeSpectrumPacket(header, averager_.powerDb());
+        const ssize_t sent =
+            ::sendto(fd_, packet.data(), packet.size(), 0,
+                     reinterpret_cast<const sockaddr *>(&addr_), sizeof(addr_));
+        if (sent < 0) {
+            std::perror("spectrum sendto");
+        }
+        ++spectraSent_;
+    }
+
+    WelchAverager averager_;
+    double sampleRate_;
+    double shiftHz_;
+    std::chrono::milliseconds minInterval_;
+    sockaddr_in addr_{};
+    int fd_ = -1;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Block> queue_;
+    uint64_t sampleIndex_ = 0;
+    uint64_t droppedBlocks_ = 0;
+    bool armed_ = true;
+    bool stopping_ = false;
+    std::atomic<uint64_t> spectraSent_{0};
+    std::thread worker_;
+};
+
+// Decodes into an existing vector so a reused packet keeps its capacity.
+template <typename Sample, typename Alloc>
+void convertToComplex(const uint8_t *bytes, std::size_t size,
+                      std::vector<Sample, Alloc> &result) {
+    if ((bytes == nullptr && size != 0U) || (size % kBytesPerIQ) != 0U) {
+        throw std::runtime_error("Unaligned IQ byte stream");
+    }
+    result.resize(size / kBytesPerIQ);
+    for (std::size_t index = 0; index < result.size(); ++index) {
+        const uint8_t *sample = bytes + index * kBytesPerIQ;
+        float i = 0.0f;
+        float q = 0.0f;
+        std::memcpy(&i, sample, sizeof(float));
+        std::memcpy(&q, sample + sizeof(float), sizeof(float));
+        result[index] = SampleTraits<Sample>::fromFloat(i, q);
+    }
+}
+
+[[maybe_unused]] SampleVector convertToComplex(const uint8_t *bytes,
+                                               std::size_t size) {
+    SampleVector result;
+    convertToComplex(bytes, size, result);
+    return result;
+}
+
+struct ZmqPacket {
+    uint64_t sequence = 0;
+    uint64_t timestampUs = 0;
+    uint32_t sampleRate = 0;
+    uint32_t sampleCount = 0;
+    uint32_t flags = 0;
+    uint32_t payloadBytes = 0;
+    // When decodeFixed is set the payload is decoded to Q15 into
+    // fixedSamples instead of samples.
+    bool decodeFixed = false;
+    SampleVector samples;
+    SampleBuffer<ci16> fixedSamples;
+};
+
+bool parseZmqFrame(const uint8_t *frame, std::size_t size, ZmqPacket &packet) {
+    ttwf_zmq_iq_packet_header_t header{};
+    const int validateRc = ttwf_validate_zmq_iq_frame(frame, size, &header);
+    if (validateRc != TTWF_ZMQ_OK) {
+        return false;
+    }
+
+    const std::size_t headerSize = static_cast<std::size_t>(header.header_size);
+    const std::size_t payloadBytes =
+        static_cast<std::size_t>(header.payload_bytes);
+
+    packet.sequence = header.sequence;
+    packet.timestampUs = header.timestamp_us;
+    packet.sampleRate = header.sample_rate;
+    packet.sampleCount = header.sample_count;
+    packet.flags = header.flags;
+    packet.payloadBytes = header.payload_bytes;
+    if (packet.decodeFixed) {
+        convertToComplex(frame + headerSize, payloadBytes, packet.fixedSamples);
+    } else {
+        convertToComplex(frame + headerSize, payloadBytes, packet.samples);
+    }
+    return true;
+}
+
+[[maybe_unused]] bool parseZmqFrame(const std::vector<uint8_t> &frame,
+                                    ZmqPacket &packet) {
+    return parseZmqFrame(frame.data(), frame.size(), packet);
+}
+
+// Without --packet-flags the header flags are cleared, since the publisher
+// may use the field for something else; a nonzero value is logged once.
+void applyPacketFlagPolicy(bool enabled, ZmqPacket &packet, bool &logged) {
+    if (enabled || packet.flags == 0U) {
+        return;
+    }
+    if (!logged) {
+        std::cerr << "airspyhf_decimator: ignoring header flags=0x" << std::hex
+                  << packet.flags << std::dec
+                  << " (enable with --packet-flags)\n";
+        logged = true;
+    }
+    packet.flags = 0;
+}
+
+// The reaction to a packet's header flags on one channel pipeline. The main
+// loop and the golden replay both go through these two, so the golden
+// references pin the shipped behaviour.
+
+// Before the packet: a retune restarts the pipeline. Returns the partial
+// frame samples dropped.
+uint64_t restartOnRetune(DecimationPipeline &pipeline, uint32_t flags) {
+    if ((flags & kZmqFlagRetune) == 0U) {
+        return 0;
+    }
+    return pipeline.restartAtDiscontinuity();
+}
+
+// In place of the packet's samples: an overflowed span becomes silence
+// without running the filters. Returns false, blanking nothing, when the
+// caller should process the samples instead; outputs gets the silent
+// output count.
+bool blankOnOverflow(DecimationPipeline &pipeline, uint32_t flags,
+                     std::size_t inputSamples, std::size_t &outputs) {
+    if ((flags & kZmqFlagOverflow) == 0U) {
+        return false;
+    }
+    outputs = pipeline.blankInput(inputSamples);
+    return true;
+}
+
+// Bump allocator for the transient bytes of one received ZMQ message. It is
+// reset per packet; when a packet overflowed into extra chunks, the next
+// reset coalesces them into one chunk sized to the high-water mark, so the
+// steady state allocates nothing.
+class PacketArena {
+  public:
+    explicit PacketArena(std::size_t initialBytes = 64 * 1024) {
+        grow(initialBytes);
+    }
+
+    uint8_t *allocate(std::size_t bytes) {
+        bytes = (bytes + kAlignment - 1) & ~(kAlignment - 1);
+        Chunk *chunk = &chunks_.back();
+        if (chunk->used + bytes > chunk->capacity) {
+            chunk = &grow(std::max(bytes, chunk->capacity));
+        }
+        uint8_t *pointer = chunk->data.data() + chunk->used;
+        chunk->used += bytes;
+        used_ += bytes;
+        highWater_ = std::max(highWater_, used_);
+        return pointer;
+    }
+
+    void reset() {
+        if (chunks_.size() > 1) {
+            chunks_.clear();
+            grow(highWater_);
+        }
+        chunks_.back().used = 0;
+        used_ = 0;
+    }
+
+    std::size_t highWaterBytes() const { return highWater_; }
+    uint64_t chunkAllocations() const { return chunkAllocations_; }
+
+  private:
+    static constexpr std::size_t kAlignment = kSampleAlignment;
+
+    struct Chunk {
+        std::vector<uint8_t, AlignedAllocator<uint8_t>> data;
+        std::size_t capacity = 0;
+        std::size_t used = 0;
+    };
+
+    Chunk &grow(std::size_t bytes) {
+        Chunk chunk;
+        chunk.capacity = std::max<std::size_t>(bytes, kAlignment);
+        chunk.data.resize(chunk.capacity);
+        chunks_.push_back(std::move(chunk));
+        ++chunkAllocations_;
+        return chunks_.back();
+    }
+
+    std::vector<Chunk> chunks_;
+    std::size_t used_ = 0;
+    std::size_t highWater_ = 0;
+    uint64_t chunkAllocations_ = 0;
+};
+
+// Publisher link health from the SUB socket's monitor plus receive gaps. A
+// stall is a run of receive timeouts after data had been flowing; it ends
+// with the next packet and is attributed to a dead publisher if the link
+// dropped meanwhile, otherwise to a slow one.
+struct ZmqLinkStats {
+    bool connected = false;
+    uint64_t connects = 0;
+    uint64_t disconnects = 0;
+    uint64_t connectRetries = 0;
+    uint64_t stalls = 0;
+    uint64_t stallsDisconnected = 0;
+    double stallSecondsTotal = 0.0;
+    double stallSecondsMax = 0.0;
+    double lastStallSeconds = 0.0;
+    bool lastStallDisconnected = false;
+};
+
+class ZmqIqReceiver {
+  public:
+        ZmqIqReceiver(const ZmqIqReceiver &) = delete;
+        ZmqIqReceiver &operator=(const ZmqIqReceiver &) = delete;
+        ZmqIqReceiver(ZmqIqReceiver &&) = delete;
+        ZmqIqReceiver &operator=(ZmqIqReceiver &&) = delete;
+
+    explicit ZmqIqReceiver(const std::string &endpoint)
+        : context_(zmq_ctx_new()), ownsContext_(true) {
+        if (context_ == nullptr) {
+            throw std::runtime_error("Failed to create ZeroMQ context");
+        }
+        open(endpoint);
+    }
+
+    // Shares the caller's context, which inproc:// endpoints require. The
+    // context must outlive the receiver.
+    ZmqIqReceiver(void *context, const std::string &endpoint)
+        : context_(context), ownsContext_(false) {
+        if (context_ == nullptr) {
+            throw std::runtime_error("ZeroMQ context must not be null");
+        }
+        open(endpoint);
+    }
+
+    ~ZmqIqReceiver() {
+        cleanup();
+    }
+
+    // Reuses packet.samples capacity; message parts live in the per-packet
+    // arena, so a steady stream does no general-purpose allocation here.
+    bool receive(ZmqPacket &packet, bool &timedOut) {
+        timedOut = false;
+        arena_.reset();
+        parts_.clear();
+        pollMonitor();
+
+        Part firstPart;
+        bool hasMore = false;
+        if (!receiveFrame(firstPart, hasMore, timedOut)) {
+            if (timedOut && receivedAny_ && !stalled_) {
+                stalled_ = true;
+                disconnectsAtStallStart_ = link_.disconnects;
+            }
+            return false;
+        }
+        noteData();
+        parts_.push_back(firstPart);
+
+        while (hasMore) {
+            Part nextPart;
+            if (!receiveFrame(nextPart, hasMore, timedOut)) {
+                ++malformedPackets_;
+                timedOut = false;
+                return false;
+            }
+            parts_.push_back(nextPart);
+        }
+
+        if (parts_.size() == 1U) {
+            if (tryParseFrame(parts_.front(), packet)) {
+                return true;
+            }
+            ++malformedPackets_;
+            return false;
+        }
+
+        std::size_t totalBytes = 0;
+        for (const auto &part : parts_) {
+            totalBytes += part.size;
+        }
+
+        Part combined{arena_.allocate(totalBytes), totalBytes};
+        std::size_t offset = 0;
+        for (const auto &part : parts_) {
+            if (part.size > 0U) {
+                std::memcpy(combined.data + offset, part.data, part.size);
+            }
+            offset += part.size;
+        }
+
+        if (tryParseFrame(combined, packet)) {
+            return true;
+        }
+
+        for (const auto &part : parts_) {
+            if (tryParseFrame(part, packet)) {
+                return true;
+            }
+        }
+
+        ++malformedPackets_;
+        return false;
+    }
+
+    // Drains pending monitor events without blocking. receive() calls this
+    // on every packet and timeout.
+    void pollMonitor() {
+        while (monitor_ != nullptr) {
+            uint8_t event[6];
+            const int eventBytes =
+                zmq_recv(monitor_, event, sizeof(event), ZMQ_DONTWAIT);
+            if (eventBytes < 0) {
+                break;
+            }
+            char address[256];
+            int addressBytes = 0;
+            int moreValue = 0;
+            std::size_t moreSize = sizeof(moreValue);
+            if (zmq_getsockopt(monitor_, ZMQ_RCVMORE, &moreValue, &moreSize) ==
+                    0 &&
+                moreValue != 0) {
+                addressBytes =
+                    zmq_recv(monitor_, address, sizeof(address) - 1, 0);
+            }
+            address[std::clamp(addressBytes, 0,
+                               static_cast<int>(sizeof(address) - 1))] = '\0';
+            if (eventBytes < 2) {
+                continue;
+            }
+            uint16_t id = 0;
+            std::memcpy(&id, event, sizeof(id));
+            recordLinkEvent(id, address);
+        }
+    }
+
+    const ZmqLinkStats &linkStats() const { return link_; }
+
+    // For waiting on several receivers with one zmq_poll().
+    zmq_pollitem_t pollItem() const { return {socket_, 0, ZMQ_POLLIN, 0}; }
+
+    uint64_t malformedPackets() const { return malformedPackets_; }
+    std::size_t arenaHighWaterBytes() const { return arena_.highWaterBytes(); }
+    uint64_t arenaChunkAllocations() const {
+        return arena_.chunkAllocations();
+    }
+
+  private:
+    void open(const std::string &endpoint) {
+        socket_ = zmq_socket(context_, ZMQ_SUB);
+
+        if (socket_ == nullptr) {
+            cleanup();
+            throw std::runtime_error("Failed to create ZeroMQ SUB socket");
+        }
+
+        const int rcvTimeoutMs = 1000;
+        if (zmq_setsockopt(socket_, ZMQ_RCVTIMEO, &rcvTimeoutMs,
+                           sizeof(rcvTimeoutMs)) != 0) {
+            cleanup();
+            throw std::runtime_error("Failed to set ZeroMQ receive timeout");
+        }
+
+        const char *allTopicsFilter = "";
+        if (zmq_setsockopt(socket_, ZMQ_SUBSCRIBE, allTopicsFilter, 0) != 0) {
+            cleanup();
+            throw std::runtime_error("Failed to subscribe ZeroMQ socket");
+        }
+
+        // Attached before connecting so the first CONNECTED is seen. The
+        // monitor is diagnostics only; without it receiving still works.
+        char monitorEndpoint[64];
+        std::snprintf(monitorEndpoint, sizeof(monitorEndpoint),
+                      "inproc://airspyhf-decimator-monitor-%p",
+                      static_cast<void *>(this));
+        if (zmq_socket_monitor(socket_, monitorEndpoint,
+                               ZMQ_EVENT_CONNECTED | ZMQ_EVENT_DISCONNECTED |
+                                   ZMQ_EVENT_CONNECT_RETRIED) == 0) {
+            monitor_ = zmq_socket(context_, ZMQ_PAIR);
+            if (monitor_ != nullptr &&
+                zmq_connect(monitor_, monitorEndpoint) != 0) {
+                zmq_close(monitor_);
+                monitor_ = nullptr;
+            }
+        }
+        if (monitor_ == nullptr) {
+            std::cerr << "airspyhf_decimator: ZMQ socket monitor unavailable; "
+                         "link events will not be reported\n";
+        }
+
+        if (zmq_connect(socket_, endpoint.c_str()) != 0) {
+            cleanup();
+            throw std::runtime_error("Failed to connect ZeroMQ endpoint: " +
+                                     endpoint);
+        }
+    }
+
+    void cleanup() {
+        if (monitor_ != nullptr) {
+            const int lingerMs = 0;
+            (void)zmq_setsockopt(monitor_, ZMQ_LINGER, &lingerMs,
+                                 sizeof(lingerMs));
+            zmq_close(monitor_);
+            monitor_ = nullptr;
+        }
+        if (socket_ != nullptr) {
+            zmq_close(socket_);
+            socket_ = nullptr;
+        }
+        if (context_ != nullptr && ownsContext_) {
+            zmq_ctx_term(context_);
+        }
+        context_ = nullptr;
+    }
+
+    void recordLinkEvent(uint16_t id, const char *address) {
+        const char *name = nullptr;
+        if (id == ZMQ_EVENT_CONNECTED) {
+            link_.connected = true;
+            ++link_.connects;
+            name = "connected";
+        } else if (id == ZMQ_EVENT_DISCONNECTED) {
+            link_.connected = false;
+            ++link_.disconnects;
+            name = "disconnected";
+        } else if (id == ZMQ_EVENT_CONNECT_RETRIED) {
+            ++link_.connectRetries;
+            if (link_.connectRetries == 1 ||
+                (link_.connectRetries % 100) == 0) {
+                name = "connect_retried";
+            }
+        }
+        if (name != nullptr) {
+            std::cerr << "airspyhf_decimator: zmq link event=" << name
+                      << " endpoint=" << address
+                      << " connects=" << link_.connects
+                      << " disconnects=" << link_.disconnects
+                      << " retries=" << link_.connectRetries << "\n";
+        }
+    }
+
+    void noteData() {
+        const auto now = std::chrono::steady_clock::now();
+        if (stalled_) {
+            stalled_ = false;
+            const double seconds =
+                std::chrono::duration<double>(now - lastDataAt_).count();
+            ++link_.stalls;
+            link_.lastStallSeconds = seconds;
+            link_.lastStallDisconnected =
+                link_.disconnects != disconnectsAtStallStart_;
+            if (link_.lastStallDisconnected) {
+                ++link_.stallsDisconnected;
+            }
+            link_.stallSecondsTotal += seconds;
+            link_.stallSecondsMax = std::max(link_.stallSecondsMax, seconds);
+        }
+        receivedAny_ = true;
+        lastDataAt_ = now;
+    }
+
+    struct Part {
+        uint8_t *data = nullptr;
+        std::size_t size = 0;
+    };
+
+    bool receiveFrame(Part &part, bool &hasMore, bool &timedOut) {
+        part = Part{};
+        timedOut = false;
+
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        const int recvRc = zmq_msg_recv(&msg, socket_, 0);
+        if (recvRc < 0) {
+            zmq_msg_close(&msg);
+            if (errno == EAGAIN) {
+                timedOut = true;
+                return false;
+            }
+            throw std::runtime_error("ZeroMQ receive failed");
+        }
+
+        const std::size_t messageSize = zmq_msg_size(&msg);
+        part.size = messageSize;
+        part.data = arena_.allocate(messageSize);
+        if (messageSize > 0U) {
+            std::memcpy(part.data, zmq_msg_data(&msg), messageSize);
+        }
+
+        int moreValue = 0;
+        std::size_t moreSize = sizeof(moreValue);
+        hasMore = false;
+        if (zmq_getsockopt(socket_, ZMQ_RCVMORE, &moreValue, &moreSize) == 0) {
+            hasMore = (moreValue != 0);
+        }
+
+        zmq_msg_close(&msg);
+        return true;
+    }
+
+    bool tryParseFrame(const Part &part, ZmqPacket &packet) {
+        return parseZmqFrame(part.data, part.size, packet);
+    }
+
+    void *context_ = nullptr;
+    bool ownsContext_ = true;
+    void *socket_ = nullptr;
+    void *monitor_ = nullptr;
+    uint64_t malformedPackets_ = 0;
+    ZmqLinkStats link_;
+    bool receivedAny_ = false;
+    bool stalled_ = false;
+    uint64_t disconnectsAtStallStart_ = 0;
+    std::chrono::steady_clock::time_point lastDataAt_{};
+    PacketArena arena_;
+    std::vector<Part> parts_;
+};
+
+// Stream-level state that, together with the pipeline's FIR/mixer/timestamp
+// state, lets a restarted process continue the downstream stream without
+// re-anchoring.
+struct PipelineCheckpoint {
+    double inputRate = 0.0;
+    uint64_t prevSequence = 0;
+    bool haveSequence = false;
+    uint64_t lastZmqTimestampUs = 0;
+    uint64_t lastPacketSamples = 0;
+};
+
+void saveCheckpoint(const std::string &path,
+                    const PipelineCheckpoint &checkpoint,
+                    const DecimationPipeline &pipeline) {
+    StateWriter writer;
+    writer.put(kCheckpointMagic);
+    writer.put(kCheckpointVersion);
+    writer.put(checkpoint.inputRate);
+    writer.put(checkpoint.prevSequence);
+    writer.put(static_cast<uint8_t>(checkpoint.haveSequence ? 1U : 0U));
+    writer.put(checkpoint.lastZmqTimestampUs);
+    writer.put(checkpoint.lastPacketSamples);
+    pipeline.save(writer);
+
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Failed to open checkpoint file: " +
+                                     tempPath);
+        }
+        const auto &bytes = writer.bytes();
+        out.write(reinterpret_cast<const char *>(bytes.data()),
+                  static_cast<std::streamsize>(bytes.size()));
+        if (!out) {
+            throw std::runtime_error("Failed to write checkpoint file: " +
+                                     tempPath);
+        }
+    }
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace checkpoint file: " + path);
+    }
+}
+
+// Builds a pipeline from config (with the checkpointed input rate) and
+// hands it over only when the whole file parses; the caller keeps its
+// cold-start state if this returns false or throws.
+bool loadCheckpoint(const std::string &path, double expectedInputRate,
+                    PipelineConfig config, PipelineCheckpoint &checkpoint,
+                    std::unique_ptr<DecimationPipeline> &pipeline) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                                     std::istreambuf_iterator<char>());
+    StateReader reader(bytes);
+    if (reader.get<uint32_t>() != kCheckpointMagic ||
+        reader.get<uint16_t>() != kCheckpointVersion) {
+        throw std::runtime_error("Checkpoint magic/version mismatch");
+    }
+
+    PipelineCheckpoint restored;
+    restored.inputRate = reader.get<double>();
+    restored.prevSequence = reader.get<uint64_t>();
+    restored.haveSequence = reader.get<uint8_t>() != 0U;
+    restored.lastZmqTimestampUs = reader.get<uint64_t>();
+    restored.lastPacketSamples = reader.get<uint64_t>();
+    if (!(restored.inputRate > 0.0)) {
+        throw std::runtime_error("Checkpoint has no locked input rate");
+    }
+    if (expectedInputRate > 0.0 && restored.inputRate != expectedInputRate) {
+        throw std::runtime_error("Checkpoint input rate " +
+                                 std::to_string(restored.inputRate) +
+                                 " does not match --input-rate");
+    }
+
+    config.inputRate = restored.inputRate;
+    auto restoredPipeline = std::make_unique<DecimationPipeline>(config);
+    restoredPipeline->restore(reader);
+    if (!reader.atEnd()) {
+        throw std::runtime_error("Checkpoint has trailing bytes");
+    }
+
+    checkpoint = restored;
+    pipeline = std::move(restoredPipeline);
+    return true;
+}
+
+// Decimated samples the publisher produced while this process was down,
+// judged from the ZMQ timestamps on either side of the restart. Gaps within
+// one packet duration are treated as timestamp jitter.
+uint64_t resumeGapOutputSamples(uint64_t lastTimestampUs,
+                                uint64_t lastPacketSamples, double inputRate,
+                                uint64_t resumeTimestampUs) {
+    if (inputRate <= 0.0) {
+        return 0;
+    }
+    const double packetUs =
+        static_cast<double>(lastPacketSamples) * 1e6 / inputRate;
+    const double expectedUs = static_cast<double>(lastTimestampUs) + packetUs;
+    const double gapUs = static_cast<double>(resumeTimestampUs) - expectedUs;
+    if (gapUs <= packetUs) {
+        return 0;
+    }
+    return static_cast<uint64_t>(
+        std::llround(gapUs * 1e-6 * inputRate / kTotalDecimation));
+}
+
+// A sequence this far behind the previous one cannot be reordering.
+constexpr uint64_t kSequenceRestartWindow = 1024;
+
+// Sequences are compared modulo 2^64: anything less than half the range
+// ahead is forward, so UINT64_MAX -> 0 is an ordinary step.
+constexpr uint64_t kSequenceHalfRange = uint64_t{1} << 63;
+
+// True when a packet starts a new publisher run: its sequence went
+// backwards and either the link dropped since the last packet or the jump
+// is too large to be reordering.
+bool isPublisherRestart(uint64_t previousSequence, uint64_t sequence,
+                        bool linkDropped) {
+    const uint64_t behind = previousSequence - sequence;
+    if (behind == 0 || behind >= kSequenceHalfRange) {
+        return false;
+    }
+    return linkDropped || behind > kSequenceRestartWindow;
+}
+
+// Classifies each packet's sequence against the previous one and keeps the
+// drop/reorder/restart totals. A restart makes the packet the first of a
+// new run.
+class SequenceTracker {
+  public:
+    enum class Step { First, InOrder, Gap, Backward, Restart };
+
+    Step observe(uint64_t sequence, bool linkDropped) {
+        Step step = Step::First;
+        if (have_) {
+            const uint64_t ahead = sequence - (previous_ + 1);
+            if (ahead == 0) {
+                step = Step::InOrder;
+            } else if (ahead < kSequenceHalfRange) {
+                step = Step::Gap;
+                lastGap_ = ahead;
+                dropped_ += ahead;
+            } else if (isPublisherRestart(previous_, sequence, linkDropped)) {
+                step = Step::Restart;
+                ++restarts_;
+            } else {
+                step = Step::Backward;
+                ++outOfOrder_;
+            }
+        }
+        have_ = true;
+        previous_ = sequence;
+        return step;
+    }
+
+    void restore(uint64_t previous, bool have) {
+        previous_ = previous;
+        have_ = have;
+    }
+
+    bool haveSequence() const { return have_; }
+    uint64_t previous() const { return previous_; }
+    // Packets missing before the last Gap step.
+    uint64_t lastGap() const { return lastGap_; }
+    uint64_t dropped() const { return dropped_; }
+    uint64_t outOfOrder() const { return outOfOrder_; }
+    uint64_t restarts() const { return restarts_; }
+
+  private:
+    uint64_t previous_ = 0;
+    bool have_ = false;
+    uint64_t lastGap_ = 0;
+    uint64_t dropped_ = 0;
+    uint64_t outOfOrder_ = 0;
+    uint64_t restarts_ = 0;
+};
+
+// The channel's frame sizes besides --frame, in port order without
+// repeats: the pipeline's extraFrameSamples.
+std::vector<std::size_t> extraFrameSamples(const ChannelSpec &spec,
+                                           std::size_t frameSamples) {
+    std::vector<std::size_t> extra;
+    for (const std::size_t frame : spec.frameSamples) {
+        if (frame != 0 && frame != frameSamples &&
+            std::find(extra.begin(), extra.end(), frame) == extra.end()) {
+            extra.push_back(frame);
+        }
+    }
+    return extra;
+}
+
+// The pipeline frame output each port of the channel is sent from.
+std::vector<std::size_t> portFrameOutputs(const ChannelSpec &spec,
+                                          std::size_t frameSamples) {
+    const std::vector<std::size_t> extra =
+        extraFrameSamples(spec, frameSamples);
+    std::vector<std::size_t> outputs(spec.ports.size(), 0);
+    for (std::size_t index = 0;
+         index < outputs.size() && index < spec.frameSamples.size(); ++index) {
+        const auto found = std::find(extra.begin(), extra.end(),
+                                     spec.frameSamples[index]);
+        if (found != extra.end()) {
+            outputs[index] =
+                static_cast<std::size_t>(found - extra.begin()) + 1;
+        }
+    }
+    return outputs;
+}
+
+// One output channel: its own shift, cascade, framing and UDP sockets. The
+// counters are atomics because a scheduler worker updates them while the
+// receive loop reports them.
+struct Channel {
+    Channel(const Options &opts, const ChannelSpec &channelSpec)
+        : spec(channelSpec),
+          streamer(opts.ip, channelSpec.ports, opts.udpSendBufferBytes,
+                   opts.udpTxTimestampEvery,
+                   portFrameOutputs(channelSpec, opts.packetSamples)) {}
+
+    ChannelSpec spec;
+    UdpStreamer streamer;
+    std::unique_ptr<DecimationPipeline> pipeline;
+    std::unique_ptr<TaskStrand> strand;
+    SampleVector input;
+    SampleBuffer<ci16> fixedInput;
+    std::atomic<uint64_t> outputSamples{0};
+    std::atomic<uint64_t> framesSent{0};
+    std::atomic<uint64_t> bufferedSamples{0};
+    // Time spent in runChannelBlock(), reported as load to a coordinator.
+    std::atomic<uint64_t> busyNs{0};
+    // The drift compensator's estimate, for the perf log.
+    std::atomic<double> driftPpm{0.0};
+    std::atomic<double> driftTimeErrorUs{0.0};
+    // errors + eagain + partial over the ports at the last udp line.
+    uint64_t loggedUdpFaults = 0;
+};
+
+// One received packet, shared read-only by every channel's task.
+struct InputBlock {
+    SampleVector samples;
+    SampleBuffer<ci16> fixedSamples;
+    bool fixed = false;
+};
+
+void sendReadyFrames(Channel &channel) {
+    DecimationPipeline &pipeline = *channel.pipeline;
+    const int64_t assembledNs =
+        channel.streamer.txTimestamping() ? realtimeNs() : 0;
+    if (pipeline.frameOutputs() == 1) {
+        while (pipeline.frameReady()) {
+            channel.streamer.send(pipeline.frame(), pipeline.frameSamples(),
+                                  assembledNs);
+            channel.framesSent.fetch_add(1);
+            pipeline.consumeFrame();
+        }
+    } else {
+        for (std::size_t output = 0; output < pipeline.frameOutputs();
+             ++output) {
+            while (pipeline.frameReady(output)) {
+                channel.streamer.sendOutput(
+                    output, pipeline.frameHeader(output),
+                    pipeline.framePayload(output),
+                    pipeline.frameSamples(output) - 1, assembledNs);
+                channel.framesSent.fetch_add(1);
+                pipeline.consumeFrame(output);
+            }
+        }
+    }
+    channel.bufferedSamples.store(pipeline.bufferedSamples());
+}
+
+// Runs one block through a channel and sends every completed frame. The
+// block is mixed in place.
+template <typename Block>
+void runChannelBlock(Channel &channel, Block &block, SpectrumMonitor *spectrum,
+                     SpectrumSource spectrumSource) {
+    const auto start = std::chrono::steady_clock::now();
+    DecimationPipeline &pipeline = *channel.pipeline;
+    const SampleVector &decimated = pipeline.process(block);
+    if (spectrum != nullptr) {
+        spectrum->push((spectrumSource == SpectrumSource::Stage1)
+                           ? pipeline.stage1Output()
+                           : decimated);
+    }
+    channel.outputSamples.fetch_add(decimated.size());
+    sendReadyFrames(channel);
+    channel.busyNs.fetch_add(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count()));
+}
+
+// A packet's publisher timestamp, given before its samples on the thread
+// that runs the channel; a no-op without --drift-comp.
+void observeReferenceTime(Channel &channel, uint64_t timestampUs,
+                          bool contiguous) {
+    DecimationPipeline &pipeline = *channel.pipeline;
+    pipeline.observeReferenceTime(timestampUs, contiguous);
+    if (const DriftCompensator *drift = pipeline.driftCompensator()) {
+        channel.driftPpm.store(drift->driftPpm());
+        channel.driftTimeErrorUs.store(drift->timeErrorUs());
+    }
+}
+
+// A packet the publisher flagged as overflowed: its span becomes silence
+// without running the filters.
+void runChannelBlank(Channel &channel, uint32_t flags,
+                     std::size_t inputSamples) {
+    std::size_t outputs = 0;
+    if (blankOnOverflow(*channel.pipeline, flags, inputSamples, outputs)) {
+        channel.outputSamples.fetch_add(outputs);
+        sendReadyFrames(channel);
+    }
+}
+
+// Gives the channel its own copy of a shared block, since mixing is in place.
+void runChannelCopy(Channel &channel, bool fixed, const SampleVector &samples,
+                    const SampleBuffer<ci16> &fixedSamples,
+                    SpectrumMonitor *spectrum, SpectrumSource spectrumSource) {
+    if (fixed) {
+        channel.fixedInput.assign(fixedSamples.begin(), fixedSamples.end());
+        runChannelBlock(channel, channel.fixedInput, spectrum, spectrumSource);
+    } else {
+        channel.input.assign(samples.begin(), samples.end());
+        runChannelBlock(channel, channel.input, spectrum, spectrumSource);
+    }
+}
+
+// A line per channel with each destination port's send counters, so a
+// consumer that stopped reading shows up as its own port's eagain count,
+// plus the sampled TX latency histogram when timestamping is on. With
+// onlyFaults, a channel's counters are printed only when its errors,
+// eagain or partial count moved since they were last printed.
+void logUdpDestinations(const std::vector<std::unique_ptr<Channel>> &channels,
+                        bool onlyFaults) {
+    for (std::size_t index = 0; index < channels.size(); ++index) {
+        Channel &channel = *channels[index];
+        const auto destinations = channel.streamer.destinationStats();
+        uint64_t faults = 0;
+        for (const auto &stats : destinations) {
+            faults += stats.errors + stats.wouldBlock + stats.partial;
+        }
+        if (!onlyFaults || faults != channel.loggedUdpFaults) {
+            channel.loggedUdpFaults = faults;
+            std::cerr << "airspyhf_decimator: udp channel=" << index;
+            for (const auto &stats : destinations) {
+                const std::string prefix = " p" + std::to_string(stats.port);
+                std::cerr << prefix << "_sent=" << stats.sent << prefix
+                          << "_errors=" << stats.errors << prefix
+                          << "_eagain=" << stats.wouldBlock << prefix
+                          << "_partial=" << stats.partial;
+            }
+            std::cerr << "\n";
+        }
+        const UdpStreamer &streamer = channel.streamer;
+        if (!streamer.txTimestamping()) {
+            continue;
+        }
+        const auto latency = streamer.txLatency();
+        std::cerr << "airspyhf_decimator: udp_tx_latency channel=" << index
+                  << " samples=" << latency.samples
+                  << " lost=" << streamer.txTimestampsLost()
+                  << " p50_us=" << latency.quantileUs(0.5)
+                  << " p99_us=" << latency.quantileUs(0.99)
+                  << " max_us=" << (latency.maxNs / 1000);
+        for (std::size_t bucket = 0; bucket < LatencyHistogram::kBuckets;
+             ++bucket) {
+            if (latency.counts[bucket] == 0) {
+                continue;
+            }
+            if (bucket + 1 == LatencyHistogram::kBuckets) {
+                std::cerr << " ge" << LatencyHistogram::upperBoundUs(bucket - 1);
+            } else {
+                std::cerr << " lt" << LatencyHistogram::upperBoundUs(bucket);
+            }
+            std::cerr << "us=" << latency.counts[bucket];
+        }
+        std::cerr << "\n";
+    }
+}
+
+// How far, in seconds of input, a merged stream is padded with silence to
+// cover a gap or a stalled publisher before the merge realigns instead.
+constexpr double kMergeMaxFillSeconds = 1.0;
+
+struct MergeStreamStats {
+    uint64_t packets = 0;
+    uint64_t dropped = 0;
+    // Out-of-order packets, and packets wholly behind the shared timeline.
+    uint64_t late = 0;
+    uint64_t gapFillSamples = 0;
+    uint64_t lagFillSamples = 0;
+    uint64_t trimmedSamples = 0;
+    // Retune-flagged packets, each restarting the stream's filters.
+    uint64_t retunes = 0;
+    // Offset of the last in-order packet's timestamp_us from where the
+    // sample count placed it.
+    double skewUs = 0.0;
+};
+
+// Puts several publishers' packets on one input timeline and emits frames
+// whose payload interleaves the streams sample by sample under a single
+// timestamp. The timeline starts at the latest stream's next packet once
+// every stream has delivered one, and its timestamp_us anchors the frame
+// headers. In-order packets follow on; after a sequence gap a packet is
+// placed by timestamp_us, with silence filling the hole and overlap
+// trimmed. A stream more than kMergeMaxFillSeconds behind the others is
+// padded with silence so output keeps flowing.
+class StreamMerger {
+  public:
+    // config.frameSamples is the merged frame: one header plus an equal
+    // share of payload per stream.
+    StreamMerger(std::size_t streams, const PipelineConfig &config)
+        : config_(config), streams_(streams),
+          encoder_(config.inputRate / kTotalDecimation),
+          maxFillSamples_(static_cast<int64_t>(
+              std::llround(kMergeMaxFillSeconds * config.inputRate))) {
+        if (streams < 2) {
+            throw std::runtime_error("Merged output needs at least two streams");
+        }
+        if (config.frameSamples < streams + 1 ||
+            (config.frameSamples - 1) % streams != 0) {
+            throw std::runtime_error(
+                "Merged frame payload must split evenly across streams");
+        }
+        streamConfig_ = config;
+        streamConfig_.frameSamples = (config.frameSamples - 1) / streams + 1;
+        frame_.resize(config.frameSamples);
+    }
+
+    std::size_t streams() const { return streams_.size(); }
+    std::size_t frameSamples() const { return frame_.size(); }
+    double outputRate() const { return config_.inputRate / kTotalDecimation; }
+    bool aligned() const { return aligned_; }
+    uint64_t realigns() const { return realigns_; }
+    // timestamp_us of the first sample on the shared timeline.
+    uint64_t startTimestampUs() const { return startUs_; }
+    const MergeStreamStats &stats(std::size_t stream) const {
+        return streams_.at(stream).stats;
+    }
+
+    void push(std::size_t index, const ZmqPacket &packet) {
+        Stream &stream = streams_.at(index);
+        ++stream.stats.packets;
+        const std::size_t count = packet.decodeFixed
+                                      ? packet.fixedSamples.size()
+                                      : packet.samples.size();
+        if (!aligned_) {
+            observeUnaligned(stream, packet.timestampUs, count);
+            return;
+        }
+
+        const auto step = stream.sequence.observe(packet.sequence, false);
+        if (step == SequenceTracker::Step::Backward) {
+            ++stream.stats.late;
+            return;
+        }
+        if (step == SequenceTracker::Step::Gap) {
+            stream.stats.dropped += stream.sequence.lastGap();
+        }
+        const auto sinceStartUs =
+            static_cast<int64_t>(packet.timestampUs - startUs_);
+        const auto placed = static_cast<int64_t>(std::llround(
+            static_cast<double>(sinceStartUs) * config_.inputRate / 1e6));
+        int64_t start = placed;
+        if (step == SequenceTracker::Step::InOrder) {
+            stream.stats.skewUs =
+                static_cast<double>(placed - stream.position) * 1e6 /
+                config_.inputRate;
+            // Timestamp jitter within a packet is not a discontinuity.
+            if (std::llabs(placed - stream.position) <=
+                static_cast<int64_t>(count)) {
+                start = stream.position;
+            }
+        }
+        if (start - stream.position > maxFillSamples_) {
+            ++realigns_;
+            reset();
+            observeUnaligned(stream, packet.timestampUs, count);
+            return;
+        }
+        if (start > stream.position) {
+            const auto gap = static_cast<std::size_t>(start - stream.position);
+            feedSilence(stream, gap);
+            stream.stats.gapFillSamples += gap;
+        }
+        std::size_t skip = 0;
+        if (start < stream.position) {
+            skip = static_cast<std::size_t>(
+                std::min<int64_t>(static_cast<int64_t>(count),
+                                  stream.position - start));
+            stream.stats.trimmedSamples += skip;
+            if (skip == count) {
+                ++stream.stats.late;
+                return;
+            }
+        }
+        // The stream's frames stay aligned with the others, so a retune
+        // restarts its filters without dropping its partial frame.
+        if ((packet.flags & kZmqFlagRetune) != 0U) {
+            stream.pipeline->restartFilters();
+            ++stream.stats.retunes;
+        }
+        if ((packet.flags & kZmqFlagOverflow) != 0U) {
+            feedSilence(stream, count - skip);
+        } else {
+            feed(stream, packet, skip);
+        }
+        padLaggingStreams();
+    }
+
+    bool frameReady() const {
+        if (!aligned_) {
+            return false;
+        }
+        for (const auto &stream : streams_) {
+            if (!stream.pipeline->frameReady()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns frameSamples() samples: the shared timestamp, then sample k
+    // of stream s at 1 + k * streams() + s. Valid until consumeFrame().
+    const std::complex<float> *frame() {
+        frame_[0] = encoder_.headerForSample(samplesSent_);
+        const std::size_t count = streams_.size();
+        const std::size_t payload = streamConfig_.frameSamples - 1;
+        for (std::size_t index = 0; index < count; ++index) {
+            const std::complex<float> *source =
+                streams_[index].pipeline->framePayload();
+            for (std::size_t sample = 0; sample < payload; ++sample) {
+                frame_[1 + sample * count + index] = source[sample];
+            }
+        }
+        return frame_.data();
+    }
+
+    void consumeFrame() {
+        for (auto &stream : streams_) {
+            stream.pipeline->consumeFrame();
+        }
+        samplesSent_ += streamConfig_.frameSamples - 1;
+    }
+
+  private:
+    struct Stream {
+        std::unique_ptr<DecimationPipeline> pipeline;
+        SequenceTracker sequence;
+        bool seen = false;
+        uint64_t nextStartUs = 0;
+        // Input samples fed since the start of the shared timeline.
+        int64_t position = 0;
+        SampleVector input;
+        SampleBuffer<ci16> fixedInput;
+        MergeStreamStats stats;
+    };
+
+    void observeUnaligned(Stream &stream, uint64_t timestampUs,
+                          std::size_t count) {
+        stream.seen = true;
+        stream.nextStartUs =
+            timestampUs + static_cast<uint64_t>(std::llround(
+                              static_cast<double>(count) * 1e6 /
+                              config_.inputRate));
+        for (const auto &other : streams_) {
+            if (!other.seen) {
+                return;
+            }
+        }
+        startUs_ = 0;
+        for (const auto &other : streams_) {
+            startUs_ = std::max(startUs_, other.nextStartUs);
+        }
+        for (auto &other : streams_) {
+            other.pipeline = std::make_unique<DecimationPipeline>(streamConfig_);
+            other.sequence = SequenceTracker();
+            other.position = 0;
+        }
+        encoder_.anchorAt(startUs_ * 1000ULL);
+        samplesSent_ = 0;
+        aligned_ = true;
+    }
+
+    void reset() {
+        aligned_ = false;
+        for (auto &stream : streams_) {
+            stream.seen = false;
+            stream.pipeline.reset();
+        }
+    }
+
+    void feed(Stream &stream, const ZmqPacket &packet, std::size_t skip) {
+        const auto offset = static_cast<std::ptrdiff_t>(skip);
+        if (packet.decodeFixed) {
+            stream.fixedInput.assign(packet.fixedSamples.begin() + offset,
+                                     packet.fixedSamples.end());
+            stream.pipeline->process(stream.fixedInput);
+            stream.position += static_cast<int64_t>(stream.fixedInput.size());
+        } else {
+            stream.input.assign(packet.samples.begin() + offset,
+                                packet.samples.end());
+            stream.pipeline->process(stream.input);
+            stream.position += static_cast<int64_t>(stream.input.size());
+        }
+    }
+
+    void feedSilence(Stream &stream, std::size_t count) {
+        if (config_.arithmetic == Arithmetic::Fixed) {
+            stream.fixedInput.assign(count, ci16{});
+            stream.pipeline->process(stream.fixedInput);
+        } else {
+            stream.input.assign(count, std::complex<float>{});
+            stream.pipeline->process(stream.input);
+        }
+        stream.position += static_cast<int64_t>(count);
+    }
+
+    void padLaggingStreams() {
+        int64_t leader = 0;
+        for (const auto &stream : streams_) {
+            leader = std::max(leader, stream.position);
+        }
+        for (auto &stream : streams_) {
+            const int64_t behind = leader - stream.position;
+            if (behind > maxFillSamples_) {
+                feedSilence(stream, static_cast<std::size_t>(behind));
+                stream.stats.lagFillSamples += static_cast<uint64_t>(behind);
+            }
+        }
+    }
+
+    PipelineConfig config_;
+    PipelineConfig streamConfig_;
+    std::vector<Stream> streams_;
+    TimestampEncoder encoder_;
+    int64_t maxFillSamples_;
+    std::vector<std::complex<float>> frame_;
+    bool aligned_ = false;
+    uint64_t startUs_ = 0;
+    uint64_t samplesSent_ = 0;
+    uint64_t realigns_ = 0;
+};
+
+// --coordinator/--shard-of. Workers report each assigned channel's load
+// (busy fraction of one core) every second, and the coordinator moves
+// channels from its busiest worker to its idlest while that lowers the
+// peak by at least kShardMinRebalanceGain. Channels not measured yet count
+// as kShardDefaultChannelLoad.
+constexpr double kShardDefaultChannelLoad = 0.1;
+constexpr double kShardMinRebalanceGain = 0.05;
+constexpr auto kShardRebalanceInterval = std::chrono::seconds(5);
+constexpr auto kShardWorkerTimeout = std::chrono::seconds(3);
+constexpr auto kShardReportInterval = std::chrono::seconds(1);
+
+struct ShardAssignment {
+    uint32_t id = 0;
+    ChannelSpec spec;
+};
+
+std::vector<std::string> splitWords(const std::string &text) {
+    std::vector<std::string> words;
+    std::istringstream in(text);
+    std::string word;
+    while (in >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+// assignment[w] lists worker w's channel indices. Returns the number of
+// channels moved.
+std::size_t rebalanceShards(std::vector<std::vector<std::size_t>> &assignment,
+                            const std::vector<double> &channelLoads) {
+    if (assignment.size() < 2) {
+        return 0;
+    }
+    std::size_t moves = 0;
+    for (std::size_t step = 0; step < channelLoads.size(); ++step) {
+        std::vector<double> load(assignment.size(), 0.0);
+        for (std::size_t worker = 0; worker < assignment.size(); ++worker) {
+            for (const std::size_t channel : assignment[worker]) {
+                load[worker] += channelLoads[channel];
+            }
+        }
+        const auto busiest = static_cast<std::size_t>(
+            std::max_element(load.begin(), load.end()) - load.begin());
+        const auto idlest = static_cast<std::size_t>(
+            std::min_element(load.begin(), load.end()) - load.begin());
+        auto &from = assignment[busiest];
+        double bestPeak = load[busiest] - kShardMinRebalanceGain;
+        auto best = from.end();
+        for (auto it = from.begin(); it != from.end(); ++it) {
+            const double peak =
+                std::max(load[busiest] - channelLoads[*it],
+                         load[idlest] + channelLoads[*it]);
+            if (peak <= bestPeak) {
+                bestPeak = peak;
+                best = it;
+            }
+        }
+        if (best == from.end()) {
+            break;
+        }
+        assignment[idlest].push_back(*best);
+        from.erase(best);
+        ++moves;
+    }
+    return moves;
+}
+
+// ROUTER end of the shard protocol. Text messages, one frame after the
+// routing identity:
+//   worker -> coordinator  "hello <name>"
+//                          "load <epoch> <name> <id>=<fraction> ..."
+//   coordinator -> worker  "assign <epoch> <id>:<shift_khz>@<ports> ..."
+// Any message from an unknown identity registers a worker, so workers
+// survive a coordinator restart; a worker reporting an old epoch gets its
+// assignment again.
+class ShardCoordinator {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct WorkerStatus {
+        std::string name;
+        std::vector<std::size_t> channels;
+        double load = 0.0;
+    };
+
+    ShardCoordinator(const ShardCoordinator &) = delete;
+    ShardCoordinator &operator=(const ShardCoordinator &) = delete;
+
+    ShardCoordinator(const std::string &endpoint,
+                     std::vector<ChannelSpec> channels)
+        : channels_(std::move(channels)),
+          channelLoads_(channels_.size(), kShardDefaultChannelLoad),
+          measured_(channels_.size(), false) {
+        for (std::size_t index = 0; index < channels_.size(); ++index) {
+            unassigned_.push_back(index);
+        }
+        context_ = zmq_ctx_new();
+        if (context_ == nullptr) {
+            throw std::runtime_error("Failed to create ZeroMQ context");
+        }
+        socket_ = zmq_socket(context_, ZMQ_ROUTER);
+        if (socket_ == nullptr) {
+            cleanup();
+            throw std::runtime_error("Failed to create coordinator socket");
+        }
+        const int lingerMs = 0;
+        (void)zmq_setsockopt(socket_, ZMQ_LINGER, &lingerMs, sizeof(lingerMs));
+        if (zmq_bind(socket_, endpoint.c_str()) != 0) {
+            cleanup();
+            throw std::runtime_error("Failed to bind coordinator endpoint: " +
+                                     endpoint);
+        }
+    }
+
+    ~ShardCoordinator() { cleanup(); }
+
+    // Blocks for up to timeoutMs until a worker message is waiting.
+    bool wait(int timeoutMs) {
+        zmq_pollitem_t item{socket_, 0, ZMQ_POLLIN, 0};
+        return zmq_poll(&item, 1, timeoutMs) > 0;
+    }
+
+    // Handles the waiting worker messages, drops silent workers, places
+    // orphaned channels and rebalances. now drives the timeouts, so read
+    // it after wait() returns: a stale now stamps lastSeen late.
+    void poll(Clock::time_point now) {
+        std::string identity;
+        std::string body;
+        while (receive(identity, body)) {
+            handle(identity, body, now);
+        }
+        expire(now);
+        placeUnassigned();
+        if (membershipChanged_ ||
+            now - lastRebalance_ >= kShardRebalanceInterval) {
+            rebalance();
+            membershipChanged_ = false;
+            lastRebalance_ = now;
+        }
+        sendAssignments(now);
+    }
+
+    std::size_t workers() const { return workers_.size(); }
+    uint64_t rebalances() const { return rebalances_; }
+    uint64_t channelMoves() const { return channelMoves_; }
+
+    std::vector<WorkerStatus> status() const {
+        std::vector<WorkerStatus> result;
+        for (const auto &worker : workers_) {
+            WorkerStatus entry;
+            entry.name = worker.name;
+            entry.channels = worker.channels;
+            for (const std::size_t channel : worker.channels) {
+                entry.load += channelLoads_[channel];
+            }
+            result.push_back(std::move(entry));
+        }
+        return result;
+    }
+
+  private:
+    struct Worker {
+        std::string identity;
+        std::string name;
+        std::vector<std::size_t> channels;
+        Clock::time_point lastSeen;
+        Clock::time_point sentAt;
+        uint64_t epoch = 0;
+        bool dirty = true;
+    };
+
+    // Next [identity, body] message, skipping anything else.
+    bool receive(std::string &identity, std::string &body) {
+        for (;;) {
+            std::vector<std::string> parts;
+            int more = 0;
+            do {
+                zmq_msg_t message;
+                zmq_msg_init(&message);
+                if (zmq_msg_recv(&message, socket_, ZMQ_DONTWAIT) < 0) {
+                    zmq_msg_close(&message);
+                    return false;
+                }
+                parts.emplace_back(
+                    static_cast<const char *>(zmq_msg_data(&message)),
+                    zmq_msg_size(&message));
+                more = zmq_msg_more(&message);
+                zmq_msg_close(&message);
+            } while (more != 0);
+            if (parts.size() == 2) {
+                identity = std::move(parts[0]);
+                body = std::move(parts[1]);
+                return true;
+            }
+        }
+    }
+
+    void handle(const std::string &identity, const std::string &body,
+                Clock::time_point now) {
+        const auto words = splitWords(body);
+        if (words.empty() || (words[0] != "hello" && words[0] != "load")) {
+            return;
+        }
+        auto worker = std::find_if(
+            workers_.begin(), workers_.end(),
+            [&](const Worker &entry) { return entry.identity == identity; });
+        if (worker == workers_.end()) {
+            const std::size_t nameIndex = (words[0] == "hello") ? 1 : 2;
+            Worker joined;
+            joined.identity = identity;
+            joined.name = (words.size() > nameIndex)
+                              ? words[nameIndex]
+                              : "worker" + std::to_string(workers_.size());
+            std::cerr << "airspyhf_decimator: shard worker joined name="
+                      << joined.name << "\n";
+            workers_.push_back(std::move(joined));
+            worker = workers_.end() - 1;
+            membershipChanged_ = true;
+        }
+        worker->lastSeen = now;
+        if (words[0] == "hello") {
+            worker->dirty = true;
+            return;
+        }
+
+        const uint64_t epoch = std::strtoull(words[1].c_str(), nullptr, 10);
+        if (epoch != worker->epoch) {
+            // Lost or pre-restart assignment; resend once it had time to
+            // arrive.
+            if (now - worker->sentAt >= kShardWorkerTimeout) {
+                worker->dirty = true;
+            }
+            return;
+        }
+        for (std::size_t index = 3; index < words.size(); ++index) {
+            const std::size_t equals = words[index].find('=');
+            if (equals == std::string::npos) {
+                continue;
+            }
+            const auto channel = static_cast<std::size_t>(
+                std::strtoul(words[index].c_str(), nullptr, 10));
+            if (std::find(worker->channels.begin(), worker->channels.end(),
+                          channel) == worker->channels.end()) {
+                continue;
+            }
+            channelLoads_[channel] =
+                std::strtod(words[index].c_str() + equals + 1, nullptr);
+            measured_[channel] = true;
+        }
+    }
+
+    void expire(Clock::time_point now) {
+        for (auto it = workers_.begin(); it != workers_.end();) {
+            if (now - it->lastSeen < kShardWorkerTimeout) {
+                ++it;
+                continue;
+            }
+            std::cerr << "airspyhf_decimator: shard worker lost name="
+                      << it->name << " channels=" << it->channels.size()
+                      << "\n";
+            unassigned_.insert(unassigned_.end(), it->channels.begin(),
+                               it->channels.end());
+            it = workers_.erase(it);
+            membershipChanged_ = true;
+        }
+    }
+
+    // Channels not measured yet count as the mean measured load.
+    std::vector<double> estimatedLoads() const {
+        double sum = 0.0;
+        std::size_t count = 0;
+        for (std::size_t index = 0; index < channels_.size(); ++index) {
+            if (measured_[index]) {
+                sum += channelLoads_[index];
+                ++count;
+            }
+        }
+        std::vector<double> loads = channelLoads_;
+        for (std::size_t index = 0; index < channels_.size(); ++index) {
+            if (!measured_[index] && count > 0) {
+                loads[index] = sum / static_cast<double>(count);
+            }
+        }
+        return loads;
+    }
+
+    void placeUnassigned() {
+        if (workers_.empty() || unassigned_.empty()) {
+            return;
+        }
+        const auto loads = estimatedLoads();
+        std::sort(unassigned_.begin(), unassigned_.end(),
+                  [&](std::size_t left, std::size_t right) {
+                      return loads[left] > loads[right];
+                  });
+        for (const std::size_t channel : unassigned_) {
+            Worker *idlest = nullptr;
+            double idlestLoad = 0.0;
+            for (auto &worker : workers_) {
+                double load = 0.0;
+                for (const std::size_t owned : worker.channels) {
+                    load += loads[owned];
+                }
+                if (idlest == nullptr || load < idlestLoad) {
+                    idlest = &worker;
+                    idlestLoad = load;
+                }
+            }
+            idlest->channels.push_back(channel);
+            idlest->dirty = true;
+        }
+        unassigned_.clear();
+    }
+
+    void rebalance() {
+        std::vector<std::vector<std::size_t>> assignment;
+        for (const auto &worker : workers_) {
+            assignment.push_back(worker.channels);
+        }
+        const std::size_t moves = rebalanceShards(assignment, estimatedLoads());
+        if (moves == 0) {
+            return;
+        }
+        for (std::size_t index = 0; index < workers_.size(); ++index) {
+            if (assignment[index] != workers_[index].channels) {
+                workers_[index].channels = std::move(assignment[index]);
+                workers_[index].dirty = true;
+            }
+        }
+        ++rebalances_;
+        channelMoves_ += moves;
+        std::cerr << "airspyhf_decimator: shard rebalance moved=" << moves
+                  << " rebalances=" << rebalances_ << "\n";
+    }
+
+    void sendAssignments(Clock::time_point now) {
+        for (auto &worker : workers_) {
+            if (!worker.dirty) {
+                continue;
+            }
+            worker.epoch = ++epoch_;
+            worker.sentAt = now;
+            worker.dirty = false;
+            std::string body = "assign " + std::to_string(worker.epoch);
+            for (const std::size_t channel : worker.channels) {
+                body += " " + std::to_string(channel) + ":" +
+                        formatChannelSpec(channels_[channel]);
+            }
+            (void)zmq_send(socket_, worker.identity.data(),
+                           worker.identity.size(), ZMQ_SNDMORE);
+            (void)zmq_send(socket_, body.data(), body.size(), 0);
+        }
+    }
+
+    void cleanup() {
+        if (socket_ != nullptr) {
+            zmq_close(socket_);
+            socket_ = nullptr;
+        }
+        if (context_ != nullptr) {
+            zmq_ctx_term(context_);
+            context_ = nullptr;
+        }
+    }
+
+    std::vector<ChannelSpec> channels_;
+    std::vector<double> channelLoads_;
+    std::vector<bool> measured_;
+    std::vector<std::size_t> unassigned_;
+    std::vector<Worker> workers_;
+    void *context_ = nullptr;
+    void *socket_ = nullptr;
+    Clock::time_point lastRebalance_{};
+    bool membershipChanged_ = false;
+    uint64_t epoch_ = 0;
+    uint64_t rebalances_ = 0;
+    uint64_t channelMoves_ = 0;
+};
+
+// DEALER end of the shard protocol, polled from the receive loop.
+class ShardWorkerLink {
   public:
-        ZmqIqReceiver(const ZmqIqReceiver &) = delete;
-        ZmqIqReceiver &operator=(const ZmqIqReceiver &) = delete;
-        ZmqIqReceiver(ZmqIqReceiver &&) = delete;
-        ZmqIqReceiver &operator=(ZmqIqReceiver &&) = delete;
+    ShardWorkerLink(const ShardWorkerLink &) = delete;
+    ShardWorkerLink &operator=(const ShardWorkerLink &) = delete;
 
-    explicit ZmqIqReceiver(const std::string &endpoint)
-        : context_(zmq_ctx_new()) {
+    ShardWorkerLink(const std::string &endpoint, std::string name)
+        : name_(std::move(name)) {
+        context_ = zmq_ctx_new();
         if (context_ == nullptr) {
             throw std::runtime_error("Failed to create ZeroMQ context");
         }
-        socket_ = zmq_socket(context_, ZMQ_SUB);
+        socket_ = zmq_socket(context_, ZMQ_DEALER);
         if (socket_ == nullptr) {
             cleanup();
-            throw std::runtime_error("Failed to create ZeroMQ SUB socket");
-        }
-
-        const int rcvTimeoutMs = 1000;
-        if (zmq_setsockopt(socket_, ZMQ_RCVTIMEO, &rcvTimeoutMs,
-                           sizeof(rcvTimeoutMs)) != 0) {
-            cleanup();
-            throw std::runtime_error("Failed to set ZeroMQ receive timeout");
-        }
-
-        const char *allTopicsFilter = "";
-        if (zmq_setsockopt(socket_, ZMQ_SUBSCRIBE, allTopicsFilter, 0) != 0) {
-            cleanup();
-            throw std::runtime_error("Failed to subscribe ZeroMQ socket");
+            throw std::runtime_error("Failed to create shard worker socket");
         }
-
+        const int lingerMs = 0;
+        (void)zmq_setsockopt(socket_, ZMQ_LINGER, &lingerMs, sizeof(lingerMs));
         if (zmq_connect(socket_, endpoint.c_str()) != 0) {
             cleanup();
-            throw std::runtime_error("Failed to connect ZeroMQ endpoint: " +
+            throw std::runtime_error("Failed to connect coordinator endpoint: " +
                                      endpoint);
         }
+        send("hello " + name_);
     }
 
-    ~ZmqIqReceiver() {
-        cleanup();
-    }
-
-    bool receive(ZmqPacket &packet, bool &timedOut) {
-        timedOut = false;
-
-        std::vector<uint8_t> firstFrame;
-        bool hasMore = false;
-        if (!receiveFrame(firstFrame, hasMore, timedOut)) {
-            return false;
-        }
+    ~ShardWorkerLink() { cleanup(); }
 
-        std::vector<std::vector<uint8_t>> parts;
-        parts.push_back(std::move(firstFrame));
+    const std::string &name() const { return name_; }
+    uint64_t epoch() const { return epoch_; }
 
-        while (hasMore) {
-            std::vector<uint8_t> nextFrame;
-            if (!receiveFrame(nextFrame, hasMore, timedOut)) {
-                ++malformedPackets_;
-                timedOut = false;
-                return false;
+    // Non-blocking. Returns true with the newest assignment when one has
+    // arrived since the last call.
+    bool pollAssignment(std::vector<ShardAssignment> &assignment) {
+        bool updated = false;
+        char buffer[65536];
+        for (;;) {
+            const int size = zmq_recv(socket_, buffer, sizeof(buffer) - 1,
+                                      ZMQ_DONTWAIT);
+            if (size < 0) {
+                break;
             }
-            parts.push_back(std::move(nextFrame));
-        }
-
-        if (parts.size() == 1U) {
-            if (tryParseFrame(parts.front(), packet)) {
-                return true;
+            const std::string body(
+                buffer, std::min<std::size_t>(static_cast<std::size_t>(size),
+                                              sizeof(buffer) - 1));
+            const auto words = splitWords(body);
+            if (words.size() < 2 || words[0] != "assign") {
+                continue;
             }
-            ++malformedPackets_;
-            return false;
-        }
-
-        std::size_t totalBytes = 0;
-        for (const auto &part : parts) {
-            totalBytes += part.size();
-        }
-
-        std::vector<uint8_t> combined;
-        combined.reserve(totalBytes);
-        for (const auto &part : parts) {
-            combined.insert(combined.end(), part.begin(), part.end());
-        }
-
-        if (tryParseFrame(combined, packet)) {
-            return true;
-        }
-
-        for (const auto &part : parts) {
-            if (tryParseFrame(part, packet)) {
-                return true;
+            try {
+                std::vector<ShardAssignment> parsed;
+                for (std::size_t index = 2; index < words.size(); ++index) {
+                    const std::size_t colon = words[index].find(':');
+                    if (colon == std::string::npos) {
+                        throw ArgsError("missing channel id");
+                    }
+                    ShardAssignment entry;
+                    entry.id = static_cast<uint32_t>(
+                        std::stoul(words[index].substr(0, colon)));
+                    entry.spec = parseChannelSpec(words[index].substr(colon + 1));
+                    parsed.push_back(std::move(entry));
+                }
+                assignment = std::move(parsed);
+                epoch_ = std::stoull(words[1]);
+                updated = true;
+            } catch (const std::exception &err) {
+                std::cerr << "airspyhf_decimator: bad shard assignment: "
+                          << err.what() << "\n";
             }
         }
-
-        ++malformedPackets_;
-        return false;
+        return updated;
     }
 
-    uint64_t malformedPackets() const { return malformedPackets_; }
+    // loads pairs channel ids with busy fractions of one core.
+    void reportLoad(const std::vector<std::pair<uint32_t, double>> &loads) {
+        std::ostringstream body;
+        body << "load " << epoch_ << " " << name_;
+        for (const auto &[id, load] : loads) {
+            body << " " << id << "=" << load;
+        }
+        send(body.str());
+    }
 
   private:
+    void send(const std::string &body) {
+        (void)zmq_send(socket_, body.data(), body.size(), ZMQ_DONTWAIT);
+    }
+
     void cleanup() {
         if (socket_ != nullptr) {
             zmq_close(socket_);
@@ -563,52 +2981,336 @@ class ZmqIqReceiver {
             context_ = nullptr;
         }
     }
-    bool receiveFrame(std::vector<uint8_t> &frame, bool &hasMore,
-                      bool &timedOut) {
-        frame.clear();
-        timedOut = false;
 
-        zmq_msg_t msg;
-        zmq_msg_init(&msg);
-        const int recvRc = zmq_msg_recv(&msg, socket_, 0);
-        if (recvRc < 0) {
-            zmq_msg_close(&msg);
-            if (errno == EAGAIN) {
-                timedOut = true;
-                return false;
+    std::string name_;
+    void *context_ = nullptr;
+    void *socket_ = nullptr;
+    uint64_t epoch_ = 0;
+};
+
+std::string defaultShardWorkerName() {
+    char host[256] = {};
+    if (gethostname(host, sizeof(host) - 1) != 0) {
+        std::strcpy(host, "localhost");
+    }
+    return std::string(host) + ":" + std::to_string(::getpid());
+}
+
+volatile std::sig_atomic_t gShouldStop = 0;
+
+void handleTerminationSignal(int) { gShouldStop = 1; }
+
+// --coordinator: no DSP, only channel placement and a status line per
+// second.
+void runCoordinator(const Options &opts) {
+    ShardCoordinator coordinator(opts.coordinatorEndpoint, opts.channels);
+    std::cerr << "airspyhf_decimator: coordinator endpoint="
+              << opts.coordinatorEndpoint
+              << " channels=" << opts.channels.size() << "\n";
+    auto lastStatusLog = std::chrono::steady_clock::now();
+    while (gShouldStop == 0) {
+        (void)coordinator.wait(200);
+        const auto now = std::chrono::steady_clock::now();
+        coordinator.poll(now);
+        if (now - lastStatusLog < std::chrono::seconds(1)) {
+            continue;
+        }
+        lastStatusLog = now;
+        const auto status = coordinator.status();
+        std::cerr << "airspyhf_decimator: shard workers=" << status.size()
+                  << " rebalances=" << coordinator.rebalances()
+                  << " moves=" << coordinator.channelMoves();
+        for (std::size_t index = 0; index < status.size(); ++index) {
+            const std::string prefix = " w" + std::to_string(index);
+            std::cerr << prefix << "=" << status[index].name << prefix
+                      << "_load=" << status[index].load << prefix
+                      << "_channels=";
+            for (std::size_t channel = 0;
+                 channel < status[index].channels.size(); ++channel) {
+                std::cerr << (channel == 0 ? "" : ",")
+                          << status[index].channels[channel];
             }
-            throw std::runtime_error("ZeroMQ receive failed");
         }
+        std::cerr << "\n";
+    }
+}
 
-        const std::size_t messageSize = zmq_msg_size(&msg);
-        frame.resize(messageSize);
-        if (messageSize > 0U) {
-            std::memcpy(frame.data(), zmq_msg_data(&msg), messageSize);
+void logMergeStreams(const StreamMerger &merger) {
+    std::cerr << "airspyhf_decimator: merge aligned="
+              << (merger.aligned() ? "true" : "false")
+              << " start_ts_us=" << merger.startTimestampUs()
+              << " realigns=" << merger.realigns();
+    for (std::size_t index = 0; index < merger.streams(); ++index) {
+        const MergeStreamStats &stats = merger.stats(index);
+        const std::string prefix = " s" + std::to_string(index);
+        std::cerr << prefix << "_packets=" << stats.packets << prefix
+                  << "_dropped=" << stats.dropped << prefix
+                  << "_late=" << stats.late << prefix
+                  << "_gap_fill=" << stats.gapFillSamples << prefix
+                  << "_lag_fill=" << stats.lagFillSamples << prefix
+                  << "_trimmed=" << stats.trimmedSamples << prefix
+                  << "_retunes=" << stats.retunes << prefix
+                  << "_skew_us=" << stats.skewUs;
+    }
+    std::cerr << "\n";
+}
+
+// --merge-zmq: one receiver per publisher feeding a StreamMerger, whose
+// interleaved frames go out on the first channel's ports.
+void runMergedOutput(const Options &opts) {
+    std::vector<std::string> endpoints = {opts.zmqEndpoint};
+    endpoints.insert(endpoints.end(), opts.mergeEndpoints.begin(),
+                     opts.mergeEndpoints.end());
+    std::vector<std::unique_ptr<ZmqIqReceiver>> receivers;
+    std::vector<zmq_pollitem_t> pollItems;
+    for (const auto &endpoint : endpoints) {
+        receivers.push_back(std::make_unique<ZmqIqReceiver>(endpoint));
+        pollItems.push_back(receivers.back()->pollItem());
+        std::cerr << "airspyhf_decimator: merge stream="
+                  << (receivers.size() - 1) << " zmq=" << endpoint << "\n";
+    }
+    const ChannelSpec &spec = opts.channels.front();
+    UdpStreamer streamer(opts.ip, spec.ports, opts.udpSendBufferBytes,
+                         opts.udpTxTimestampEvery);
+
+    PipelineConfig config;
+    config.frameSamples = opts.packetSamples;
+    config.arithmetic = opts.arithmetic;
+    config.stage1Threads = opts.stage1Threads;
+    config.stage1Engine = opts.stage1Engine;
+    config.shiftHz = spec.shiftKhz * 1000.0;
+    std::unique_ptr<StreamMerger> merger;
+    uint64_t framesSent = 0;
+    uint64_t sampleRateFieldWarnings = 0;
+    auto lastPerfLog = std::chrono::steady_clock::now();
+
+    ZmqPacket packet;
+    bool flagsLogged = false;
+    packet.decodeFixed = (opts.arithmetic == Arithmetic::Fixed);
+    while (gShouldStop == 0) {
+        if (zmq_poll(pollItems.data(), static_cast<int>(pollItems.size()),
+                     1000) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("zmq_poll failed on merged streams");
         }
+        for (std::size_t index = 0; index < receivers.size(); ++index) {
+            if ((pollItems[index].revents & ZMQ_POLLIN) == 0) {
+                continue;
+            }
+            ZmqIqReceiver &receiver = *receivers[index];
+            bool timedOut = false;
+            if (!receiver.receive(packet, timedOut)) {
+                if (!timedOut && (receiver.malformedPackets() == 1 ||
+                                  (receiver.malformedPackets() % 100) == 0)) {
+                    std::cerr << "airspyhf_decimator: malformed ZMQ packets="
+                              << receiver.malformedPackets()
+                              << " stream=" << index << "\n";
+                }
+                continue;
+            }
+            applyPacketFlagPolicy(opts.packetFlags, packet, flagsLogged);
 
-        int moreValue = 0;
-        std::size_t moreSize = sizeof(moreValue);
-        hasMore = false;
-        if (zmq_getsockopt(socket_, ZMQ_RCVMORE, &moreValue, &moreSize) == 0) {
-            hasMore = (moreValue != 0);
+            if (!merger) {
+                config.inputRate = (opts.inputRate > 0.0)
+                                       ? opts.inputRate
+                                       : static_cast<double>(packet.sampleRate);
+                merger = std::make_unique<StreamMerger>(receivers.size(),
+                                                        config);
+                std::cerr << "airspyhf_decimator: locked input rate="
+                          << config.inputRate
+                          << " outputRate=" << merger->outputRate()
+                          << " merged_streams=" << merger->streams() << "\n";
+            }
+            // Every stream must run at the locked rate for the timelines
+            // to line up.
+            const double rateErrorPpm =
+                1e6 *
+                std::abs(static_cast<double>(packet.sampleRate) -
+                         config.inputRate) /
+                config.inputRate;
+            if (rateErrorPpm > opts.rateTolerancePpm) {
+                if (opts.strictInputRate) {
+                    throw std::runtime_error(
+                        "Strict input-rate mismatch in packet header");
+                }
+                ++sampleRateFieldWarnings;
+                if (sampleRateFieldWarnings <= 10 ||
+                    (sampleRateFieldWarnings % 100) == 0) {
+                    std::cerr
+                        << "airspyhf_decimator: bad incoming sample_rate field="
+                        << packet.sampleRate << " expected=" << config.inputRate
+                        << " stream=" << index
+                        << " warnings=" << sampleRateFieldWarnings << "\n";
+                }
+            }
+
+            const uint64_t realignsBefore = merger->realigns();
+            const uint64_t retunesBefore = merger->stats(index).retunes;
+            const bool wasAligned = merger->aligned();
+            merger->push(index, packet);
+            if (merger->stats(index).retunes != retunesBefore) {
+                std::cerr << "airspyhf_decimator: retune flagged stream="
+                          << index << " sequence=" << packet.sequence
+                          << " retunes=" << merger->stats(index).retunes
+                          << "\n";
+            }
+            if (merger->realigns() != realignsBefore) {
+                std::cerr << "airspyhf_decimator: merge realign stream="
+                          << index << " ts_us=" << packet.timestampUs
+                          << " realigns=" << merger->realigns() << "\n";
+            } else if (!wasAligned && merger->aligned()) {
+                std::cerr << "airspyhf_decimator: merge aligned start_ts_us="
+                          << merger->startTimestampUs() << "\n";
+            }
+            const int64_t assembledNs =
+                streamer.txTimestamping() ? realtimeNs() : 0;
+            while (merger->frameReady()) {
+                streamer.send(merger->frame(), merger->frameSamples(),
+                              assembledNs);
+                merger->consumeFrame();
+                ++framesSent;
+            }
         }
 
-        zmq_msg_close(&msg);
-        return true;
+        const auto now = std::chrono::steady_clock::now();
+        if (merger && now - lastPerfLog >= std::chrono::seconds(1)) {
+            std::cerr << "airspyhf_decimator: perf merged_frames=" << framesSent;
+            for (std::size_t index = 0; index < receivers.size(); ++index) {
+                const ZmqLinkStats &link = receivers[index]->linkStats();
+                std::cerr << " s" << index << "_malformed="
+                          << receivers[index]->malformedPackets() << " s"
+                          << index << "_zmq_connected="
+                          << (link.connected ? "true" : "false");
+            }
+            std::cerr << "\n";
+            logMergeStreams(*merger);
+            lastPerfLog = now;
+        }
     }
 
-    bool tryParseFrame(const std::vector<uint8_t> &frame, ZmqPacket &packet) {
-        return parseZmqFrame(frame, packet);
+    if (merger) {
+        logMergeStreams(*merger);
     }
+    std::cerr << "airspyhf_decimator: stopping merged_frames=" << framesSent
+              << " sample_rate_field_warnings=" << sampleRateFieldWarnings
+              << "\n";
+}
 
-    void *context_ = nullptr;
-    void *socket_ = nullptr;
-    uint64_t malformedPackets_ = 0;
-};
+// The local interface a tcp:// endpoint's host is routed through: a
+// connected UDP socket reports its source address without sending. Empty
+// for other transports and hosts that do not resolve.
+std::string endpointInterface(const std::string &endpoint) {
+    const std::string scheme = "tcp://";
+    if (endpoint.compare(0, scheme.size(), scheme) != 0) {
+        return {};
+    }
+    std::string host = endpoint.substr(scheme.size());
+    // "tcp://source;host:port" names the local side explicitly.
+    const std::size_t semicolon = host.find(';');
+    if (semicolon != std::string::npos) {
+        host = host.substr(semicolon + 1);
+    }
+    std::string port = "9";
+    const std::size_t colon = host.rfind(':');
+    if (colon != std::string::npos) {
+        port = host.substr(colon + 1);
+        host = host.substr(0, colon);
+    }
+    if (host.empty() || host == "*") {
+        return {};
+    }
 
-volatile std::sig_atomic_t gShouldStop = 0;
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *resolved = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &resolved) != 0 ||
+        resolved == nullptr) {
+        return {};
+    }
+    sockaddr_in local{};
+    socklen_t localLength = sizeof(local);
+    const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    const bool routed =
+        fd >= 0 &&
+        ::connect(fd, resolved->ai_addr, resolved->ai_addrlen) == 0 &&
+        ::getsockname(fd, reinterpret_cast<sockaddr *>(&local),
+                      &localLength) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    ::freeaddrinfo(resolved);
+    if (!routed) {
+        return {};
+    }
 
-void handleTerminationSignal(int) { gShouldStop = 1; }
+    ifaddrs *interfaces = nullptr;
+    if (::getifaddrs(&interfaces) != 0) {
+        return {};
+    }
+    std::string name;
+    for (ifaddrs *entry = interfaces; entry != nullptr;
+         entry = entry->ifa_next) {
+        if (entry->ifa_addr != nullptr &&
+            entry->ifa_addr->sa_family == AF_INET &&
+            reinterpret_cast<const sockaddr_in *>(entry->ifa_addr)
+                    ->sin_addr.s_addr == local.sin_addr.s_addr) {
+            name = entry->ifa_name;
+            break;
+        }
+    }
+    ::freeifaddrs(interfaces);
+    return name;
+}
+
+struct NumaPlacement {
+    int node = -1;
+    std::vector<int> cpus;
+    bool memoryPolicy = false;
+    std::string reason;
+};
+
+// Chooses a node per --numa and binds the calling thread to it. Runs on
+// the main thread before any receiver, worker or buffer exists, so they
+// all inherit the placement.
+NumaPlacement placeOnNumaNode(const Options &opts,
+                              const NumaTopology &topology) {
+    NumaPlacement placement;
+    if (opts.numaPolicy == NumaPolicy::Off) {
+        placement.reason = "off";
+        return placement;
+    }
+    int node = opts.numaNode;
+    if (opts.numaPolicy == NumaPolicy::Node) {
+        placement.reason = "requested";
+    } else if (topology.nodes().size() == 1) {
+        node = topology.nodes().front().id;
+        placement.reason = "single_node";
+    } else {
+        const std::string interfaceName = endpointInterface(opts.zmqEndpoint);
+        node = interfaceNumaNode(interfaceName);
+        if (topology.node(node) != nullptr) {
+            placement.reason = "zmq_interface:" + interfaceName;
+        } else {
+            node = topology.nodeOfCpu(::sched_getcpu());
+            if (node < 0) {
+                node = topology.nodes().front().id;
+            }
+            placement.reason = "current_cpu";
+        }
+    }
+    const NumaNode *target = topology.node(node);
+    if (target == nullptr) {
+        throw std::runtime_error("NUMA node " + std::to_string(node) +
+                                 " does not exist; nodes are " +
+                                 topology.summary());
+    }
+    placement.node = node;
+    placement.cpus = bindCurrentThreadToNode(*target, placement.memoryPolicy);
+    return placement;
+}
 
 } // namespace
 
@@ -618,52 +3320,280 @@ int main(int argc, char **argv) {
         std::signal(SIGTERM, handleTerminationSignal);
         std::signal(SIGPIPE, SIG_IGN);
         auto opts = parseArgs(argc, argv);
+        gHugePageMode.store(opts.hugePages);
+        // The receive thread runs DSP inline; worker and stage-1 threads
+        // inherit this mode from it.
+        const bool denormalModeSet = setFlushDenormals(opts.flushDenormals);
+        // Before any thread or buffer exists; everything inherits it.
+        const NumaTopology topology = NumaTopology::discover();
+        const NumaPlacement placement = placeOnNumaNode(opts, topology);
 
         std::cerr << "airspyhf_decimator: zmq=" << opts.zmqEndpoint
                   << " inputRateExpected=" << opts.inputRate
                   << " strictInputRate="
                   << (opts.strictInputRate ? "true" : "false")
-                  << " shiftKhz=" << opts.shiftKhz
+                  << " channels=" << opts.channels.size()
+                  << " workers=" << opts.workers
+                  << " stage1Threads=" << opts.stage1Threads
+                  << " stage1Engine="
+                  << ((opts.stage1Engine == Stage1Engine::Iir) ? "iir" : "fir")
                   << " frame=" << opts.packetSamples
-                  << " rateTolPpm=" << opts.rateTolerancePpm << "\n";
+                  << " rateTolPpm=" << opts.rateTolerancePpm
+                  << " hugepages=" << hugePageModeName(opts.hugePages)
+                  << " denormals="
+                  << (!denormalModeSet       ? "unsupported"
+                      : opts.flushDenormals ? "flush"
+                                            : "ieee")
+                  << " arith="
+                  << ((opts.arithmetic == Arithmetic::Fixed) ? "fixed"
+                                                             : "float")
+                  << " merged_streams="
+                  << (opts.mergeEndpoints.empty()
+                          ? 0
+                          : opts.mergeEndpoints.size() + 1)
+                  << "\n";
+        std::cerr << "airspyhf_decimator: numa nodes="
+                  << topology.nodes().size() << " topology=" << topology.summary() << " policy="
+                  << ((opts.numaPolicy == NumaPolicy::Off)    ? "off"
+                      : (opts.numaPolicy == NumaPolicy::Auto) ? "auto"
+                                                              : "node");
+        if (placement.node >= 0) {
+            std::cerr << " node=" << placement.node
+                      << " cpus=" << formatCpuList(placement.cpus)
+                      << " memory="
+                      << (placement.memoryPolicy ? "preferred" : "first_touch")
+                      << " reason=" << placement.reason;
+        }
+        std::cerr << "\n";
 
-        FirDecimator stage1(8, 8 * 16, 0.45f / 8.0f);
-        FirDecimator stage2(5, 5 * 16, 0.45f / 5.0f);
-        FirDecimator stage3(5, 5 * 16, 0.45f / 5.0f);
+        if (!opts.mergeEndpoints.empty()) {
+            runMergedOutput(opts);
+            return 0;
+        }
+        if (!opts.coordinatorEndpoint.empty()) {
+            runCoordinator(opts);
+            return 0;
+        }
 
-        ZmqIqReceiver receiver(opts.zmqEndpoint);
-        std::unique_ptr<TimestampEncoder> timestampEncoder;
-        UdpStreamer streamer(opts.ip, opts.ports);
-        std::unique_ptr<FrequencyShifter> frequencyShifter;
+        // Opened before any worker thread exists so every one inherits it.
+        std::unique_ptr<PerfCounters> perfCounters;
+        if (opts.perfCounters) {
+            perfCounters = std::make_unique<PerfCounters>();
+            if (!perfCounters->available()) {
+                std::cerr << "airspyhf_decimator: perf counters unavailable "
+                             "(check perf_event_paranoid); continuing without "
+                             "them\n";
+                perfCounters.reset();
+            }
+        }
 
-        const std::size_t payloadSamples = opts.packetSamples - 1;
+        PipelineConfig pipelineConfig;
+        pipelineConfig.frameSamples = opts.packetSamples;
+        pipelineConfig.arithmetic = opts.arithmetic;
+        pipelineConfig.stage1Threads = opts.stage1Threads;
+        pipelineConfig.stage1Engine = opts.stage1Engine;
+        pipelineConfig.driftCompensation = opts.driftCompensation;
 
-        std::vector<std::complex<float>> buffer;
-        buffer.reserve(payloadSamples * 2);
+        ZmqIqReceiver receiver(opts.zmqEndpoint);
+        std::vector<std::unique_ptr<Channel>> channels;
+        for (const auto &spec : opts.channels) {
+            channels.push_back(std::make_unique<Channel>(opts, spec));
+            std::string frames;
+            for (std::size_t index = 0; index < spec.ports.size(); ++index) {
+                const std::size_t frame =
+                    (index < spec.frameSamples.size() &&
+                     spec.frameSamples[index] != 0)
+                        ? spec.frameSamples[index]
+                        : opts.packetSamples;
+                frames += (index == 0 ? "" : ",") + std::to_string(frame);
+            }
+            std::cerr << "airspyhf_decimator: channel=" << (channels.size() - 1)
+                      << " shiftKhz=" << spec.shiftKhz
+                      << " ports=" << spec.ports.size()
+                      << " frames=" << frames << " udp_sndbuf="
+                      << channels.back()->streamer.sendBufferBytes() << "\n";
+        }
+        // The spectrum monitor taps the first channel.
+        const auto channelConfig = [&](std::size_t index) {
+            PipelineConfig config = pipelineConfig;
+            config.shiftHz = opts.channels[index].shiftKhz * 1000.0;
+            config.extraFrameSamples =
+                extraFrameSamples(opts.channels[index], opts.packetSamples);
+            config.keepStage1Output =
+                index == 0 && opts.spectrumPort != 0 &&
+                opts.spectrumSource == SpectrumSource::Stage1;
+            return config;
+        };
+        std::unique_ptr<SpectrumMonitor> spectrumMonitor;
 
-        uint64_t samplesSent = 0;
         uint64_t inputSamplesProcessed = 0;
-        uint64_t outputSamplesProduced = 0;
-        uint64_t framesSent = 0;
         uint64_t zmqBytesRead = 0;
         uint64_t zmqPacketsReceived = 0;
-        uint64_t droppedPackets = 0;
-        uint64_t outOfOrderPackets = 0;
         uint64_t sampleRateFieldWarnings = 0;
         uint64_t measuredRateWarnings = 0;
-        uint64_t prevSequence = 0;
-        bool haveSequence = false;
+        uint64_t overflowPackets = 0;
+        uint64_t retunes = 0;
+        SequenceTracker sequence;
         uint64_t firstZmqTimestampUs = 0;
         uint64_t lastZmqTimestampUs = 0;
+        uint64_t timestampRateBaseSamples = 0;
+        uint64_t reportedStalls = 0;
+        uint64_t disconnectsAtLastPacket = 0;
         double effectiveInputRate = 0.0;
         double effectiveOutputRate = 0.0;
+        uint64_t lastPacketSamples = 0;
+        bool resumePending = false;
+        uint64_t resumeLastTimestampUs = 0;
+
+        if (!opts.stateFile.empty()) {
+            PipelineCheckpoint checkpoint;
+            try {
+                auto &pipeline = channels.front()->pipeline;
+                if (loadCheckpoint(opts.stateFile, opts.inputRate,
+                                   channelConfig(0), checkpoint, pipeline)) {
+                    effectiveInputRate = checkpoint.inputRate;
+                    effectiveOutputRate = pipeline->outputRate();
+                    sequence.restore(checkpoint.prevSequence,
+                                     checkpoint.haveSequence);
+                    lastPacketSamples = checkpoint.lastPacketSamples;
+                    resumeLastTimestampUs = checkpoint.lastZmqTimestampUs;
+                    resumePending = true;
+                    std::cerr << "airspyhf_decimator: restored state file="
+                              << opts.stateFile
+                              << " inputRate=" << effectiveInputRate
+                              << " samplesSent=" << pipeline->samplesSent()
+                              << " sequence=" << sequence.previous()
+                              << " buffer_samples="
+                              << pipeline->bufferedSamples()
+                              << "\n";
+                }
+            } catch (const std::exception &err) {
+                std::cerr << "airspyhf_decimator: cold start, state file "
+                          << opts.stateFile << " unusable: " << err.what()
+                          << "\n";
+            }
+        }
+
+        // Declared after everything its tasks touch, so it drains and joins
+        // first on the way out.
+        std::unique_ptr<WorkStealingScheduler> scheduler;
+        if (opts.workers > 0) {
+            scheduler = std::make_unique<WorkStealingScheduler>(opts.workers);
+            for (auto &channel : channels) {
+                channel->strand = std::make_unique<TaskStrand>(
+                    *scheduler, kMaxQueuedBlocksPerChannel);
+            }
+        }
+        std::vector<WorkStealingScheduler::WorkerStats> lastWorkerStats(
+            opts.workers);
+
+        // --shard-of: channels come and go with the coordinator's
+        // assignments; shardIds[i] is channels[i]'s coordinator id.
+        std::unique_ptr<ShardWorkerLink> shardLink;
+        std::vector<uint32_t> shardIds;
+        std::vector<uint64_t> reportedBusyNs;
+        auto lastShardReport = std::chrono::steady_clock::now();
+        if (!opts.shardOf.empty()) {
+            shardLink = std::make_unique<ShardWorkerLink>(
+                opts.shardOf, defaultShardWorkerName());
+            std::cerr << "airspyhf_decimator: shard worker name="
+                      << shardLink->name() << " coordinator=" << opts.shardOf
+                      << "\n";
+        }
+        const auto applyShardAssignment =
+            [&](const std::vector<ShardAssignment> &assignment) {
+                if (scheduler) {
+                    scheduler->waitIdle();
+                    for (auto &channel : channels) {
+                        channel->strand->rethrowIfFailed();
+                    }
+                }
+                // Channels that stay keep their pipelines and timelines.
+                std::vector<std::unique_ptr<Channel>> kept;
+                std::vector<uint64_t> keptBusyNs;
+                opts.channels.clear();
+                for (const auto &entry : assignment) {
+                    std::unique_ptr<Channel> channel;
+                    uint64_t busyNs = 0;
+                    for (std::size_t index = 0; index < channels.size();
+                         ++index) {
+                        if (channels[index] && shardIds[index] == entry.id &&
+                            channels[index]->spec.shiftKhz ==
+                                entry.spec.shiftKhz &&
+                            channels[index]->spec.ports == entry.spec.ports &&
+                            channels[index]->spec.frameSamples ==
+                                entry.spec.frameSamples) {
+                            channel = std::move(channels[index]);
+                            busyNs = reportedBusyNs[index];
+                            break;
+                        }
+                    }
+                    opts.channels.push_back(entry.spec);
+                    if (!channel) {
+                        channel = std::make_unique<Channel>(opts, entry.spec);
+                        busyNs = 0;
+                        if (effectiveInputRate > 0.0) {
+                            channel->pipeline =
+                                std::make_unique<DecimationPipeline>(
+                                    channelConfig(opts.channels.size() - 1));
+                        }
+                        if (scheduler) {
+                            channel->strand = std::make_unique<TaskStrand>(
+                                *scheduler, kMaxQueuedBlocksPerChannel);
+                        }
+                    }
+                    kept.push_back(std::move(channel));
+                    keptBusyNs.push_back(busyNs);
+                }
+                channels = std::move(kept);
+                reportedBusyNs = std::move(keptBusyNs);
+                shardIds.clear();
+                std::cerr << "airspyhf_decimator: shard assignment epoch="
+                          << shardLink->epoch() << " channels=";
+                for (std::size_t index = 0; index < assignment.size();
+                     ++index) {
+                    shardIds.push_back(assignment[index].id);
+                    std::cerr << (index == 0 ? "" : ",")
+                              << assignment[index].id;
+                }
+                std::cerr << "\n";
+            };
 
         auto runStart = std::chrono::steady_clock::now();
         auto lastPerfLog = runStart;
         std::chrono::steady_clock::duration processingTime{};
 
+        ZmqPacket packet;
+        bool flagsLogged = false;
+        packet.decodeFixed = (opts.arithmetic == Arithmetic::Fixed);
         while (gShouldStop == 0) {
-            ZmqPacket packet;
+            if (shardLink) {
+                std::vector<ShardAssignment> assignment;
+                if (shardLink->pollAssignment(assignment)) {
+                    applyShardAssignment(assignment);
+                }
+                const auto now = std::chrono::steady_clock::now();
+                if (now - lastShardReport >= kShardReportInterval) {
+                    const double intervalNs =
+                        std::chrono::duration<double, std::nano>(
+                            now - lastShardReport)
+                            .count();
+                    std::vector<std::pair<uint32_t, double>> loads;
+                    for (std::size_t index = 0; index < channels.size();
+                         ++index) {
+                        const uint64_t busyNs = channels[index]->busyNs.load();
+                        loads.emplace_back(
+                            shardIds[index],
+                            static_cast<double>(busyNs -
+                                                reportedBusyNs[index]) /
+                                intervalNs);
+                        reportedBusyNs[index] = busyNs;
+                    }
+                    shardLink->reportLoad(loads);
+                    lastShardReport = now;
+                }
+            }
+
             bool timedOut = false;
             if (!receiver.receive(packet, timedOut)) {
                 if (timedOut) {
@@ -676,32 +3606,91 @@ int main(int argc, char **argv) {
                 }
                 continue;
             }
+            applyPacketFlagPolicy(opts.packetFlags, packet, flagsLogged);
             ++zmqPacketsReceived;
             zmqBytesRead += static_cast<uint64_t>(kZmqHeaderSizeBytes +
                                                   packet.payloadBytes);
 
+            const ZmqLinkStats &link = receiver.linkStats();
+            if (link.stalls != reportedStalls) {
+                reportedStalls = link.stalls;
+                std::cerr << "airspyhf_decimator: zmq stall ended duration_ms="
+                          << (link.lastStallSeconds * 1e3) << " publisher="
+                          << (link.lastStallDisconnected ? "gone" : "slow")
+                          << " stalls=" << link.stalls << "\n";
+            }
+            const bool linkDropped =
+                link.disconnects != disconnectsAtLastPacket;
+            disconnectsAtLastPacket = link.disconnects;
+            const uint64_t previousSequence = sequence.previous();
+            const auto step = sequence.observe(packet.sequence, linkDropped);
+            // Whether the samples received still line up with the
+            // timestamps, for drift compensation.
+            bool timestampsContiguous =
+                step != SequenceTracker::Step::Gap &&
+                step != SequenceTracker::Step::Restart;
+            if (step == SequenceTracker::Step::Gap) {
+                std::cerr << "airspyhf_decimator: dropped " << sequence.lastGap()
+                          << " packet(s) before sequence=" << packet.sequence
+                          << " total_dropped=" << sequence.dropped() << "\n";
+            } else if (step == SequenceTracker::Step::Backward) {
+                std::cerr << "airspyhf_decimator: out-of-order/duplicate "
+                             "packet sequence="
+                          << packet.sequence << " previous=" << previousSequence
+                          << " count=" << sequence.outOfOrder() << "\n";
+            } else if (step == SequenceTracker::Step::Restart) {
+                // Start over as if this were the first packet: relock the
+                // rate and rebuild every pipeline so frame timestamps
+                // re-anchor, instead of reporting a huge drop.
+                std::cerr << "airspyhf_decimator: publisher restart detected "
+                             "sequence="
+                          << packet.sequence << " previous=" << previousSequence
+                          << " link_dropped=" << (linkDropped ? "true" : "false")
+                          << " restarts=" << sequence.restarts() << "\n";
+                if (scheduler) {
+                    scheduler->waitIdle();
+                    for (auto &channel : channels) {
+                        channel->strand->rethrowIfFailed();
+                    }
+                }
+                resumePending = false;
+                effectiveInputRate = 0.0;
+                spectrumMonitor.reset();
+                firstZmqTimestampUs = 0;
+                timestampRateBaseSamples = inputSamplesProcessed;
+            }
+
             if (firstZmqTimestampUs == 0) {
                 firstZmqTimestampUs = packet.timestampUs;
             }
             lastZmqTimestampUs = packet.timestampUs;
 
-            if (!haveSequence) {
-                haveSequence = true;
-            } else if (packet.sequence > (prevSequence + 1)) {
-                const uint64_t newlyDropped =
-                    packet.sequence - (prevSequence + 1);
-                droppedPackets += newlyDropped;
-                std::cerr << "airspyhf_decimator: dropped " << newlyDropped
-                          << " packet(s) before sequence=" << packet.sequence
-                          << " total_dropped=" << droppedPackets << "\n";
-            } else if (packet.sequence <= prevSequence) {
-                ++outOfOrderPackets;
-                std::cerr << "airspyhf_decimator: out-of-order/duplicate "
-                             "packet sequence="
-                          << packet.sequence << " previous=" << prevSequence
-                          << " count=" << outOfOrderPackets << "\n";
+            if (resumePending) {
+                resumePending = false;
+                timestampsContiguous = false;
+                const uint64_t gap = resumeGapOutputSamples(
+                    resumeLastTimestampUs, lastPacketSamples,
+                    effectiveInputRate, packet.timestampUs);
+                if (gap == 0) {
+                    std::cerr << "airspyhf_decimator: resumed contiguous "
+                                 "stream at sequence="
+                              << packet.sequence << "\n";
+                } else if (static_cast<double>(gap) <=
+                           kMaxResumeZeroFillSeconds * effectiveOutputRate) {
+                    channels.front()->pipeline->insertSilence(
+                        static_cast<std::size_t>(gap));
+                    std::cerr << "airspyhf_decimator: resumed after gap, "
+                                 "zero-filled output_samples="
+                              << gap << "\n";
+                } else {
+                    const uint64_t discarded =
+                        channels.front()->pipeline->skipGap(gap);
+                    std::cerr << "airspyhf_decimator: resumed after gap, "
+                                 "skipped output_samples="
+                              << gap << " discarded_buffer_samples="
+                              << discarded << "\n";
+                }
             }
-            prevSequence = packet.sequence;
 
             if (effectiveInputRate <= 0.0) {
                 effectiveInputRate =
@@ -729,12 +3718,13 @@ int main(int argc, char **argv) {
                         << " warnings=" << sampleRateFieldWarnings << "\n";
                 }
 
+                pipelineConfig.inputRate = effectiveInputRate;
+                for (std::size_t index = 0; index < channels.size(); ++index) {
+                    channels[index]->pipeline =
+                        std::make_unique<DecimationPipeline>(
+                            channelConfig(index));
+                }
                 effectiveOutputRate = effectiveInputRate / kTotalDecimation;
-                timestampEncoder =
-                    std::make_unique<TimestampEncoder>(effectiveOutputRate);
-                frequencyShifter = std::make_unique<FrequencyShifter>(
-                    effectiveInputRate, opts.shiftKhz * 1000.0);
-
                 std::cerr << "airspyhf_decimator: locked input rate="
                           << effectiveInputRate
                           << " outputRate=" << effectiveOutputRate << " source="
@@ -765,44 +3755,158 @@ int main(int argc, char **argv) {
                 }
             }
 
-            auto stageInput = std::move(packet.samples);
-            inputSamplesProcessed += stageInput.size();
+            const std::size_t packetSampleCount =
+                packet.decodeFixed ? packet.fixedSamples.size()
+                                   : packet.samples.size();
+            inputSamplesProcessed += packetSampleCount;
 
-            if (!frequencyShifter || !timestampEncoder) {
+            if (channels.empty()) {
+                // A shard worker with nothing assigned keeps the stream
+                // accounting only.
+                continue;
+            }
+            if (!channels.front()->pipeline) {
                 std::cerr << "airspyhf_decimator: internal initialization "
                              "incomplete, skipping packet sequence="
                           << packet.sequence << "\n";
                 continue;
             }
 
-            auto processStart = std::chrono::steady_clock::now();
-            frequencyShifter->mix(stageInput);
-            auto afterStage1 = stage1.process(stageInput);
-            auto afterStage2 = stage2.process(afterStage1);
-            auto decimated = stage3.process(afterStage2);
-            processingTime += (std::chrono::steady_clock::now() - processStart);
-            outputSamplesProduced += decimated.size();
+            if ((packet.flags & kZmqFlagRetune) != 0U) {
+                // Rare: drain the workers and restart every channel here.
+                if (scheduler) {
+                    scheduler->waitIdle();
+                    for (auto &channel : channels) {
+                        channel->strand->rethrowIfFailed();
+                    }
+                }
+                uint64_t droppedPartial = 0;
+                for (auto &channel : channels) {
+                    droppedPartial +=
+                        restartOnRetune(*channel->pipeline, packet.flags);
+                }
+                spectrumMonitor.reset();
+                ++retunes;
+                std::cerr << "airspyhf_decimator: retune flagged sequence="
+                          << packet.sequence
+                          << " dropped_partial_frame_samples=" << droppedPartial
+                          << " retunes=" << retunes << "\n";
+            }
 
-            if (!decimated.empty()) {
-                buffer.insert(buffer.end(), decimated.begin(), decimated.end());
+            // After the retune reset, so a retune packet opens the new
+            // averages instead of closing the old ones.
+            if (opts.spectrumPort != 0 && !spectrumMonitor) {
+                const double spectrumRate =
+                    (opts.spectrumSource == SpectrumSource::Stage1)
+                        ? effectiveInputRate / 8.0
+                        : effectiveOutputRate;
+                spectrumMonitor = std::make_unique<SpectrumMonitor>(
+                    opts.ip, opts.spectrumPort, opts.spectrumFftSize,
+                    opts.spectrumAverages, spectrumRate,
+                    opts.channels.front().shiftKhz * 1000.0,
+                    std::chrono::milliseconds(static_cast<int64_t>(
+                        opts.spectrumIntervalMs)));
+                std::cerr << "airspyhf_decimator: spectrum monitor port="
+                          << opts.spectrumPort
+                          << " fft=" << opts.spectrumFftSize
+                          << " avg=" << opts.spectrumAverages
+                          << " source="
+                          << ((opts.spectrumSource ==
+                               SpectrumSource::Stage1)
+                                  ? "stage1"
+                                  : "stage3")
+                          << " rate=" << spectrumRate << "\n";
             }
 
-            while (buffer.size() >= payloadSamples) {
-                std::vector<std::complex<float>> frame;
-                frame.reserve(opts.packetSamples);
-                frame.push_back(timestampEncoder->headerForSample(samplesSent));
-                frame.insert(frame.end(), buffer.begin(),
-                             buffer.begin() + payloadSamples);
-                streamer.send(frame);
-                ++framesSent;
-                buffer.erase(buffer.begin(), buffer.begin() + payloadSamples);
-                samplesSent += payloadSamples;
+            const bool overflowed = (packet.flags & kZmqFlagOverflow) != 0U;
+            if (overflowed) {
+                ++overflowPackets;
+                if (overflowPackets == 1 || (overflowPackets % 100) == 0) {
+                    std::cerr << "airspyhf_decimator: overflow flagged "
+                                 "sequence="
+                              << packet.sequence
+                              << " blanked_samples=" << packetSampleCount
+                              << " overflow_packets=" << overflowPackets
+                              << "\n";
+                }
+            }
+
+            auto processStart = std::chrono::steady_clock::now();
+            const uint64_t timestampUs = packet.timestampUs;
+            if (overflowed) {
+                const uint32_t flags = packet.flags;
+                for (auto &channel : channels) {
+                    if (scheduler) {
+                        channel->strand->post([&channel = *channel, flags,
+                                               packetSampleCount, timestampUs,
+                                               timestampsContiguous] {
+                            observeReferenceTime(channel, timestampUs,
+                                                 timestampsContiguous);
+                            runChannelBlank(channel, flags, packetSampleCount);
+                        });
+                    } else {
+                        observeReferenceTime(*channel, timestampUs,
+                                             timestampsContiguous);
+                        runChannelBlank(*channel, flags, packetSampleCount);
+                    }
+                }
+            } else if (scheduler) {
+                auto block = std::make_shared<InputBlock>();
+                block->fixed = packet.decodeFixed;
+                if (block->fixed) {
+                    block->fixedSamples = packet.fixedSamples;
+                } else {
+                    block->samples = packet.samples;
+                }
+                for (std::size_t index = 0; index < channels.size(); ++index) {
+                    Channel &channel = *channels[index];
+                    SpectrumMonitor *tap =
+                        (index == 0) ? spectrumMonitor.get() : nullptr;
+                    channel.strand->post([&channel, block, tap,
+                                          source = opts.spectrumSource,
+                                          timestampUs, timestampsContiguous] {
+                        observeReferenceTime(channel, timestampUs,
+                                             timestampsContiguous);
+                        runChannelCopy(channel, block->fixed, block->samples,
+                                       block->fixedSamples, tap, source);
+                    });
+                }
+            } else {
+                // The last channel consumes the packet's own buffer.
+                for (std::size_t index = 0; index < channels.size(); ++index) {
+                    Channel &channel = *channels[index];
+                    SpectrumMonitor *tap =
+                        (index == 0) ? spectrumMonitor.get() : nullptr;
+                    observeReferenceTime(channel, timestampUs,
+                                         timestampsContiguous);
+                    if (index + 1 < channels.size()) {
+                        runChannelCopy(channel, packet.decodeFixed,
+                                       packet.samples, packet.fixedSamples, tap,
+                                       opts.spectrumSource);
+                    } else if (packet.decodeFixed) {
+                        runChannelBlock(channel, packet.fixedSamples, tap,
+                                        opts.spectrumSource);
+                    } else {
+                        runChannelBlock(channel, packet.samples, tap,
+                                        opts.spectrumSource);
+                    }
+                }
             }
+            processingTime += (std::chrono::steady_clock::now() - processStart);
+            lastPacketSamples = packetSampleCount;
 
             auto now = std::chrono::steady_clock::now();
             if (now - lastPerfLog >= std::chrono::seconds(1)) {
                 const double elapsedSec =
                     std::chrono::duration<double>(now - runStart).count();
+                uint64_t outputSamplesProduced = 0;
+                uint64_t framesSent = 0;
+                uint64_t bufferedSamples = 0;
+                for (const auto &channel : channels) {
+                    outputSamplesProduced += channel->outputSamples.load();
+                    framesSent += channel->framesSent.load();
+                    bufferedSamples += channel->bufferedSamples.load();
+                }
                 const double processingSec =
                     std::chrono::duration<double>(processingTime).count();
                 const double inputRate =
@@ -863,38 +3967,141 @@ int main(int argc, char **argv) {
                           << " out_sps=" << outputRateMeasured
                           << " frames_per_s=" << frameRate
                           << " cpu_duty_pct=" << processingDuty
-                          << " buffer_samples=" << buffer.size()
+                          << " buffer_samples=" << bufferedSamples
                           << " zmq_packets=" << zmqPacketsReceived
                           << " malformed=" << receiver.malformedPackets()
-                          << " dropped=" << droppedPackets
-                          << " out_of_order=" << outOfOrderPackets << "\n";
+                          << " dropped=" << sequence.dropped()
+                          << " out_of_order=" << sequence.outOfOrder()
+                          << " arena_high_water_bytes="
+                          << receiver.arenaHighWaterBytes()
+                          << " arena_chunk_allocs="
+                          << receiver.arenaChunkAllocations()
+                          << " zmq_connected="
+                          << (link.connected ? "true" : "false")
+                          << " zmq_disconnects=" << link.disconnects
+                          << " zmq_retries=" << link.connectRetries
+                          << " zmq_stalls=" << link.stalls
+                          << " zmq_stall_max_ms=" << (link.stallSecondsMax * 1e3)
+                          << " publisher_restarts=" << sequence.restarts()
+                          << " overflow_packets=" << overflowPackets
+                          << " retunes=" << retunes << "\n";
+
+                if (perfCounters && inputSamplesProcessed > 0) {
+                    const uint64_t dtlbMisses = perfCounters->dtlbLoadMisses();
+                    std::cerr << "airspyhf_decimator: perf_counters "
+                                 "dtlb_load_misses="
+                              << dtlbMisses << " dtlb_misses_per_sample="
+                              << (static_cast<double>(dtlbMisses) /
+                                  static_cast<double>(inputSamplesProcessed))
+                              << "\n";
+                }
+
+                if (scheduler) {
+                    const auto workerStats = scheduler->stats();
+                    const double intervalNs =
+                        std::chrono::duration<double, std::nano>(now -
+                                                                 lastPerfLog)
+                            .count();
+                    std::cerr << "airspyhf_decimator: scheduler workers="
+                              << workerStats.size();
+                    for (std::size_t index = 0; index < workerStats.size();
+                         ++index) {
+                        const auto busyNs = static_cast<double>(
+                            (workerStats[index].busy -
+                             lastWorkerStats[index].busy)
+                                .count());
+                        std::cerr << " w" << index << "_util_pct="
+                                  << ((intervalNs > 0.0)
+                                          ? 100.0 * busyNs / intervalNs
+                                          : 0.0)
+                                  << " w" << index
+                                  << "_tasks=" << workerStats[index].tasks
+                                  << " w" << index
+                                  << "_steals=" << workerStats[index].steals;
+                    }
+                    std::cerr << "\n";
+                    lastWorkerStats = workerStats;
+                }
 
-                if (haveSequence && lastZmqTimestampUs > firstZmqTimestampUs) {
+                logUdpDestinations(channels, true);
+
+                if (sequence.haveSequence() &&
+                    lastZmqTimestampUs > firstZmqTimestampUs) {
                     const double streamDurationSec =
                         static_cast<double>(lastZmqTimestampUs -
                                             firstZmqTimestampUs) /
                         1'000'000.0;
                     const double timestampRate =
                         (streamDurationSec > 0.0)
-                            ? (static_cast<double>(inputSamplesProcessed) /
+                            ? (static_cast<double>(inputSamplesProcessed -
+                                                   timestampRateBaseSamples) /
                                streamDurationSec)
                             : 0.0;
                     std::cerr << "airspyhf_decimator: zmq_timestamp_rate_sps="
                               << timestampRate
                               << " first_ts_us=" << firstZmqTimestampUs
-                              << " last_ts_us=" << lastZmqTimestampUs << "\n";
+                              << " last_ts_us=" << lastZmqTimestampUs;
+                    if (opts.driftCompensation) {
+                        const Channel &first = *channels.front();
+                        std::cerr << " drift_ppm=" << first.driftPpm.load()
+                                  << " drift_time_error_us="
+                                  << first.driftTimeErrorUs.load();
+                    }
+                    std::cerr << "\n";
                 }
                 lastPerfLog = now;
             }
         }
 
+        if (scheduler) {
+            scheduler->waitIdle();
+            for (auto &channel : channels) {
+                channel->strand->rethrowIfFailed();
+            }
+        }
+
+        if (!opts.stateFile.empty() && channels.front()->pipeline) {
+            const auto &pipeline = channels.front()->pipeline;
+            PipelineCheckpoint checkpoint;
+            checkpoint.inputRate = effectiveInputRate;
+            checkpoint.prevSequence = sequence.previous();
+            checkpoint.haveSequence = sequence.haveSequence();
+            checkpoint.lastZmqTimestampUs = lastZmqTimestampUs;
+            checkpoint.lastPacketSamples = lastPacketSamples;
+            try {
+                saveCheckpoint(opts.stateFile, checkpoint, *pipeline);
+                std::cerr << "airspyhf_decimator: saved state file="
+                          << opts.stateFile
+                          << " samplesSent=" << pipeline->samplesSent()
+                          << " buffer_samples=" << pipeline->bufferedSamples()
+                          << "\n";
+            } catch (const std::exception &err) {
+                std::cerr << "airspyhf_decimator: failed to save state: "
+                          << err.what() << "\n";
+            }
+        }
+
+        logUdpDestinations(channels, false);
         std::cerr << "airspyhf_decimator: stopping packets="
                   << zmqPacketsReceived
                   << " malformed=" << receiver.malformedPackets()
-                  << " dropped=" << droppedPackets
-                  << " out_of_order=" << outOfOrderPackets
+                  << " dropped=" << sequence.dropped()
+                  << " out_of_order=" << sequence.outOfOrder()
+                  << " publisher_restarts=" << sequence.restarts()
+                  << " overflow_packets=" << overflowPackets
+                  << " retunes=" << retunes
+                  << " zmq_disconnects=" << receiver.linkStats().disconnects
+                  << " zmq_stalls=" << receiver.linkStats().stalls
+                  << " zmq_stall_total_s="
+                  << receiver.linkStats().stallSecondsTotal
                   << " sample_rate_field_warnings=" << sampleRateFieldWarnings
-                  << " measured_rate_warnings=" << measuredRateWarnings << "\n";
+                  << " measured_rate_warnings=" << measuredRateWarnings;
+        if (spectrumMonitor) {
+            std::cerr << " spectra_sent=" << spectrumMonitor->spectraSent()
+                      << " spectrum_dropped_blocks="
+                      << spectrumMonitor->droppedBlocks();
+        }
+        std::cerr << "\n";
     } catch (const ArgsError &err) {
         std::cerr << "Argument error: " << err.what() << "\n";
         printUsage(argv[0]);
@@ -0,0 +1,246 @@
+// NUMA topology discovery and thread placement, read from sysfs without
+// libnuma. A thread inherits its creator's CPU affinity and memory policy,
+// so placing the main thread before it starts the receiver, workers and
+// buffers keeps all of them on one node.
+#pragma once
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace airspyhf_dsp {
+
+constexpr const char *kSysfsNodeRoot = "/sys/devices/system/node";
+constexpr const char *kSysfsNetRoot = "/sys/class/net";
+
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+    uint64_t memoryKb = 0;
+};
+
+// Parses a sysfs cpulist such as "0-3,8,10-11".
+inline std::vector<int> parseCpuList(const std::string &text) {
+    std::vector<int> cpus;
+    std::stringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        range.erase(std::remove(range.begin(), range.end(), '\n'),
+                    range.end());
+        range.erase(std::remove(range.begin(), range.end(), ' '), range.end());
+        if (range.empty()) {
+            continue;
+        }
+        const std::size_t dash = range.find('-');
+        try {
+            std::size_t used = 0;
+            const int first = std::stoi(range.substr(0, dash), &used);
+            int last = first;
+            if (dash != std::string::npos) {
+                std::size_t lastUsed = 0;
+                last = std::stoi(range.substr(dash + 1), &lastUsed);
+                used = dash + 1 + lastUsed;
+            }
+            if (used != range.size() || first < 0 || last < first) {
+                throw std::invalid_argument(range);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::logic_error &) {
+            throw std::runtime_error("Malformed CPU list: " + text);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+// The inverse of parseCpuList, with consecutive CPUs folded into ranges.
+inline std::string formatCpuList(const std::vector<int> &cpus) {
+    std::string text;
+    for (std::size_t index = 0; index < cpus.size();) {
+        std::size_t end = index;
+        while (end + 1 < cpus.size() && cpus[end + 1] == cpus[end] + 1) {
+            ++end;
+        }
+        if (!text.empty()) {
+            text += ',';
+        }
+        text += std::to_string(cpus[index]);
+        if (end > index) {
+            text += '-' + std::to_string(cpus[end]);
+        }
+        index = end + 1;
+    }
+    return text;
+}
+
+// CPUs the calling thread may run on.
+inline std::vector<int> allowedCpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cpus;
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+class NumaTopology {
+  public:
+    // Reads root/node<N>/cpulist and meminfo. Without that tree (a kernel
+    // built without NUMA) the host is one node holding the allowed CPUs.
+    static NumaTopology discover(const std::string &root = kSysfsNodeRoot) {
+        NumaTopology topology;
+        std::error_code error;
+        for (const auto &entry :
+             std::filesystem::directory_iterator(root, error)) {
+            const std::string name = entry.path().filename().string();
+            if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+            NumaNode node;
+            node.id = std::stoi(name.substr(4));
+            std::ifstream cpulist(entry.path() / "cpulist");
+            std::string text;
+            std::getline(cpulist, text);
+            node.cpus = parseCpuList(text);
+            node.memoryKb = readMemTotalKb(entry.path() / "meminfo");
+            topology.nodes_.push_back(std::move(node));
+        }
+        if (topology.nodes_.empty()) {
+            NumaNode node;
+            node.cpus = allowedCpus();
+            topology.nodes_.push_back(std::move(node));
+        }
+        std::sort(topology.nodes_.begin(), topology.nodes_.end(),
+                  [](const NumaNode &left, const NumaNode &right) {
+                      return left.id < right.id;
+                  });
+        return topology;
+    }
+
+    const std::vector<NumaNode> &nodes() const { return nodes_; }
+
+    const NumaNode *node(int id) const {
+        for (const auto &node : nodes_) {
+            if (node.id == id) {
+                return &node;
+            }
+        }
+        return nullptr;
+    }
+
+    // -1 when no node lists the CPU.
+    int nodeOfCpu(int cpu) const {
+        for (const auto &node : nodes_) {
+            if (std::binary_search(node.cpus.begin(), node.cpus.end(), cpu)) {
+                return node.id;
+            }
+        }
+        return -1;
+    }
+
+    // "0:0-7/1:8-15", for the startup log.
+    std::string summary() const {
+        std::string text;
+        for (const auto &node : nodes_) {
+            if (!text.empty()) {
+                text += '/';
+            }
+            text += std::to_string(node.id) + ':' + formatCpuList(node.cpus);
+        }
+        return text;
+    }
+
+  private:
+    static uint64_t readMemTotalKb(const std::filesystem::path &path) {
+        // "Node 0 MemTotal:       16318068 kB"
+        std::ifstream meminfo(path);
+        std::string line;
+        while (std::getline(meminfo, line)) {
+            const std::size_t key = line.find("MemTotal:");
+            if (key != std::string::npos) {
+                return std::strtoull(line.c_str() + key + 9, nullptr, 10);
+            }
+        }
+        return 0;
+    }
+
+    std::vector<NumaNode> nodes_;
+};
+
+// The node a network interface's device is attached to; -1 for virtual
+// interfaces (loopback, bridges) and hosts that do not report one.
+inline int interfaceNumaNode(const std::string &interfaceName,
+                             const std::string &root = kSysfsNetRoot) {
+    if (interfaceName.empty()) {
+        return -1;
+    }
+    std::ifstream file(root + "/" + interfaceName + "/device/numa_node");
+    int node = -1;
+    if (!(file >> node)) {
+        return -1;
+    }
+    return node;
+}
+
+// Pins the calling thread to the node's CPUs that its current affinity
+// allows and makes the node its preferred memory node, so later threads
+// and first-touched pages follow. Returns the CPUs used; memoryPolicySet
+// is false where set_mempolicy is unavailable (pages then follow first
+// touch from the pinned threads).
+inline std::vector<int> bindCurrentThreadToNode(const NumaNode &node,
+                                                bool &memoryPolicySet) {
+    const std::vector<int> allowed = allowedCpus();
+    std::vector<int> cpus;
+    std::set_intersection(node.cpus.begin(), node.cpus.end(), allowed.begin(),
+                          allowed.end(), std::back_inserter(cpus));
+    if (cpus.empty()) {
+        throw std::runtime_error("No allowed CPUs on NUMA node " +
+                                 std::to_string(node.id));
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    if (::sched_setaffinity(0, sizeof(set), &set) != 0) {
+        throw std::runtime_error("sched_setaffinity failed for NUMA node " +
+                                 std::to_string(node.id));
+    }
+
+    constexpr std::size_t kMaskBits = 1024;
+    unsigned long mask[kMaskBits / (8 * sizeof(unsigned long))] = {};
+    memoryPolicySet = false;
+    if (node.id >= 0 && static_cast<std::size_t>(node.id) < kMaskBits) {
+        const std::size_t bitsPerWord = 8 * sizeof(unsigned long);
+        mask[static_cast<std::size_t>(node.id) / bitsPerWord] |=
+            1UL << (static_cast<std::size_t>(node.id) % bitsPerWord);
+        memoryPolicySet = ::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask,
+                                    kMaskBits + 1) == 0;
+    }
+    return cpus;
+}
+
+} // namespace airspyhf_dsp
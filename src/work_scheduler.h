@@ -0,0 +1,382 @@
+// Thread pools for the decimator: a work-stealing scheduler that spreads
+// many channel pipelines over a fixed set of workers, and a fork-join team
+// that splits one stream's stage-1 FIR across cores.
+#pragma once
+
+#include "denormals.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace airspyhf_dsp {
+
+// Each worker owns a deque: it pushes and pops its own tasks at the back
+// and, when that runs dry, steals the oldest task from the front of another
+// worker's deque. Tasks submitted from outside the pool are dealt
+// round-robin. Tasks must not throw; use TaskStrand for fallible work.
+// Workers take the constructing thread's flush-to-zero mode.
+class WorkStealingScheduler {
+  public:
+    using Task = std::function<void()>;
+
+    struct WorkerStats {
+        uint64_t tasks = 0;
+        uint64_t steals = 0;
+        std::chrono::nanoseconds busy{0};
+    };
+
+    WorkStealingScheduler(const WorkStealingScheduler &) = delete;
+    WorkStealingScheduler &operator=(const WorkStealingScheduler &) = delete;
+
+    explicit WorkStealingScheduler(std::size_t workers) {
+        if (workers == 0) {
+            throw std::runtime_error("Scheduler needs at least one worker");
+        }
+        workers_.reserve(workers);
+        for (std::size_t index = 0; index < workers; ++index) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (std::size_t index = 0; index < workers; ++index) {
+            workers_[index]->thread = std::thread([this, index] { run(index); });
+        }
+    }
+
+    // Runs every task already submitted, then joins the workers.
+    ~WorkStealingScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto &worker : workers_) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    std::size_t workerCount() const { return workers_.size(); }
+
+    void submit(Task task) {
+        const std::size_t target =
+            (currentScheduler() == this)
+                ? currentWorker()
+                : nextWorker_.fetch_add(1, std::memory_order_relaxed) %
+                      workers_.size();
+        unfinished_.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+            workers_[target]->tasks.push_back(std::move(task));
+        }
+        queued_.fetch_add(1);
+        {
+            // Pairs with the predicate check in run() so a worker that is
+            // about to sleep cannot miss this task.
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+        }
+        wake_.notify_one();
+    }
+
+    // Blocks until every submitted task, including tasks those tasks
+    // submitted, has finished.
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        idle_.wait(lock, [this] { return unfinished_.load() == 0; });
+    }
+
+    std::vector<WorkerStats> stats() const {
+        std::vector<WorkerStats> result(workers_.size());
+        for (std::size_t index = 0; index < workers_.size(); ++index) {
+            result[index].tasks = workers_[index]->tasksRun.load();
+            result[index].steals = workers_[index]->steals.load();
+            result[index].busy =
+                std::chrono::nanoseconds(workers_[index]->busyNs.load());
+        }
+        return result;
+    }
+
+  private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<uint64_t> tasksRun{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<int64_t> busyNs{0};
+        std::thread thread;
+    };
+
+    static const WorkStealingScheduler *&currentScheduler() {
+        thread_local const WorkStealingScheduler *scheduler = nullptr;
+        return scheduler;
+    }
+
+    static std::size_t &currentWorker() {
+        thread_local std::size_t worker = 0;
+        return worker;
+    }
+
+    bool takeTask(std::size_t self, Task &task) {
+        {
+            Worker &own = *workers_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued_.fetch_sub(1);
+                return true;
+            }
+        }
+        for (std::size_t offset = 1; offset < workers_.size(); ++offset) {
+            Worker &victim = *workers_[(self + offset) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued_.fetch_sub(1);
+                workers_[self]->steals.fetch_add(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(std::size_t self) {
+        currentScheduler() = this;
+        currentWorker() = self;
+        setFlushDenormals(flushDenormals_);
+        Worker &worker = *workers_[self];
+        for (;;) {
+            Task task;
+            if (!takeTask(self, task)) {
+                std::unique_lock<std::mutex> lock(sleepMutex_);
+                wake_.wait(lock, [this] {
+                    return stopping_ || queued_.load() > 0;
+                });
+                if (stopping_ && queued_.load() == 0) {
+                    return;
+                }
+                continue;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            task();
+            worker.busyNs.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count());
+            worker.tasksRun.fetch_add(1);
+            if (unfinished_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+                idle_.notify_all();
+            }
+        }
+    }
+
+    const bool flushDenormals_ = flushDenormalsEnabled();
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<std::size_t> nextWorker_{0};
+    std::atomic<std::size_t> queued_{0};
+    std::atomic<std::size_t> unfinished_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    bool stopping_ = false;
+};
+
+// Runs posted jobs one at a time, in posting order, on a scheduler. At most
+// one task per strand is queued or running, so a channel's blocks can be
+// stolen between workers but never overlap or reorder. The first exception
+// a job throws is kept and rethrown to the posting thread.
+class TaskStrand {
+  public:
+    TaskStrand(const TaskStrand &) = delete;
+    TaskStrand &operator=(const TaskStrand &) = delete;
+
+    TaskStrand(WorkStealingScheduler &scheduler, std::size_t maxQueued)
+        : scheduler_(scheduler), maxQueued_(maxQueued == 0 ? 1 : maxQueued) {}
+
+    // Blocks while maxQueued jobs are already waiting, so a slow channel
+    // pushes back on the receive loop instead of growing without bound.
+    void post(std::function<void()> job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_.wait(lock, [this] { return jobs_.size() < maxQueued_; });
+        rethrowLocked();
+        jobs_.push_back(std::move(job));
+        if (!scheduled_) {
+            scheduled_ = true;
+            lock.unlock();
+            scheduler_.submit([this] { runOne(); });
+        }
+    }
+
+    void rethrowIfFailed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rethrowLocked();
+    }
+
+  private:
+    void rethrowLocked() {
+        if (error_) {
+            auto error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    void runOne() {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        space_.notify_one();
+        try {
+            job();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (jobs_.empty()) {
+            scheduled_ = false;
+        } else {
+            scheduler_.submit([this] { runOne(); });
+        }
+    }
+
+    WorkStealingScheduler &scheduler_;
+    const std::size_t maxQueued_;
+    std::mutex mutex_;
+    std::condition_variable space_;
+    std::deque<std::function<void()>> jobs_;
+    std::exception_ptr error_;
+    bool scheduled_ = false;
+};
+
+// Fixed team of threads for fork-join loops. run(parts, fn) calls fn(part)
+// once for every part in [0, parts), with the calling thread working
+// alongside the helpers, and returns when every part has finished. Helpers
+// run each loop in the caller's flush-to-zero mode, so a split loop rounds
+// exactly like the same loop run on the caller alone.
+class ForkJoinPool {
+  public:
+    ForkJoinPool(const ForkJoinPool &) = delete;
+    ForkJoinPool &operator=(const ForkJoinPool &) = delete;
+
+    // threads counts the caller, so ForkJoinPool(1) runs everything inline.
+    explicit ForkJoinPool(std::size_t threads) {
+        for (std::size_t index = 1; index < threads; ++index) {
+            helpers_.emplace_back([this] { helperLoop(); });
+        }
+    }
+
+    ~ForkJoinPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        start_.notify_all();
+        for (auto &helper : helpers_) {
+            helper.join();
+        }
+    }
+
+    std::size_t threads() const { return helpers_.size() + 1; }
+
+    void run(std::size_t parts, const std::function<void(std::size_t)> &fn) {
+        if (parts <= 1 || helpers_.empty()) {
+            for (std::size_t part = 0; part < parts; ++part) {
+                fn(part);
+            }
+            return;
+        }
+        uint64_t generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &fn;
+            flushDenormals_ = flushDenormalsEnabled();
+            parts_ = parts;
+            next_ = 0;
+            remaining_ = parts;
+            generation = ++generation_;
+        }
+        start_.notify_all();
+        work(generation);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return remaining_ == 0; });
+        job_ = nullptr;
+    }
+
+  private:
+    // Parts are claimed under the lock and tagged with the generation, so a
+    // helper that wakes late can never run a part of a finished loop.
+    void work(uint64_t generation) {
+        for (;;) {
+            const std::function<void(std::size_t)> *job = nullptr;
+            std::size_t part = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (generation != generation_ || next_ >= parts_) {
+                    return;
+                }
+                job = job_;
+                part = next_++;
+            }
+            (*job)(part);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--remaining_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+
+    void helperLoop() {
+        uint64_t seen = 0;
+        bool flush = flushDenormalsEnabled();
+        for (;;) {
+            bool wantFlush = false;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_.wait(lock, [&] {
+                    return stopping_ || generation_ != seen;
+                });
+                if (stopping_) {
+                    return;
+                }
+                seen = generation_;
+                wantFlush = flushDenormals_;
+            }
+            if (wantFlush != flush) {
+                setFlushDenormals(wantFlush);
+                flush = wantFlush;
+            }
+            work(seen);
+        }
+    }
+
+    std::vector<std::thread> helpers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const std::function<void(std::size_t)> *job_ = nullptr;
+    std::size_t parts_ = 0;
+    std::size_t next_ = 0;
+    std::size_t remaining_ = 0;
+    uint64_t generation_ = 0;
+    bool flushDenormals_ = false;
+    bool stopping_ = false;
+};
+
+} // namespace airspyhf_dsp
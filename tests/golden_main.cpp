@@ -0,0 +1,625 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#define main airspyhf_decimator_program_main
+#include "../src/main.cpp"
+#undef main
+
+// Golden-output regression corpus: replays short ZeroMQ captures through
+// the receive parse and a full DecimationPipeline, and compares every UDP
+// frame with a reference produced by an earlier build. Synthetic captures
+// are generated here from fixed seeds; recorded captures are <name>.zcap
+// files in the corpus directory. Each case's reference is <name>.golden.
+// Reports frame-count and timestamp equality, max error and SNR versus the
+// reference, so numeric drift shows up before it shows up in detections.
+
+namespace {
+
+constexpr char kCaptureMagic[8] = {'A', 'H', 'F', 'Z', 'C', 'A', 'P', '1'};
+constexpr char kGoldenMagic[8] = {'A', 'H', 'F', 'G', 'O', 'L', 'D', '1'};
+constexpr uint32_t kGoldenSampleRate = 768000;
+constexpr uint64_t kGoldenStartUs = 1'700'000'000'000'000ULL;
+constexpr std::size_t kGoldenFrameSamples = 257;
+
+using Capture = std::vector<std::vector<uint8_t>>;
+
+// What a reference was produced with; replay uses the same settings.
+struct GoldenSettings {
+    double inputRate = kGoldenSampleRate;
+    double shiftHz = 0.0;
+    std::size_t frameSamples = kGoldenFrameSamples;
+    Arithmetic arithmetic = Arithmetic::Float;
+};
+
+struct GoldenReference {
+    GoldenSettings settings;
+    std::vector<SampleVector> frames;
+};
+
+struct GoldenCase {
+    std::string name;
+    GoldenSettings settings;
+    Capture capture;
+};
+
+struct GoldenConfig {
+    std::string corpusDir = "tests/golden";
+    bool regenerate = false;
+    double minSnrDb = 100.0;
+    std::string recordEndpoint;
+    std::string recordName;
+    std::size_t recordPackets = 32;
+    double recordShiftHz = 0.0;
+    Arithmetic recordArithmetic = Arithmetic::Float;
+};
+
+[[noreturn]] void usage(const char *argv0, int status) {
+    std::cout
+        << "Usage: " << argv0 << " [options]\n"
+        << "  --corpus <dir>         Captures and references (default "
+           "tests/golden)\n"
+        << "  --min-snr-db <dB>      Lowest accepted SNR versus the reference "
+           "(default 100)\n"
+        << "  --regenerate           Rewrite every reference from this build\n"
+        << "  --record <endpoint>    Record a capture from a publisher, write "
+           "its reference and exit\n"
+        << "  --name <name>          Case name for --record\n"
+        << "  --packets <N>          Packets to record (default 32)\n"
+        << "  --shift <Hz>           Shift for the recorded case (default 0)\n"
+        << "  --fixed-point          Replay the recorded case with the Q15 "
+           "chain\n";
+    std::exit(status);
+}
+
+GoldenConfig parseGoldenArgs(int argc, char **argv) {
+    GoldenConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--help") {
+            usage(argv[0], 0);
+        }
+        if (arg == "--regenerate") {
+            config.regenerate = true;
+            continue;
+        }
+        if (arg == "--fixed-point") {
+            config.recordArithmetic = Arithmetic::Fixed;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0], 64);
+        }
+        const char *value = argv[++i];
+        if (arg == "--corpus") {
+            config.corpusDir = value;
+        } else if (arg == "--min-snr-db") {
+            config.minSnrDb = std::stod(value);
+        } else if (arg == "--record") {
+            config.recordEndpoint = value;
+        } else if (arg == "--name") {
+            config.recordName = value;
+        } else if (arg == "--packets") {
+            config.recordPackets = std::stoul(value);
+        } else if (arg == "--shift") {
+            config.recordShiftHz = std::stod(value);
+        } else {
+            usage(argv[0], 64);
+        }
+    }
+    if (!config.recordEndpoint.empty() &&
+        (config.recordName.empty() || config.recordPackets == 0)) {
+        usage(argv[0], 64);
+    }
+    return config;
+}
+
+// splitmix64 with a Box-Muller transform: unlike std::normal_distribution
+// the sequence is the same with every standard library.
+class GoldenNoise {
+  public:
+    explicit GoldenNoise(uint64_t seed) : state_(seed) {}
+
+    double uniform() {
+        state_ += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = state_;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        return (static_cast<double>(z >> 11) + 0.5) * 0x1.0p-53;
+    }
+
+    std::complex<double> gaussian(double sigma) {
+        const double radius = sigma * std::sqrt(-2.0 * std::log(uniform()));
+        const double angle = kTwoPi * uniform();
+        return {radius * std::cos(angle), radius * std::sin(angle)};
+    }
+
+  private:
+    uint64_t state_;
+};
+
+// Builds one synthetic capture. signal(n) returns input sample n; flags
+// returns the header flags of packet p.
+template <typename Signal, typename Flags>
+Capture synthesizeCapture(const std::vector<std::size_t> &packetSizes,
+                          Signal signal, Flags flags) {
+    Capture capture;
+    uint64_t sampleIndex = 0;
+    for (std::size_t packet = 0; packet < packetSizes.size(); ++packet) {
+        const std::size_t samples = packetSizes[packet];
+        std::vector<uint8_t> frame(kZmqHeaderSizeBytes + samples * kBytesPerIQ);
+        for (std::size_t index = 0; index < samples; ++index) {
+            const std::complex<double> value = signal(sampleIndex + index);
+            const float iq[2] = {static_cast<float>(value.real()),
+                                 static_cast<float>(value.imag())};
+            std::memcpy(frame.data() + kZmqHeaderSizeBytes +
+                            index * kBytesPerIQ,
+                        iq, sizeof(iq));
+        }
+        ttwf_zmq_iq_packet_header_t header{};
+        header.magic = kZmqMagic;
+        header.version = kZmqVersion;
+        header.header_size = kZmqHeaderSizeBytes;
+        header.sequence = packet;
+        header.timestamp_us = kGoldenStartUs + sampleIndex * 1'000'000ULL /
+                                                   kGoldenSampleRate;
+        header.sample_rate = kGoldenSampleRate;
+        header.sample_count = static_cast<uint32_t>(samples);
+        header.payload_bytes = static_cast<uint32_t>(samples * kBytesPerIQ);
+        header.flags = flags(packet);
+        if (ttwf_encode_zmq_iq_header(frame.data(), frame.size(), &header) !=
+            TTWF_ZMQ_OK) {
+            throw std::runtime_error("Failed to encode golden packet header");
+        }
+        capture.push_back(std::move(frame));
+        sampleIndex += samples;
+    }
+    return capture;
+}
+
+std::complex<double> tone(double hz, uint64_t sampleIndex, double amplitude) {
+    const double phase = kTwoPi * hz * static_cast<double>(sampleIndex) /
+                         static_cast<double>(kGoldenSampleRate);
+    return std::polar(amplitude, phase);
+}
+
+std::vector<GoldenCase> syntheticCases() {
+    const std::vector<std::size_t> uniform(32, 16384);
+    std::vector<std::size_t> ragged;
+    for (std::size_t packet = 0; packet < 32; ++packet) {
+        ragged.push_back(16000 + (packet % 3) * 1111);
+    }
+    const auto noFlags = [](std::size_t) { return uint32_t{0}; };
+    std::vector<GoldenCase> cases;
+
+    GoldenSettings settings;
+    settings.shiftHz = 12000.0;
+    {
+        GoldenNoise noise(1);
+        cases.push_back(
+            {"tone_noise", settings,
+             synthesizeCapture(
+                 uniform,
+                 [&noise](uint64_t n) {
+                     return tone(12500.0, n, 0.5) + noise.gaussian(0.05);
+                 },
+                 noFlags)});
+    }
+    {
+        GoldenNoise noise(1);
+        GoldenSettings fixed = settings;
+        fixed.arithmetic = Arithmetic::Fixed;
+        cases.push_back(
+            {"tone_noise_q15", fixed,
+             synthesizeCapture(
+                 uniform,
+                 [&noise](uint64_t n) {
+                     return tone(12500.0, n, 0.5) + noise.gaussian(0.05);
+                 },
+                 noFlags)});
+    }
+    {
+        // 15 ms pulses every 100 ms in noise, in ragged packets.
+        GoldenNoise noise(2);
+        GoldenSettings pulse;
+        pulse.shiftHz = -24000.0;
+        cases.push_back(
+            {"pulse_train", pulse,
+             synthesizeCapture(
+                 ragged,
+                 [&noise](uint64_t n) {
+                     const uint64_t period = kGoldenSampleRate / 10;
+                     const uint64_t width = kGoldenSampleRate * 15 / 1000;
+                     const double amplitude =
+                         ((n % period) < width) ? 0.3 : 0.0;
+                     return tone(-23800.0, n, amplitude) + noise.gaussian(0.1);
+                 },
+                 noFlags)});
+    }
+    {
+        // Sweeps the whole input band, through every stage's stopband.
+        GoldenSettings chirp;
+        const double duration =
+            static_cast<double>(32 * 16384) / kGoldenSampleRate;
+        const double rate = 600000.0 / duration;
+        cases.push_back(
+            {"chirp", chirp,
+             synthesizeCapture(
+                 uniform,
+                 [rate](uint64_t n) {
+                     const double t =
+                         static_cast<double>(n) / kGoldenSampleRate;
+                     return std::polar(
+                         0.5, kTwoPi * (-300000.0 * t + 0.5 * rate * t * t));
+                 },
+                 noFlags)});
+    }
+    {
+        // An overflowed packet of full-scale garbage, then a retune.
+        GoldenNoise noise(3);
+        cases.push_back(
+            {"overflow_retune", settings,
+             synthesizeCapture(
+                 uniform,
+                 [&noise](uint64_t n) {
+                     const uint64_t packet = n / 16384;
+                     if (packet == 10) {
+                         return std::complex<double>((n & 1U) ? 1.0 : -1.0,
+                                                     1.0);
+                     }
+                     const double hz = (packet < 20) ? 12500.0 : 9000.0;
+                     return tone(hz, n, 0.5) + noise.gaussian(0.05);
+                 },
+                 [](std::size_t packet) {
+                     return (packet == 10)   ? kZmqFlagOverflow
+                            : (packet == 20) ? kZmqFlagRetune
+                                             : uint32_t{0};
+                 })});
+    }
+    return cases;
+}
+
+// Runs a capture the way the main loop does, reacting to header flags
+// through its restartOnRetune()/blankOnOverflow(), with timestamps anchored
+// at the first packet so the frames are reproducible.
+std::vector<SampleVector> replayCapture(const Capture &capture,
+                                        const GoldenSettings &settings) {
+    PipelineConfig pipelineConfig;
+    pipelineConfig.inputRate = settings.inputRate;
+    pipelineConfig.shiftHz = settings.shiftHz;
+    pipelineConfig.frameSamples = settings.frameSamples;
+    pipelineConfig.arithmetic = settings.arithmetic;
+    DecimationPipeline pipeline(pipelineConfig);
+
+    std::vector<SampleVector> frames;
+    ZmqPacket packet;
+    packet.decodeFixed = (settings.arithmetic == Arithmetic::Fixed);
+    bool anchored = false;
+    for (const auto &message : capture) {
+        if (!parseZmqFrame(message, packet)) {
+            throw std::runtime_error("Malformed packet in golden capture");
+        }
+        if (!anchored) {
+            pipeline.anchorTimestamps(packet.timestampUs * 1000ULL);
+            anchored = true;
+        }
+        (void)restartOnRetune(pipeline, packet.flags);
+        const std::size_t sampleCount = packet.decodeFixed
+                                            ? packet.fixedSamples.size()
+                                            : packet.samples.size();
+        std::size_t blanked = 0;
+        if (!blankOnOverflow(pipeline, packet.flags, sampleCount, blanked)) {
+            if (packet.decodeFixed) {
+                (void)pipeline.process(packet.fixedSamples);
+            } else {
+                (void)pipeline.process(packet.samples);
+            }
+        }
+        while (pipeline.frameReady()) {
+            const std::complex<float> *frame = pipeline.frame();
+            frames.emplace_back(frame, frame + pipeline.frameSamples());
+            pipeline.consumeFrame();
+        }
+    }
+    return frames;
+}
+
+std::string capturePath(const GoldenConfig &config, const std::string &name) {
+    return config.corpusDir + "/" + name + ".zcap";
+}
+
+std::string referencePath(const GoldenConfig &config,
+                          const std::string &name) {
+    return config.corpusDir + "/" + name + ".golden";
+}
+
+template <typename T> void writeRaw(std::ofstream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> T readRaw(std::ifstream &in) {
+    T value{};
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (!in) {
+        throw std::runtime_error("Golden corpus file truncated");
+    }
+    return value;
+}
+
+void readMagic(std::ifstream &in, const char (&magic)[8],
+               const std::string &path) {
+    char found[8] = {};
+    in.read(found, sizeof(found));
+    if (!in || std::memcmp(found, magic, sizeof(found)) != 0) {
+        throw std::runtime_error("Not a golden corpus file: " + path);
+    }
+}
+
+// Captures are the raw ZeroMQ messages, each prefixed with its length.
+void writeCapture(const std::string &path, const Capture &capture) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(kCaptureMagic, sizeof(kCaptureMagic));
+    for (const auto &message : capture) {
+        writeRaw(out, static_cast<uint32_t>(message.size()));
+        out.write(reinterpret_cast<const char *>(message.data()),
+                  static_cast<std::streamsize>(message.size()));
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+Capture readCapture(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    readMagic(in, kCaptureMagic, path);
+    Capture capture;
+    uint32_t size = 0;
+    while (in.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+        std::vector<uint8_t> message(size);
+        in.read(reinterpret_cast<char *>(message.data()), size);
+        if (!in) {
+            throw std::runtime_error("Truncated capture " + path);
+        }
+        capture.push_back(std::move(message));
+    }
+    return capture;
+}
+
+// References are host-endian like the state file: settings, then every
+// frame exactly as it would go out on UDP.
+void writeReference(const std::string &path,
+                    const GoldenReference &reference) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(kGoldenMagic, sizeof(kGoldenMagic));
+    writeRaw(out, reference.settings.inputRate);
+    writeRaw(out, reference.settings.shiftHz);
+    writeRaw(out, static_cast<uint32_t>(reference.settings.frameSamples));
+    writeRaw(out, static_cast<uint8_t>(reference.settings.arithmetic ==
+                                       Arithmetic::Fixed));
+    writeRaw(out, static_cast<uint32_t>(reference.frames.size()));
+    for (const auto &frame : reference.frames) {
+        out.write(reinterpret_cast<const char *>(frame.data()),
+                  static_cast<std::streamsize>(frame.size() *
+                                               sizeof(frame[0])));
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+GoldenReference readReference(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    readMagic(in, kGoldenMagic, path);
+    GoldenReference reference;
+    reference.settings.inputRate = readRaw<double>(in);
+    reference.settings.shiftHz = readRaw<double>(in);
+    reference.settings.frameSamples = readRaw<uint32_t>(in);
+    reference.settings.arithmetic =
+        (readRaw<uint8_t>(in) != 0U) ? Arithmetic::Fixed : Arithmetic::Float;
+    const auto frames = readRaw<uint32_t>(in);
+    if (reference.settings.frameSamples < 2) {
+        throw std::runtime_error("Bad frame size in " + path);
+    }
+    reference.frames.assign(frames,
+                            SampleVector(reference.settings.frameSamples));
+    for (auto &frame : reference.frames) {
+        in.read(reinterpret_cast<char *>(frame.data()),
+                static_cast<std::streamsize>(frame.size() * sizeof(frame[0])));
+    }
+    if (!in) {
+        throw std::runtime_error("Truncated reference " + path);
+    }
+    return reference;
+}
+
+struct GoldenComparison {
+    std::size_t frames = 0;
+    std::size_t referenceFrames = 0;
+    bool timestampsEqual = true;
+    bool bitExact = true;
+    double maxError = 0.0;
+    double snrDb = std::numeric_limits<double>::infinity();
+};
+
+GoldenComparison compareFrames(const std::vector<SampleVector> &frames,
+                               const std::vector<SampleVector> &reference) {
+    GoldenComparison result;
+    result.frames = frames.size();
+    result.referenceFrames = reference.size();
+    double signal = 0.0;
+    double error = 0.0;
+    const std::size_t common = std::min(frames.size(), reference.size());
+    for (std::size_t index = 0; index < common; ++index) {
+        const SampleVector &actual = frames[index];
+        const SampleVector &expected = reference[index];
+        if (actual.size() != expected.size()) {
+            throw std::runtime_error("Golden frame size differs");
+        }
+        // Sample 0 carries the timestamp bits and must match exactly.
+        if (std::memcmp(&actual[0], &expected[0], sizeof(actual[0])) != 0) {
+            result.timestampsEqual = false;
+        }
+        for (std::size_t sample = 1; sample < actual.size(); ++sample) {
+            const std::complex<double> want(expected[sample]);
+            const std::complex<double> diff =
+                std::complex<double>(actual[sample]) - want;
+            signal += std::norm(want);
+            error += std::norm(diff);
+            result.maxError = std::max(result.maxError, std::abs(diff));
+        }
+        if (std::memcmp(actual.data() + 1, expected.data() + 1,
+                        (actual.size() - 1) * sizeof(actual[0])) != 0) {
+            result.bitExact = false;
+        }
+    }
+    if (error > 0.0) {
+        result.snrDb = (signal > 0.0) ? 10.0 * std::log10(signal / error)
+                                      : -std::numeric_limits<double>::infinity();
+    }
+    return result;
+}
+
+// Records packets from a live publisher into <name>.zcap and writes the
+// reference this build produces for it.
+void recordCase(const GoldenConfig &config) {
+    void *context = zmq_ctx_new();
+    void *socket = zmq_socket(context, ZMQ_SUB);
+    const int timeoutMs = 5000;
+    zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "", 0);
+    zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeoutMs, sizeof(timeoutMs));
+    Capture capture;
+    try {
+        if (zmq_connect(socket, config.recordEndpoint.c_str()) != 0) {
+            throw std::runtime_error("Failed to connect to " +
+                                     config.recordEndpoint);
+        }
+        while (capture.size() < config.recordPackets) {
+            std::vector<uint8_t> message;
+            bool more = true;
+            while (more) {
+                zmq_msg_t part;
+                zmq_msg_init(&part);
+                if (zmq_msg_recv(&part, socket, 0) < 0) {
+                    zmq_msg_close(&part);
+                    throw std::runtime_error("Timed out recording from " +
+                                             config.recordEndpoint);
+                }
+                const auto *data =
+                    static_cast<const uint8_t *>(zmq_msg_data(&part));
+                message.insert(message.end(), data, data + zmq_msg_size(&part));
+                more = zmq_msg_more(&part) != 0;
+                zmq_msg_close(&part);
+            }
+            capture.push_back(std::move(message));
+        }
+    } catch (...) {
+        zmq_close(socket);
+        zmq_ctx_term(context);
+        throw;
+    }
+    zmq_close(socket);
+    zmq_ctx_term(context);
+
+    ZmqPacket first;
+    if (!parseZmqFrame(capture.front(), first) || first.sampleRate == 0) {
+        throw std::runtime_error("Recorded capture starts with a bad packet");
+    }
+    GoldenReference reference;
+    reference.settings.inputRate = first.sampleRate;
+    reference.settings.shiftHz = config.recordShiftHz;
+    reference.settings.arithmetic = config.recordArithmetic;
+    reference.frames = replayCapture(capture, reference.settings);
+    writeCapture(capturePath(config, config.recordName), capture);
+    writeReference(referencePath(config, config.recordName), reference);
+    std::printf("recorded %s: packets=%zu frames=%zu\n",
+                config.recordName.c_str(), capture.size(),
+                reference.frames.size());
+}
+
+// Synthetic cases plus every recorded capture in the corpus; a recorded
+// case's settings come from its reference.
+std::vector<GoldenCase> corpusCases(const GoldenConfig &config) {
+    std::vector<GoldenCase> cases = syntheticCases();
+    std::vector<std::string> recorded;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(config.corpusDir)) {
+        if (entry.path().extension() == ".zcap") {
+            recorded.push_back(entry.path().stem().string());
+        }
+    }
+    std::sort(recorded.begin(), recorded.end());
+    for (const auto &name : recorded) {
+        cases.push_back({name, readReference(referencePath(config, name)).settings,
+                         readCapture(capturePath(config, name))});
+    }
+    return cases;
+}
+
+int runGolden(const GoldenConfig &config) {
+    if (!config.recordEndpoint.empty()) {
+        recordCase(config);
+        return 0;
+    }
+    const std::vector<GoldenCase> cases = corpusCases(config);
+    if (config.regenerate) {
+        for (const auto &golden : cases) {
+            GoldenReference reference;
+            reference.settings = golden.settings;
+            reference.frames = replayCapture(golden.capture, golden.settings);
+            writeReference(referencePath(config, golden.name), reference);
+            std::printf("regenerated %s: frames=%zu\n", golden.name.c_str(),
+                        reference.frames.size());
+        }
+        return 0;
+    }
+
+    std::printf("%-18s %9s %10s %12s %9s %9s %6s\n", "case", "frames",
+                "timestamps", "max_abs_err", "snr_db", "bit_exact", "result");
+    int failures = 0;
+    for (const auto &golden : cases) {
+        const GoldenReference reference =
+            readReference(referencePath(config, golden.name));
+        const GoldenComparison result = compareFrames(
+            replayCapture(golden.capture, reference.settings),
+            reference.frames);
+        const bool pass = result.frames == result.referenceFrames &&
+                          result.referenceFrames > 0 &&
+                          result.timestampsEqual &&
+                          result.snrDb >= config.minSnrDb;
+        const std::string frames = std::to_string(result.frames) + "/" +
+                                   std::to_string(result.referenceFrames);
+        std::printf("%-18s %9s %10s %12.3e %9.1f %9s %6s\n",
+                    golden.name.c_str(), frames.c_str(),
+                    result.timestampsEqual ? "equal" : "DIFFER",
+                    result.maxError, result.snrDb,
+                    result.bitExact ? "yes" : "no", pass ? "pass" : "FAIL");
+        if (!pass) {
+            ++failures;
+            std::cerr << "[FAIL] " << golden.name
+                      << " drifted from its reference\n";
+        }
+    }
+    return (failures == 0) ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    try {
+        return runGolden(parseGoldenArgs(argc, argv));
+    } catch (const std::exception &err) {
+        std::cerr << "[FAIL] " << err.what() << "\n";
+        return 1;
+    }
+}
@@ -4,12 +4,16 @@
 #include <cstdint>
 #include <cstring>
 #include <exception>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <random>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include <airspyhf_decim.h>
+
 #define main airspyhf_decimator_program_main
 #include "../src/main.cpp"
 #undef main
@@ -156,6 +160,18 @@ class TestZmqPublisher {
         }
     }
 
+    void sendMultipart(const std::vector<std::vector<uint8_t>> &parts) {
+        for (std::size_t index = 0; index < parts.size(); ++index) {
+            const int flags = (index + 1 < parts.size()) ? ZMQ_SNDMORE : 0;
+            const int sent = zmq_send(socket_, parts[index].data(),
+                                      parts[index].size(), flags);
+            if (sent < 0 ||
+                static_cast<std::size_t>(sent) != parts[index].size()) {
+                throw std::runtime_error("Failed sending ZMQ test part");
+            }
+        }
+    }
+
   private:
     void cleanup() {
         if (socket_ != nullptr) {
@@ -271,6 +287,88 @@ void testParseArgsValidation() {
     }
 }
 
+void testNumaTopologyFromSysfs() {
+    char rootTemplate[] = "/tmp/airspyhf_decimator_numaXXXXXX";
+    if (::mkdtemp(rootTemplate) == nullptr) {
+        throw std::runtime_error("Failed creating temporary sysfs tree");
+    }
+    const std::filesystem::path root(rootTemplate);
+    const auto writeFile = [](const std::filesystem::path &path,
+                              const std::string &text) {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path) << text;
+    };
+    writeFile(root / "node/node1/cpulist", "4-7,12\n");
+    writeFile(root / "node/node1/meminfo",
+              "Node 1 MemTotal:       16318068 kB\n");
+    writeFile(root / "node/node0/cpulist", "0-3\n");
+    writeFile(root / "node/possible", "0-1\n");
+    writeFile(root / "net/eth1/device/numa_node", "1\n");
+    writeFile(root / "net/eth0/device/numa_node", "-1\n");
+
+    const NumaTopology topology =
+        NumaTopology::discover((root / "node").string());
+    const bool layoutOk = topology.nodes().size() == 2 &&
+                          topology.nodes()[0].id == 0 &&
+                          topology.nodes()[1].memoryKb == 16318068U &&
+                          topology.summary() == "0:0-3/1:4-7,12" &&
+                          topology.nodeOfCpu(12) == 1 &&
+                          topology.nodeOfCpu(9) == -1;
+    const bool interfacesOk =
+        interfaceNumaNode("eth1", (root / "net").string()) == 1 &&
+        interfaceNumaNode("eth0", (root / "net").string()) == -1 &&
+        interfaceNumaNode("lo", (root / "net").string()) == -1;
+    std::filesystem::remove_all(root);
+    if (!layoutOk || !interfacesOk) {
+        throw std::runtime_error("NUMA topology parsed incorrectly");
+    }
+    if (formatCpuList(parseCpuList("8,0-2, 3,10-11")) != "0-3,8,10-11") {
+        throw std::runtime_error("CPU list round trip failed");
+    }
+    bool threw = false;
+    try {
+        (void)parseCpuList("3-1");
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("parseCpuList should reject a reversed range");
+    }
+
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--numa";
+    char arg2[] = "1";
+    char *argv[] = {arg0, arg1, arg2};
+    const Options opts = parseArgs(3, argv);
+    if (opts.numaPolicy != NumaPolicy::Node || opts.numaNode != 1) {
+        throw std::runtime_error("--numa 1 should select node 1");
+    }
+    char bad[] = "near";
+    char *argvBad[] = {arg0, arg1, bad};
+    threw = false;
+    try {
+        (void)parseArgs(3, argvBad);
+    } catch (const ArgsError &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("--numa should reject an unknown policy");
+    }
+
+    Options placed;
+    placed.numaPolicy = NumaPolicy::Node;
+    placed.numaNode = 7;
+    threw = false;
+    try {
+        (void)placeOnNumaNode(placed, topology);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("Placement on a missing node should fail");
+    }
+}
+
 void testDesignLowpassNormalization() {
     const auto coeffs = designLowpass(10, 0.2f);
     if (coeffs.size() % 2 == 0) {
@@ -432,6 +530,424 @@ void testZmqReceiverMalformedFrameAccounting() {
     }
 }
 
+// Sends valid frames until the receiver gets one.
+void syncZmqSubscriber(TestZmqPublisher &publisher, ZmqIqReceiver &receiver) {
+    for (int attempt = 0; attempt < 30; ++attempt) {
+        publisher.sendFrame(makeValidZmqFrame());
+        ZmqPacket packet;
+        bool timedOut = false;
+        if (receiver.receive(packet, timedOut)) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    throw std::runtime_error("Subscriber never received a frame");
+}
+
+void testZmqReceiverLinkEventsAndRestart() {
+    std::string endpoint;
+    std::unique_ptr<ZmqIqReceiver> receiver;
+    {
+        TestZmqPublisher publisher;
+        endpoint = publisher.endpoint();
+        receiver = std::make_unique<ZmqIqReceiver>(endpoint);
+        syncZmqSubscriber(publisher, *receiver);
+        receiver->pollMonitor();
+        if (!receiver->linkStats().connected ||
+            receiver->linkStats().connects != 1) {
+            throw std::runtime_error("Monitor should report the connect");
+        }
+    }
+    TestZmqPublisher restarted;
+    if (restarted.endpoint() != endpoint) {
+        throw std::runtime_error("Restarted publisher took another endpoint");
+    }
+    syncZmqSubscriber(restarted, *receiver);
+    receiver->pollMonitor();
+    const ZmqLinkStats &link = receiver->linkStats();
+    if (link.disconnects != 1 || link.connects != 2 || !link.connected) {
+        throw std::runtime_error("Monitor should report the reconnect");
+    }
+
+    if (!isPublisherRestart(1000, 0, true) ||
+        !isPublisherRestart(100000, 5, false) ||
+        isPublisherRestart(1000, 999, false) ||
+        isPublisherRestart(5, 6, true)) {
+        throw std::runtime_error("isPublisherRestart classification mismatch");
+    }
+}
+
+void testSequenceTrackerWraparound() {
+    SequenceTracker tracker;
+    const uint64_t max = std::numeric_limits<uint64_t>::max();
+    using Step = SequenceTracker::Step;
+    if (tracker.observe(max - 1, false) != Step::First ||
+        tracker.observe(max, false) != Step::InOrder ||
+        tracker.observe(0, false) != Step::InOrder ||
+        tracker.observe(3, false) != Step::Gap || tracker.lastGap() != 2 ||
+        tracker.observe(2, false) != Step::Backward ||
+        tracker.observe(2, false) != Step::Backward) {
+        throw std::runtime_error("SequenceTracker step mismatch at wrap");
+    }
+    tracker.restore(max - 2, true);
+    if (tracker.observe(1, false) != Step::Gap || tracker.lastGap() != 3 ||
+        tracker.observe(0, true) != Step::Restart ||
+        tracker.dropped() != 5 || tracker.outOfOrder() != 2 ||
+        tracker.restarts() != 1 || tracker.previous() != 0) {
+        throw std::runtime_error("SequenceTracker totals mismatch");
+    }
+}
+
+void testStreamMergerAlignsByTimestamp() {
+    // Stream B starts 200 samples (250 us) after A; both carry the same
+    // signal at the same absolute times.
+    constexpr double rate = 800000.0;
+    constexpr std::size_t packetSamples = 1000;
+    constexpr uint64_t baseUs = 1000000;
+    const auto makePacket = [&](uint64_t sequence, uint64_t firstSample) {
+        ZmqPacket packet;
+        packet.sequence = sequence;
+        packet.timestampUs =
+            baseUs + static_cast<uint64_t>(static_cast<double>(firstSample) *
+                                           1e6 / rate);
+        packet.sampleRate = static_cast<uint32_t>(rate);
+        for (std::size_t index = 0; index < packetSamples; ++index) {
+            const double phase = kTwoPi * 3000.0 *
+                                 static_cast<double>(firstSample + index) /
+                                 rate;
+            packet.samples.push_back({0.5f * static_cast<float>(std::cos(phase)),
+                                      0.5f * static_cast<float>(std::sin(phase))});
+        }
+        return packet;
+    };
+
+    PipelineConfig config;
+    config.inputRate = rate;
+    config.frameSamples = 1 + 2 * 16;
+    StreamMerger merger(2, config);
+    std::vector<std::vector<std::complex<float>>> frames;
+    const auto drain = [&] {
+        while (merger.frameReady()) {
+            const auto *frame = merger.frame();
+            frames.emplace_back(frame, frame + merger.frameSamples());
+            merger.consumeFrame();
+        }
+    };
+
+    merger.push(0, makePacket(0, 0));
+    merger.push(1, makePacket(0, 200));
+    if (!merger.aligned() || merger.startTimestampUs() != baseUs + 1500) {
+        throw std::runtime_error("Merge should start at B's next packet");
+    }
+    for (uint64_t packet = 1; packet < 200; ++packet) {
+        merger.push(0, makePacket(packet, packet * packetSamples));
+        if (packet != 100) {
+            merger.push(1, makePacket(packet, packet * packetSamples + 200));
+        }
+        drain();
+    }
+    if (merger.stats(0).trimmedSamples != 200 ||
+        merger.stats(1).trimmedSamples != 0 || merger.stats(1).dropped != 1 ||
+        merger.stats(1).gapFillSamples != packetSamples ||
+        merger.stats(0).gapFillSamples != 0) {
+        throw std::runtime_error("Merge trim/gap accounting mismatch");
+    }
+    if (frames.size() < 50 || extractTimeNs(frames[0][0]) != 1001500000ULL ||
+        extractTimeNs(frames[1][0]) != 1005500000ULL) {
+        throw std::runtime_error("Merged frames should share the aligned "
+                                 "timestamp");
+    }
+    // Output n covers timeline input 200 n; B's gap starts at input 99000.
+    const std::size_t cleanFrames = 400 / 16;
+    for (std::size_t index = 0; index < cleanFrames; ++index) {
+        for (std::size_t sample = 0; sample < 16; ++sample) {
+            if (frames[index][1 + 2 * sample] !=
+                frames[index][2 + 2 * sample]) {
+                throw std::runtime_error("Aligned streams should interleave "
+                                         "identical samples");
+            }
+        }
+    }
+
+    // A publisher that stops is padded once it falls a second behind.
+    const std::size_t framesBefore = frames.size();
+    for (uint64_t packet = 200; packet < 1200; ++packet) {
+        merger.push(0, makePacket(packet, packet * packetSamples));
+        drain();
+    }
+    if (merger.stats(1).lagFillSamples == 0 ||
+        frames.size() < framesBefore + 200) {
+        throw std::runtime_error("Stalled stream should be padded");
+    }
+}
+
+void testStreamMergerRestartsRetunedStream() {
+    // Both streams carry a tone that stops at packet 40; stream 0 flags
+    // that packet as a retune. Its filters restart, so it is silent from
+    // there on, while stream 1 rings out the tone's filter tail.
+    constexpr double rate = 800000.0;
+    constexpr std::size_t packetSamples = 1000;
+    constexpr uint64_t retunePacket = 40;
+    const auto makePacket = [&](uint64_t sequence) {
+        ZmqPacket packet;
+        packet.sequence = sequence;
+        packet.timestampUs = 1000000 + sequence * 1250;
+        packet.sampleRate = static_cast<uint32_t>(rate);
+        for (std::size_t index = 0; index < packetSamples; ++index) {
+            const double phase =
+                kTwoPi * 3000.0 *
+                static_cast<double>(sequence * packetSamples + index) / rate;
+            packet.samples.push_back(
+                (sequence < retunePacket)
+                    ? std::polar(0.5f, static_cast<float>(phase))
+                    : std::complex<float>{});
+        }
+        return packet;
+    };
+
+    PipelineConfig config;
+    config.inputRate = rate;
+    config.frameSamples = 1 + 2 * 16;
+    StreamMerger merger(2, config);
+    std::vector<std::complex<float>> outputs[2];
+    for (uint64_t sequence = 0; sequence < 80; ++sequence) {
+        ZmqPacket retuned = makePacket(sequence);
+        if (sequence == retunePacket) {
+            retuned.flags = kZmqFlagRetune;
+        }
+        merger.push(0, retuned);
+        merger.push(1, makePacket(sequence));
+        while (merger.frameReady()) {
+            const auto *frame = merger.frame();
+            for (std::size_t sample = 0; sample < 16; ++sample) {
+                outputs[0].push_back(frame[1 + 2 * sample]);
+                outputs[1].push_back(frame[2 + 2 * sample]);
+            }
+            merger.consumeFrame();
+        }
+    }
+    if (merger.stats(0).retunes != 1 || merger.stats(1).retunes != 0 ||
+        outputs[0].size() != outputs[1].size()) {
+        throw std::runtime_error("Merged retune accounting mismatch");
+    }
+    // Both streams start at packet 1 on the shared timeline.
+    const auto retuneOutput = static_cast<std::size_t>(
+        static_cast<double>((retunePacket - 1) * packetSamples) /
+        kTotalDecimation);
+    bool tail = false;
+    for (std::size_t index = retuneOutput; index < outputs[0].size();
+         ++index) {
+        if (outputs[0][index] != std::complex<float>{}) {
+            throw std::runtime_error("Retuned stream kept pre-retune state");
+        }
+        tail = tail || outputs[1][index] != std::complex<float>{};
+    }
+    if (!tail || outputs[0][retuneOutput - 1] == std::complex<float>{}) {
+        throw std::runtime_error("Merged retune restarted the wrong stream");
+    }
+}
+
+void testShardCoordinatorAssignsAndRebalances() {
+    std::vector<std::vector<std::size_t>> plan = {{0, 1, 2}, {}};
+    if (rebalanceShards(plan, {0.9, 0.1, 0.1}) != 1 ||
+        plan[0] != std::vector<std::size_t>{1, 2} ||
+        plan[1] != std::vector<std::size_t>{0}) {
+        throw std::runtime_error("rebalanceShards should isolate the heavy "
+                                 "channel");
+    }
+
+    std::vector<ChannelSpec> specs;
+    for (uint16_t index = 0; index < 4; ++index) {
+        specs.push_back(
+            {5.0 * index, {static_cast<uint16_t>(30000 + index)}, {0}});
+    }
+    std::unique_ptr<ShardCoordinator> coordinator;
+    std::string endpoint;
+    for (int port = 29300; port < 29400 && !coordinator; ++port) {
+        endpoint = "tcp://127.0.0.1:" + std::to_string(port);
+        try {
+            coordinator = std::make_unique<ShardCoordinator>(endpoint, specs);
+        } catch (const std::runtime_error &) {
+        }
+    }
+    if (!coordinator) {
+        throw std::runtime_error("Failed binding shard coordinator");
+    }
+
+    std::vector<std::unique_ptr<ShardWorkerLink>> links;
+    std::vector<std::vector<ShardAssignment>> assigned;
+    // Each round runs tick() (worker reports), one coordinator poll at
+    // `now`, and the workers' polls, until done() holds.
+    const auto pump = [&](std::chrono::steady_clock::time_point now,
+                          const auto &tick, const auto &done) {
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            tick();
+            (void)coordinator->wait(10);
+            coordinator->poll(now);
+            for (std::size_t index = 0; index < links.size(); ++index) {
+                (void)links[index]->pollAssignment(assigned[index]);
+            }
+            if (done()) {
+                return;
+            }
+        }
+        throw std::runtime_error("Shard exchange did not settle");
+    };
+    const auto join = [&](const char *name) {
+        links.push_back(std::make_unique<ShardWorkerLink>(endpoint, name));
+        assigned.emplace_back();
+    };
+    const auto report = [&](std::size_t worker, double heavyLoad) {
+        std::vector<std::pair<uint32_t, double>> loads;
+        for (const auto &entry : assigned[worker]) {
+            loads.emplace_back(entry.id, entry.id == 0 ? heavyLoad : 0.1);
+        }
+        links[worker]->reportLoad(loads);
+    };
+
+    const auto idle = [] {};
+    const auto start = std::chrono::steady_clock::now();
+    join("w0");
+    pump(start, idle, [&] { return assigned[0].size() == 4; });
+    if (assigned[0][1].spec.shiftKhz != 5.0 ||
+        assigned[0][1].spec.ports != std::vector<uint16_t>{30001}) {
+        throw std::runtime_error("Assigned channel spec mismatch");
+    }
+    join("w1");
+    pump(start, idle, [&] {
+        return assigned[0].size() == 2 && assigned[1].size() == 2;
+    });
+
+    // Make channel 0 heavy; after the rebalance interval it gets a worker
+    // to itself.
+    const auto later = start + std::chrono::seconds(6);
+    pump(
+        later,
+        [&] {
+            report(0, 0.9);
+            report(1, 0.9);
+        },
+        [&] {
+            for (const auto &worker : assigned) {
+                if (worker.size() == 1 && worker.front().id == 0) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    if (coordinator->rebalances() == 0 || coordinator->workers() != 2) {
+        throw std::runtime_error("Load should have triggered a rebalance");
+    }
+
+    // w0 goes silent; w1 inherits everything.
+    const auto afterLoss = later + std::chrono::seconds(4);
+    pump(
+        afterLoss, [&] { report(1, 0.9); },
+        [&] {
+            return coordinator->workers() == 1 && assigned[1].size() == 4;
+        });
+}
+
+void testPacketArenaReuse() {
+    PacketArena arena(256);
+    (void)arena.allocate(100);
+    (void)arena.allocate(1000);
+    (void)arena.allocate(3000);
+    const uint64_t allocationsAfterBurst = arena.chunkAllocations();
+    if (allocationsAfterBurst < 2 || arena.highWaterBytes() < 4100) {
+        throw std::runtime_error("PacketArena should grow to fit a burst");
+    }
+
+    arena.reset();
+    const uint64_t allocationsAfterCoalesce = arena.chunkAllocations();
+    for (int packet = 0; packet < 10; ++packet) {
+        arena.reset();
+        uint8_t *first = arena.allocate(100);
+        uint8_t *second = arena.allocate(1000);
+        uint8_t *third = arena.allocate(3000);
+        if ((reinterpret_cast<uintptr_t>(second) % kSampleAlignment) != 0U ||
+            second < first + 100 || third < second + 1000) {
+            throw std::runtime_error("PacketArena returned overlapping spans");
+        }
+    }
+    if (arena.chunkAllocations() != allocationsAfterCoalesce) {
+        throw std::runtime_error(
+            "PacketArena should not allocate at steady state");
+    }
+}
+
+void testZmqReceiverSharedContextInproc() {
+    void *context = zmq_ctx_new();
+    void *publisher = zmq_socket(context, ZMQ_PUB);
+    const int lingerMs = 0;
+    (void)zmq_setsockopt(publisher, ZMQ_LINGER, &lingerMs, sizeof(lingerMs));
+    const std::string endpoint = "inproc://airspyhf-decimator-test";
+    if (zmq_bind(publisher, endpoint.c_str()) != 0) {
+        throw std::runtime_error("Failed binding inproc test PUB socket");
+    }
+
+    bool received = false;
+    {
+        ZmqIqReceiver receiver(context, endpoint);
+        const auto frame = makeValidZmqFrame();
+        for (int attempt = 0; attempt < 30 && !received; ++attempt) {
+            (void)zmq_send(publisher, frame.data(), frame.size(), 0);
+            ZmqPacket packet;
+            bool timedOut = false;
+            received = receiver.receive(packet, timedOut) &&
+                       packet.sequence == 42U;
+        }
+    }
+    // The receiver must leave a borrowed context running.
+    void *probe = zmq_socket(context, ZMQ_SUB);
+    if (probe != nullptr) {
+        zmq_close(probe);
+    }
+    zmq_close(publisher);
+    zmq_ctx_term(context);
+    if (!received) {
+        throw std::runtime_error("Shared-context inproc receiver got no frame");
+    }
+    if (probe == nullptr) {
+        throw std::runtime_error("Receiver terminated a context it did not own");
+    }
+
+    bool threw = false;
+    try {
+        ZmqIqReceiver invalid(nullptr, endpoint);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("Null context should be rejected");
+    }
+}
+
+void testZmqReceiverMultipartCombine() {
+    TestZmqPublisher publisher;
+    ZmqIqReceiver receiver(publisher.endpoint());
+    const auto frame = makeValidZmqFrame();
+    const std::vector<std::vector<uint8_t>> parts = {
+        std::vector<uint8_t>(frame.begin(), frame.begin() + 10),
+        std::vector<uint8_t>(frame.begin() + 10, frame.end()),
+    };
+
+    for (int attempt = 0; attempt < 30; ++attempt) {
+        publisher.sendMultipart(parts);
+        ZmqPacket packet;
+        bool timedOut = false;
+        if (receiver.receive(packet, timedOut)) {
+            if (packet.sequence != 42ULL || packet.samples.size() != 2U ||
+                packet.samples[1] != std::complex<float>(0.75f, 0.125f)) {
+                throw std::runtime_error("Multipart ZMQ packet mismatch");
+            }
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    throw std::runtime_error("Multipart ZMQ packet was never received");
+}
+
 void testFrequencyShifterSignConvention() {
     constexpr double sampleRateHz = 96000.0;
     constexpr double inputToneHz = 5000.0;
@@ -478,6 +994,1368 @@ void testFirDecimatorOutputCount() {
     }
 }
 
+void testParseArgsSpectrumOptions() {
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--spectrum-port";
+    char arg2[] = "10100";
+    char arg3[] = "--spectrum-fft";
+    char arg4[] = "256";
+    char arg5[] = "--spectrum-avg";
+    char arg6[] = "4";
+    char arg7[] = "--spectrum-source";
+    char arg8[] = "stage1";
+    char *argv[] = {arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8};
+
+    const Options opts =
+        parseArgs(static_cast<int>(sizeof(argv) / sizeof(argv[0])), argv);
+    if (opts.spectrumPort != 10100 || opts.spectrumFftSize != 256 ||
+        opts.spectrumAverages != 4 ||
+        opts.spectrumSource != SpectrumSource::Stage1) {
+        throw std::runtime_error("parseArgs spectrum values mismatch");
+    }
+
+    char arg9[] = "--spectrum-fft";
+    char arg10[] = "300";
+    char *argvBadFft[] = {arg0, arg9, arg10};
+    bool threw = false;
+    try {
+        (void)parseArgs(3, argvBadFft);
+    } catch (const ArgsError &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error(
+            "parseArgs should reject non power-of-two spectrum FFT sizes");
+    }
+}
+
+void testParseArgsChannels() {
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--channel";
+    char arg2[] = "-25.5@11000,11001";
+    char arg3[] = "--channel";
+    char arg4[] = "40@11002";
+    char arg5[] = "--workers";
+    char arg6[] = "3";
+    char *argv[] = {arg0, arg1, arg2, arg3, arg4, arg5, arg6};
+
+    const Options opts =
+        parseArgs(static_cast<int>(sizeof(argv) / sizeof(argv[0])), argv);
+    if (opts.channels.size() != 2 || opts.workers != 3 ||
+        opts.channels[0].shiftKhz != -25.5 ||
+        opts.channels[0].ports != std::vector<uint16_t>{11000, 11001} ||
+        opts.channels[1].shiftKhz != 40.0 ||
+        opts.channels[1].ports != std::vector<uint16_t>{11002}) {
+        throw std::runtime_error("parseArgs channel values mismatch");
+    }
+
+    char *argvDefault[] = {arg0};
+    const Options defaults = parseArgs(1, argvDefault);
+    if (defaults.channels.size() != 1 || defaults.channels[0].shiftKhz != 10.0 ||
+        defaults.channels[0].ports != defaults.ports) {
+        throw std::runtime_error(
+            "Without --channel, --shift-khz/--ports should form one channel");
+    }
+
+    char arg7[] = "--state-file";
+    char arg8[] = "/tmp/unused";
+    char arg9[] = "--channel";
+    char arg10[] = "5@";
+    char *argvState[] = {arg0, arg1, arg2, arg3, arg4, arg7, arg8};
+    char *argvNoPort[] = {arg0, arg9, arg10};
+    for (auto *badArgv : {argvState, argvNoPort}) {
+        bool threw = false;
+        try {
+            (void)parseArgs(badArgv == argvState ? 7 : 3, badArgv);
+        } catch (const ArgsError &) {
+            threw = true;
+        }
+        if (!threw) {
+            throw std::runtime_error("parseArgs should reject bad channels");
+        }
+    }
+}
+
+void testWelchAveragerTonePeak() {
+    constexpr std::size_t fftSize = 64;
+    constexpr std::size_t averages = 4;
+    constexpr double sampleRateHz = 3840.0;
+    constexpr int toneBin = 5;
+    const double toneHz = sampleRateHz * toneBin / fftSize;
+
+    std::vector<std::complex<float>> samples(fftSize * (averages + 1));
+    for (std::size_t index = 0; index < samples.size(); ++index) {
+        const double phase =
+            kTwoPi * toneHz * static_cast<double>(index) / sampleRateHz;
+        samples[index] = {static_cast<float>(std::cos(phase)),
+                          static_cast<float>(std::sin(phase))};
+    }
+
+    WelchAverager averager(fftSize, averages);
+    const std::size_t used = averager.push(samples.data(), samples.size());
+    if (!averager.complete()) {
+        throw std::runtime_error("Welch average should complete");
+    }
+    if (used != fftSize * (averages + 1) / 2) {
+        throw std::runtime_error("Welch average consumed unexpected samples");
+    }
+
+    const auto power = averager.powerDb();
+    const auto peak = std::max_element(power.begin(), power.end());
+    const std::size_t peakIndex =
+        static_cast<std::size_t>(peak - power.begin());
+    if (peakIndex != fftSize / 2 + toneBin) {
+        throw std::runtime_error("Welch peak bin does not match tone");
+    }
+    if (std::fabs(*peak) > 0.1f) {
+        throw std::runtime_error("Unit tone should read 0 dB at its bin");
+    }
+    if (power[fftSize / 2 - toneBin] > -60.0f) {
+        throw std::runtime_error("Mirror bin should be suppressed");
+    }
+}
+
+void testEncodeSpectrumPacketLayout() {
+    SpectrumHeader header;
+    header.sequence = 7;
+    header.firstSampleIndex = 123456;
+    header.sampleRateHz = 3840.0;
+    header.shiftHz = 10000.0;
+    header.fftSize = 4;
+    header.averages = 2;
+    const std::vector<float> power = {-1.0f, -2.0f, -3.0f, -4.0f};
+
+    const auto packet = encodeSpectrumPacket(header, power);
+    if (packet.size() != kSpectrumHeaderSizeBytes + 4 * sizeof(float)) {
+        throw std::runtime_error("Spectrum packet size mismatch");
+    }
+
+    uint32_t magic = 0;
+    uint16_t headerSize = 0;
+    uint64_t sequence = 0;
+    double sampleRate = 0.0;
+    uint32_t fftSize = 0;
+    float lastBin = 0.0f;
+    std::memcpy(&magic, packet.data(), sizeof(magic));
+    std::memcpy(&headerSize, packet.data() + 6, sizeof(headerSize));
+    std::memcpy(&sequence, packet.data() + 8, sizeof(sequence));
+    std::memcpy(&sampleRate, packet.data() + 24, sizeof(sampleRate));
+    std::memcpy(&fftSize, packet.data() + 40, sizeof(fftSize));
+    std::memcpy(&lastBin, packet.data() + packet.size() - sizeof(float),
+                sizeof(float));
+    if (magic != kSpectrumMagic || headerSize != kSpectrumHeaderSizeBytes ||
+        sequence != 7 || sampleRate != 3840.0 || fftSize != 4 ||
+        lastBin != -4.0f) {
+        throw std::runtime_error("Spectrum packet fields mismatch");
+    }
+}
+
+void testAlignedAllocatorAlignment() {
+    for (std::size_t count : {1U, 3U, 1023U, 4096U}) {
+        SampleVector samples(count, {1.0f, -1.0f});
+        if ((reinterpret_cast<uintptr_t>(samples.data()) % kSampleAlignment) !=
+            0U) {
+            throw std::runtime_error("SampleVector storage not 64-byte aligned");
+        }
+    }
+
+    const HugePageMode previous = gHugePageMode.load();
+    for (HugePageMode mode :
+         {HugePageMode::Transparent, HugePageMode::Explicit}) {
+        gHugePageMode.store(mode);
+        SampleVector large(kHugePageBytes / sizeof(std::complex<float>) + 1,
+                           {0.5f, 0.25f});
+        gHugePageMode.store(HugePageMode::Off);
+        if ((reinterpret_cast<uintptr_t>(large.data()) % kSampleAlignment) !=
+                0U ||
+            large.back() != std::complex<float>(0.5f, 0.25f)) {
+            gHugePageMode.store(previous);
+            throw std::runtime_error("Huge-page SampleVector allocation failed");
+        }
+    }
+    gHugePageMode.store(previous);
+}
+
+void testMirroredRingAliasing() {
+    MirroredRing<std::complex<float>> ring(100);
+    const std::size_t capacity = ring.capacity();
+    if (capacity < 100) {
+        throw std::runtime_error("MirroredRing capacity too small");
+    }
+
+    ring[capacity - 1] = {1.0f, 2.0f};
+    ring[0] = {3.0f, 4.0f};
+    if (ring[2 * capacity - 1] != std::complex<float>(1.0f, 2.0f) ||
+        ring[capacity] != std::complex<float>(3.0f, 4.0f)) {
+        throw std::runtime_error("MirroredRing mirror does not alias");
+    }
+
+    const std::complex<float> *window = ring.data() + capacity - 1;
+    if (window[0] != std::complex<float>(1.0f, 2.0f) ||
+        window[1] != std::complex<float>(3.0f, 4.0f)) {
+        throw std::runtime_error("MirroredRing wrap window not contiguous");
+    }
+
+    MirroredRing<std::complex<float>> copy(ring);
+    ring[0] = {0.0f, 0.0f};
+    if (copy[capacity] != std::complex<float>(3.0f, 4.0f)) {
+        throw std::runtime_error("MirroredRing copy should own its pages");
+    }
+}
+
+void testFirDecimatorMatchesDirectConvolution() {
+    constexpr int factor = 5;
+    constexpr std::size_t taps = 5 * 16;
+    std::vector<std::complex<float>> input(1500);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (auto &sample : input) {
+        sample = {dist(rng), dist(rng)};
+    }
+
+    const auto coeffs = designLowpass(taps, 0.45f / factor);
+    FirDecimator decimator(factor, taps, 0.45f / factor);
+    std::vector<std::complex<float>> output;
+    for (std::size_t offset = 0; offset < input.size(); offset += 250) {
+        const std::vector<std::complex<float>> block(
+            input.begin() + offset, input.begin() + offset + 250);
+        const auto part = decimator.process(block);
+        output.insert(output.end(), part.begin(), part.end());
+    }
+
+    if (output.size() != input.size() / factor) {
+        throw std::runtime_error("FirDecimator block output count mismatch");
+    }
+    for (std::size_t n = 0; n < output.size(); ++n) {
+        const std::size_t newest = (n + 1) * factor - 1;
+        std::complex<double> expected{0.0, 0.0};
+        for (std::size_t k = 0; k < coeffs.size() && k <= newest; ++k) {
+            expected += static_cast<std::complex<double>>(input[newest - k]) *
+                        static_cast<double>(coeffs[k]);
+        }
+        if (std::abs(static_cast<std::complex<double>>(output[n]) -
+                     expected) > 1e-5) {
+            throw std::runtime_error(
+                "FirDecimator output differs from direct convolution");
+        }
+    }
+}
+
+void testSegmentedStage1MatchesSequential() {
+    std::mt19937 rng(85);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    FirDecimator sequential(8, 8 * 16, 0.45f / 8.0f);
+    FirDecimator segmented = sequential;
+    FixedFirDecimator fixedSequential(8, 8 * 16, 0.45f / 8.0f);
+    FixedFirDecimator fixedSegmented = fixedSequential;
+
+    // Uneven segments run back to front, so no segment can depend on the
+    // one before it having run.
+    const auto backwards = [](std::size_t outputs, const auto &segment) {
+        const std::size_t cuts[] = {0, outputs / 7, outputs / 3,
+                                    outputs / 3 + 1, outputs};
+        for (std::size_t index = 4; index > 0; --index) {
+            segment(std::min(cuts[index - 1], outputs),
+                    std::min(cuts[index], outputs));
+        }
+    };
+
+    for (const std::size_t blockSize :
+         {std::size_t{0}, std::size_t{1}, std::size_t{7}, std::size_t{100},
+          std::size_t{129}, std::size_t{5000}, std::size_t{3}, std::size_t{16384}}) {
+        SampleVector block(blockSize);
+        for (auto &sample : block) {
+            sample = {noise(rng), noise(rng)};
+        }
+        SampleBuffer<ci16> fixedBlock(blockSize);
+        for (std::size_t index = 0; index < blockSize; ++index) {
+            fixedBlock[index] = SampleTraits<ci16>::fromFloat(
+                block[index].real(), block[index].imag());
+        }
+
+        if (sequential.process(block) !=
+            segmented.processSegmented(block.data(), block.size(), backwards)) {
+            throw std::runtime_error("Segmented float stage 1 diverged at block " +
+                                     std::to_string(blockSize));
+        }
+        if (fixedSequential.process(fixedBlock) !=
+            fixedSegmented.processSegmented(fixedBlock.data(),
+                                            fixedBlock.size(), backwards)) {
+            throw std::runtime_error("Segmented fixed stage 1 diverged at block " +
+                                     std::to_string(blockSize));
+        }
+    }
+
+    StateWriter sequentialState;
+    StateWriter segmentedState;
+    sequential.save(sequentialState);
+    segmented.save(segmentedState);
+    if (sequentialState.bytes() != segmentedState.bytes()) {
+        throw std::runtime_error("Segmented stage 1 left a different state");
+    }
+}
+
+void testParallelStage1PipelineBitExact() {
+    PipelineConfig config;
+    config.inputRate = 768000.0;
+    config.shiftHz = 10000.0;
+    config.frameSamples = 129;
+    DecimationPipeline sequential(config);
+    config.stage1Threads = 4;
+    DecimationPipeline parallel(config);
+
+    std::mt19937 rng(851);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    std::size_t frames = 0;
+    for (int block = 0; block < 20; ++block) {
+        SampleVector input(16384 + static_cast<std::size_t>(block) * 13);
+        for (auto &sample : input) {
+            sample = {noise(rng), noise(rng)};
+        }
+        auto parallelInput = input;
+        (void)sequential.process(input);
+        (void)parallel.process(parallelInput);
+        while (sequential.frameReady()) {
+            if (!parallel.frameReady()) {
+                throw std::runtime_error("Parallel pipeline missed a frame");
+            }
+            const auto *expected = sequential.frame();
+            const auto *actual = parallel.frame();
+            if (!std::equal(expected + 1, expected + config.frameSamples,
+                            actual + 1)) {
+                throw std::runtime_error("Parallel stage 1 is not bit-exact");
+            }
+            sequential.consumeFrame();
+            parallel.consumeFrame();
+            ++frames;
+        }
+    }
+    if (frames == 0 || parallel.frameReady()) {
+        throw std::runtime_error("Parallel pipeline frame count differs");
+    }
+
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--stage1-threads";
+    char arg2[] = "2";
+    char arg3[] = "--workers";
+    char arg4[] = "2";
+    char *argv[] = {arg0, arg1, arg2, arg3, arg4};
+    bool threw = false;
+    try {
+        (void)parseArgs(5, argv);
+    } catch (const ArgsError &) {
+        threw = true;
+    }
+    if (!threw || parseArgs(3, argv).stage1Threads != 2) {
+        throw std::runtime_error(
+            "--stage1-threads above 1 should exclude --workers");
+    }
+}
+
+void testFrameAssemblerContiguousFrames() {
+    constexpr std::size_t payload = 700;
+    FrameAssembler assembler(payload);
+    float next = 0.0f;
+    float expected = 0.0f;
+    uint32_t frames = 0;
+    for (int block = 0; block < 40; ++block) {
+        std::vector<std::complex<float>> samples(333 + block * 17);
+        for (auto &sample : samples) {
+            sample = {next, -next};
+            next += 1.0f;
+        }
+        assembler.append(samples);
+        while (assembler.frameReady()) {
+            const std::complex<float> header{static_cast<float>(frames), 0.5f};
+            const auto *frame = assembler.frame(header);
+            if (frame[0] != header) {
+                throw std::runtime_error("FrameAssembler header mismatch");
+            }
+            for (std::size_t index = 1; index <= payload; ++index) {
+                if (frame[index] != std::complex<float>(expected, -expected)) {
+                    throw std::runtime_error(
+                        "FrameAssembler payload not contiguous in order");
+                }
+                expected += 1.0f;
+            }
+            assembler.consumeFrame();
+            ++frames;
+        }
+    }
+    if (frames == 0 || assembler.size() >= payload) {
+        throw std::runtime_error("FrameAssembler did not drain frames");
+    }
+    const auto remaining = assembler.contents();
+    if (remaining.size() != assembler.size() ||
+        (!remaining.empty() &&
+         remaining.front() != std::complex<float>(expected, -expected))) {
+        throw std::runtime_error("FrameAssembler contents mismatch");
+    }
+}
+
+void testFixedPointChainSnrVersusFloat() {
+    constexpr double inputRateHz = 768000.0;
+    constexpr double shiftHz = 10000.0;
+    constexpr std::size_t sampleCount = 768000 / 5;
+    std::vector<std::complex<float>> samples(sampleCount);
+    std::mt19937 rng(5);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    for (std::size_t index = 0; index < sampleCount; ++index) {
+        const double phase = kTwoPi * -9000.0 * static_cast<double>(index) /
+                             inputRateHz;
+        samples[index] = {0.3f * static_cast<float>(std::cos(phase)) +
+                              noise(rng),
+                          0.3f * static_cast<float>(std::sin(phase)) +
+                              noise(rng)};
+    }
+    const auto payload = makeIqPayload(samples);
+
+    SampleVector floatInput;
+    convertToComplex(payload.data(), payload.size(), floatInput);
+    FrequencyShifter shifter(inputRateHz, shiftHz);
+    FirDecimator stage1(8, 8 * 16, 0.45f / 8.0f);
+    FirDecimator stage2(5, 5 * 16, 0.45f / 5.0f);
+    FirDecimator stage3(5, 5 * 16, 0.45f / 5.0f);
+    shifter.mix(floatInput);
+    const auto floatOutput =
+        stage3.process(stage2.process(stage1.process(floatInput)));
+
+    SampleBuffer<ci16> fixedInput;
+    convertToComplex(payload.data(), payload.size(), fixedInput);
+    FixedPointChain chain(inputRateHz, shiftHz);
+    chain.shifter.mix(fixedInput);
+    const auto fixedOutput = toFloatSamples(chain.stage3.process(
+        chain.stage2.process(chain.stage1.process(fixedInput))));
+
+    if (fixedOutput.size() != floatOutput.size() || floatOutput.empty()) {
+        throw std::runtime_error("Fixed-point output count mismatch");
+    }
+    double signal = 0.0;
+    double error = 0.0;
+    for (std::size_t index = 0; index < floatOutput.size(); ++index) {
+        signal += std::norm(floatOutput[index]);
+        error += std::norm(fixedOutput[index] - floatOutput[index]);
+    }
+    const double snrDb = 10.0 * std::log10(signal / error);
+    std::cout << "[INFO] fixed-point chain SNR vs float path: " << snrDb
+              << " dB\n";
+    if (snrDb < 55.0) {
+        throw std::runtime_error(
+            "Fixed-point chain SNR versus float path is too low");
+    }
+}
+
+void testIntegerNcoMatchesFloatShift() {
+    constexpr double sampleRateHz = 96000.0;
+    constexpr double toneHz = 5000.0;
+    constexpr std::size_t sampleCount = 4096;
+    SampleBuffer<ci16> up(sampleCount);
+    for (std::size_t index = 0; index < sampleCount; ++index) {
+        const double phase =
+            kTwoPi * toneHz * static_cast<double>(index) / sampleRateHz;
+        up[index] = SampleTraits<ci16>::fromFloat(
+            0.5f * static_cast<float>(std::cos(phase)),
+            0.5f * static_cast<float>(std::sin(phase)));
+    }
+    auto down = up;
+
+    IntegerNcoShifter shiftUp(sampleRateHz, 2000.0);
+    IntegerNcoShifter shiftDown(sampleRateHz, -2000.0);
+    shiftUp.mix(up);
+    shiftDown.mix(down);
+
+    const auto upFloat = toFloatSamples(up);
+    const double upHz = estimateToneFrequencyHz(
+        std::vector<std::complex<float>>(upFloat.begin(), upFloat.end()),
+        sampleRateHz);
+    const auto downFloat = toFloatSamples(down);
+    const double downHz = estimateToneFrequencyHz(
+        std::vector<std::complex<float>>(downFloat.begin(), downFloat.end()),
+        sampleRateHz);
+    if (std::abs(upHz - 7000.0) > 60.0 || std::abs(downHz - 3000.0) > 60.0) {
+        throw std::runtime_error(
+            "IntegerNcoShifter should follow the float shift sign convention");
+    }
+}
+
+void testSaturatingQ15FullScale() {
+    SampleBuffer<ci16> input(4000, ci16{32767, -32768});
+    FixedFirDecimator decimator(8, 8 * 16, 0.45f / 8.0f);
+    const auto output = decimator.process(input);
+    const ci16 settled = output.back();
+    if (settled.i < 32000 || settled.q > -32000) {
+        throw std::runtime_error(
+            "Full-scale DC should saturate near full scale, not wrap");
+    }
+}
+
+void testFirDecimatorCheckpointContinuity() {
+    std::vector<std::complex<float>> input(997);
+    for (std::size_t index = 0; index < input.size(); ++index) {
+        const double phase = 0.01 * static_cast<double>(index * index);
+        input[index] = {static_cast<float>(std::cos(phase)),
+                        static_cast<float>(std::sin(phase))};
+    }
+    const std::vector<std::complex<float>> head(input.begin(),
+                                                input.begin() + 413);
+    const std::vector<std::complex<float>> tail(input.begin() + 413,
+                                                input.end());
+
+    FirDecimator reference(5, 5 * 16, 0.45f / 5.0f);
+    auto expected = reference.process(head);
+    const auto expectedTail = reference.process(tail);
+    expected.insert(expected.end(), expectedTail.begin(), expectedTail.end());
+
+    FirDecimator before(5, 5 * 16, 0.45f / 5.0f);
+    auto actual = before.process(head);
+    StateWriter writer;
+    before.save(writer);
+
+    FirDecimator after(5, 5 * 16, 0.45f / 5.0f);
+    StateReader reader(writer.bytes());
+    after.restore(reader);
+    const auto actualTail = after.process(tail);
+    actual.insert(actual.end(), actualTail.begin(), actualTail.end());
+
+    if (actual != expected) {
+        throw std::runtime_error(
+            "Restored FirDecimator should continue bit-exactly");
+    }
+
+    FirDecimator mismatched(8, 8 * 16, 0.45f / 8.0f);
+    StateReader mismatchedReader(writer.bytes());
+    bool threw = false;
+    try {
+        mismatched.restore(mismatchedReader);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error(
+            "Restoring into a different FIR design should fail");
+    }
+}
+
+void testCheckpointFileRoundTrip() {
+    char pathTemplate[] = "/tmp/airspyhf_decimator_stateXXXXXX";
+    const int fd = ::mkstemp(pathTemplate);
+    if (fd < 0) {
+        throw std::runtime_error("Failed creating temporary state file");
+    }
+    ::close(fd);
+    const std::string path(pathTemplate);
+
+    PipelineConfig config;
+    config.inputRate = 768000.0;
+    config.shiftHz = 10000.0;
+    config.frameSamples = 65;
+    DecimationPipeline pipeline(config);
+    SampleVector input(20000, {0.5f, -0.25f});
+    (void)pipeline.process(input);
+    (void)pipeline.frame();
+    pipeline.consumeFrame();
+
+    PipelineCheckpoint saved;
+    saved.inputRate = 768000.0;
+    saved.prevSequence = 99;
+    saved.haveSequence = true;
+    saved.lastZmqTimestampUs = 123456789ULL;
+    saved.lastPacketSamples = 20000;
+    saveCheckpoint(path, saved, pipeline);
+
+    PipelineCheckpoint restored;
+    std::unique_ptr<DecimationPipeline> restoredPipeline;
+    config.inputRate = 0.0;
+    const bool loaded =
+        loadCheckpoint(path, 0.0, config, restored, restoredPipeline);
+    std::remove(path.c_str());
+
+    if (!loaded || !restoredPipeline ||
+        restored.inputRate != saved.inputRate ||
+        restored.prevSequence != saved.prevSequence ||
+        !restored.haveSequence ||
+        restored.lastZmqTimestampUs != saved.lastZmqTimestampUs ||
+        restored.lastPacketSamples != saved.lastPacketSamples ||
+        restoredPipeline->samplesSent() != pipeline.samplesSent() ||
+        restoredPipeline->bufferedSamples() != pipeline.bufferedSamples()) {
+        throw std::runtime_error("Checkpoint stream fields mismatch");
+    }
+
+    SampleVector more(20000, {0.5f, -0.25f});
+    auto moreRestored = more;
+    (void)pipeline.process(more);
+    (void)restoredPipeline->process(moreRestored);
+    std::size_t frames = 0;
+    while (pipeline.frameReady() && restoredPipeline->frameReady()) {
+        const auto *original = pipeline.frame();
+        const auto *resumed = restoredPipeline->frame();
+        if (extractTimeNs(original[0]) != extractTimeNs(resumed[0])) {
+            throw std::runtime_error(
+                "Restored pipeline should keep its wall-clock anchor");
+        }
+        if (!std::equal(original + 1, original + config.frameSamples,
+                        resumed + 1)) {
+            throw std::runtime_error("Restored pipeline output diverged");
+        }
+        pipeline.consumeFrame();
+        restoredPipeline->consumeFrame();
+        ++frames;
+    }
+    if (frames == 0 || pipeline.frameReady() ||
+        restoredPipeline->frameReady()) {
+        throw std::runtime_error("Restored pipeline frame count diverged");
+    }
+}
+
+void testCApiMatchesPipeline() {
+    airspyhf_decim_config config;
+    airspyhf_decim_config_init(&config);
+    airspyhf_decim *decim = nullptr;
+    if (airspyhf_decim_create(&config, &decim) !=
+            AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT ||
+        decim != nullptr) {
+        throw std::runtime_error("Create without an input rate should fail");
+    }
+
+    config.input_rate_hz = 768000.0;
+    config.shift_hz = -25000.0;
+    config.frame_samples = 65;
+    config.max_pending_frames = 4;
+    if (airspyhf_decim_create(&config, &decim) != AIRSPYHF_DECIM_OK) {
+        throw std::runtime_error("Create with a valid config failed");
+    }
+    std::unique_ptr<airspyhf_decim, void (*)(airspyhf_decim *)> handle(
+        decim, airspyhf_decim_destroy);
+
+    PipelineConfig pipelineConfig;
+    pipelineConfig.inputRate = config.input_rate_hz;
+    pipelineConfig.shiftHz = config.shift_hz;
+    pipelineConfig.frameSamples = config.frame_samples;
+    DecimationPipeline reference(pipelineConfig);
+
+    std::vector<float> iq(2 * 16000);
+    for (std::size_t n = 0; n < iq.size() / 2; ++n) {
+        const double phase = kTwoPi * 31000.0 * static_cast<double>(n) /
+                             config.input_rate_hz;
+        iq[2 * n] = static_cast<float>(0.5 * std::cos(phase));
+        iq[2 * n + 1] = static_cast<float>(0.5 * std::sin(phase));
+    }
+    SampleVector referenceInput(iq.size() / 2);
+    std::memcpy(static_cast<void *>(referenceInput.data()), iq.data(),
+                iq.size() * sizeof(float));
+
+    std::vector<float> frame(2 * config.frame_samples);
+    if (airspyhf_decim_push(decim, iq.data(), iq.size() / 2) !=
+        AIRSPYHF_DECIM_OK) {
+        throw std::runtime_error("Push failed");
+    }
+    (void)reference.process(referenceInput);
+    if (airspyhf_decim_pull_frame(decim, frame.data(), 8) !=
+        AIRSPYHF_DECIM_ERROR_BUFFER_TOO_SMALL) {
+        throw std::runtime_error("Short output buffer should be rejected");
+    }
+    std::size_t pulled = 0;
+    while (airspyhf_decim_pull_frame(decim, frame.data(),
+                                     config.frame_samples) == 1) {
+        if (!reference.frameReady()) {
+            throw std::runtime_error("C API produced an extra frame");
+        }
+        const auto *expected = reference.frame();
+        if (std::memcmp(frame.data() + 2, expected + 1,
+                        (config.frame_samples - 1) * 2 * sizeof(float)) != 0) {
+            throw std::runtime_error("C API frame payload differs");
+        }
+        reference.consumeFrame();
+        ++pulled;
+    }
+    if (pulled == 0 || reference.frameReady()) {
+        throw std::runtime_error("C API frame count differs");
+    }
+
+    for (int block = 0; block < 4; ++block) {
+        (void)airspyhf_decim_push(decim, iq.data(), iq.size() / 2);
+    }
+    airspyhf_decim_stats stats{};
+    stats.struct_size = sizeof(stats);
+    if (airspyhf_decim_get_stats(decim, &stats) != AIRSPYHF_DECIM_OK) {
+        throw std::runtime_error("Stats query failed");
+    }
+    if (stats.input_samples != 5U * 16000U || stats.output_samples != 400U ||
+        stats.frames_pulled != pulled || stats.pending_frames != 4U ||
+        stats.frames_dropped == 0U) {
+        throw std::runtime_error("C API stats mismatch");
+    }
+
+    // A caller built against the first layout: its struct_size stops
+    // before the appended fields, which take their defaults.
+    airspyhf_decim_config v1Config = config;
+    v1Config.struct_size = AIRSPYHF_DECIM_CONFIG_V1_SIZE;
+    // Not part of a version 1 struct: ignored, one stage-1 thread is used.
+    v1Config.stage1_threads = 0;
+    airspyhf_decim *v1Decim = nullptr;
+    if (airspyhf_decim_create(&v1Config, &v1Decim) != AIRSPYHF_DECIM_OK) {
+        throw std::runtime_error("A first-layout config should be accepted");
+    }
+    airspyhf_decim_destroy(v1Decim);
+    if (airspyhf_decim_api_version() != AIRSPYHF_DECIM_API_VERSION) {
+        throw std::runtime_error("Library and header API versions differ");
+    }
+    v1Config.struct_size = AIRSPYHF_DECIM_CONFIG_V1_SIZE - 1;
+    if (airspyhf_decim_create(&v1Config, &v1Decim) !=
+        AIRSPYHF_DECIM_ERROR_INVALID_ARGUMENT) {
+        throw std::runtime_error("A truncated config should be rejected");
+    }
+    airspyhf_decim_stats v1Stats{};
+    v1Stats.struct_size = AIRSPYHF_DECIM_STATS_V1_SIZE;
+    if (airspyhf_decim_get_stats(decim, &v1Stats) != AIRSPYHF_DECIM_OK ||
+        v1Stats.input_samples != stats.input_samples) {
+        throw std::runtime_error("First-layout stats query failed");
+    }
+}
+
+void testWorkStealingPreservesChannelOrder() {
+    constexpr std::size_t channelCount = 6;
+    constexpr std::size_t blocksPerChannel = 200;
+    std::vector<std::vector<std::size_t>> seen(channelCount);
+    {
+        WorkStealingScheduler scheduler(4);
+        std::vector<std::unique_ptr<TaskStrand>> strands;
+        for (std::size_t channel = 0; channel < channelCount; ++channel) {
+            strands.push_back(std::make_unique<TaskStrand>(scheduler, 8));
+        }
+        for (std::size_t block = 0; block < blocksPerChannel; ++block) {
+            for (std::size_t channel = 0; channel < channelCount; ++channel) {
+                strands[channel]->post([&seen, channel, block] {
+                    // Uneven per-channel cost, as with different tap counts.
+                    volatile double sink = 0.0;
+                    for (std::size_t k = 0; k < 200 * (channel + 1); ++k) {
+                        sink = sink + static_cast<double>(k);
+                    }
+                    seen[channel].push_back(block);
+                });
+            }
+        }
+        scheduler.waitIdle();
+
+        uint64_t tasks = 0;
+        for (const auto &worker : scheduler.stats()) {
+            tasks += worker.tasks;
+        }
+        if (tasks != channelCount * blocksPerChannel) {
+            throw std::runtime_error("Scheduler task count mismatch");
+        }
+
+        // Tasks spawned on one worker land in its deque; idle workers must
+        // steal them.
+        std::atomic<int> done{0};
+        scheduler.submit([&scheduler, &done] {
+            for (int task = 0; task < 32; ++task) {
+                scheduler.submit([&done] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    done.fetch_add(1);
+                });
+            }
+        });
+        scheduler.waitIdle();
+        uint64_t steals = 0;
+        for (const auto &worker : scheduler.stats()) {
+            steals += worker.steals;
+        }
+        if (done.load() != 32 || steals == 0) {
+            throw std::runtime_error("Idle workers should steal queued tasks");
+        }
+    }
+
+    for (const auto &blocks : seen) {
+        if (blocks.size() != blocksPerChannel) {
+            throw std::runtime_error("Channel lost blocks");
+        }
+        for (std::size_t index = 0; index < blocks.size(); ++index) {
+            if (blocks[index] != index) {
+                throw std::runtime_error("Channel blocks ran out of order");
+            }
+        }
+    }
+}
+
+void testTaskStrandRethrows() {
+    WorkStealingScheduler scheduler(2);
+    TaskStrand strand(scheduler, 4);
+    strand.post([] { throw std::runtime_error("channel failed"); });
+    scheduler.waitIdle();
+    bool threw = false;
+    try {
+        strand.rethrowIfFailed();
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("TaskStrand should surface job exceptions");
+    }
+    strand.rethrowIfFailed();
+}
+
+// Binds a UDP socket on an ephemeral loopback port.
+int bindLoopbackUdp(uint16_t &port, int receiveBufferBytes) {
+    const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create test UDP socket");
+    }
+    (void)::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferBytes,
+                       sizeof(receiveBufferBytes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) !=
+            0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &length) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to bind test UDP socket");
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+void testUdpStreamerPerDestinationCounters() {
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--udp-sndbuf";
+    char arg2[] = "65536";
+    char *argv[] = {arg0, arg1, arg2};
+    if (parseArgs(3, argv).udpSendBufferBytes != 65536 ||
+        parseArgs(1, argv).udpSendBufferBytes != 0) {
+        throw std::runtime_error("--udp-sndbuf parse mismatch");
+    }
+
+    // One consumer reads; the other never does and has a tiny buffer.
+    uint16_t readerPort = 0;
+    uint16_t stalledPort = 0;
+    const int reader = bindLoopbackUdp(readerPort, 1 << 20);
+    const int stalled = bindLoopbackUdp(stalledPort, 1);
+    constexpr std::size_t kFrames = 16;
+    const std::vector<std::complex<float>> frame(1024, {0.25f, -0.5f});
+    std::size_t received = 0;
+    std::vector<UdpDestinationStats> stats;
+    int sendBuffer = 0;
+    {
+        UdpStreamer streamer("127.0.0.1", {readerPort, stalledPort}, 65536);
+        sendBuffer = streamer.sendBufferBytes();
+        for (std::size_t index = 0; index < kFrames; ++index) {
+            streamer.send(frame);
+        }
+        stats = streamer.destinationStats();
+    }
+    std::vector<char> datagram(frame.size() * sizeof(frame[0]) + 1);
+    while (::recv(reader, datagram.data(), datagram.size(), MSG_DONTWAIT) ==
+           static_cast<ssize_t>(frame.size() * sizeof(frame[0]))) {
+        ++received;
+    }
+    ::close(reader);
+    ::close(stalled);
+
+    if (sendBuffer < 65536) {
+        throw std::runtime_error("--udp-sndbuf was not applied");
+    }
+    if (stats.size() != 2 || stats[0].port != readerPort ||
+        stats[1].port != stalledPort) {
+        throw std::runtime_error("UDP destination stats ports mismatch");
+    }
+    for (const auto &destination : stats) {
+        if (destination.sent + destination.wouldBlock != kFrames ||
+            destination.errors != 0 || destination.partial != 0) {
+            throw std::runtime_error("UDP destination counters mismatch");
+        }
+    }
+    if (received != stats[0].sent || received == 0) {
+        throw std::runtime_error(
+            "Reader port should receive every frame counted as sent");
+    }
+}
+
+void testPerPortFramesShareOneRing() {
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--channel";
+    char arg2[] = "-25@11000/33,11001,11002/33";
+    char arg3[] = "--frame";
+    char arg4[] = "129";
+    char *argv[] = {arg0, arg1, arg2, arg3, arg4};
+    const Options parsed = parseArgs(5, argv);
+    const ChannelSpec &parsedSpec = parsed.channels.front();
+    if (parsedSpec.frameSamples != std::vector<std::size_t>{33, 0, 33} ||
+        formatChannelSpec(parsedSpec) != "-25@11000/33,11001,11002/33" ||
+        portFrameOutputs(parsedSpec, 129) !=
+            std::vector<std::size_t>{1, 0, 1}) {
+        throw std::runtime_error("Per-port frame sizes parsed incorrectly");
+    }
+
+    // Output 0 frames 129 samples; ports with /33 take output 1, and a
+    // 1025-sample output holds the slowest reader back.
+    uint16_t bigPort = 0;
+    uint16_t smallPort = 0;
+    const int big = bindLoopbackUdp(bigPort, 1 << 20);
+    const int small = bindLoopbackUdp(smallPort, 1 << 20);
+    Options opts;
+    opts.packetSamples = 129;
+    ChannelSpec spec;
+    spec.shiftKhz = 10.0;
+    spec.ports = {bigPort, smallPort, 9};
+    spec.frameSamples = {0, 33, 1025};
+    Channel channel(opts, spec);
+    PipelineConfig config;
+    config.inputRate = 768000.0;
+    config.shiftHz = 10000.0;
+    config.frameSamples = 129;
+    config.extraFrameSamples = extraFrameSamples(spec, 129);
+    channel.pipeline = std::make_unique<DecimationPipeline>(config);
+    channel.pipeline->anchorTimestamps(1'000'000'000'000'000'000ULL);
+    PipelineConfig single = config;
+    single.frameSamples = 33;
+    single.extraFrameSamples.clear();
+    DecimationPipeline reference(single);
+    reference.anchorTimestamps(1'000'000'000'000'000'000ULL);
+
+    std::mt19937 rng(98);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    std::vector<SampleVector> expected;
+    for (int block = 0; block < 8; ++block) {
+        SampleVector input(16384);
+        for (auto &sample : input) {
+            sample = {noise(rng), noise(rng)};
+        }
+        SampleVector referenceInput = input;
+        runChannelBlock(channel, input, nullptr, SpectrumSource::Stage3);
+        (void)reference.process(referenceInput);
+        while (reference.frameReady()) {
+            const std::complex<float> *frame = reference.frame();
+            expected.emplace_back(frame, frame + 33);
+            reference.consumeFrame();
+        }
+    }
+
+    std::vector<std::complex<float>> datagram(1025);
+    std::size_t bigFrames = 0;
+    while (::recv(big, datagram.data(), datagram.size() * sizeof(datagram[0]),
+                  MSG_DONTWAIT) ==
+           static_cast<ssize_t>(129 * sizeof(datagram[0]))) {
+        ++bigFrames;
+    }
+    std::size_t smallFrames = 0;
+    ssize_t got = 0;
+    while ((got = ::recv(small, datagram.data(),
+                         datagram.size() * sizeof(datagram[0]),
+                         MSG_DONTWAIT)) > 0) {
+        if (got != static_cast<ssize_t>(33 * sizeof(datagram[0])) ||
+            smallFrames >= expected.size() ||
+            std::memcmp(datagram.data(), expected[smallFrames].data(),
+                        static_cast<std::size_t>(got)) != 0) {
+            throw std::runtime_error(
+                "Small frame differs from a single-output pipeline");
+        }
+        ++smallFrames;
+    }
+    ::close(big);
+    ::close(small);
+    const uint64_t outputs = channel.pipeline->outputSamples();
+    if (bigFrames != outputs / 128 || smallFrames != outputs / 32 ||
+        smallFrames != expected.size()) {
+        throw std::runtime_error("Per-port frame counts mismatch");
+    }
+}
+
+void testUdpTxTimestampLatencyHistogram() {
+    LatencyHistogram histogram;
+    histogram.record(0);
+    histogram.record(1500);
+    histogram.record(1500);
+    histogram.record(3'000'000);
+    const auto snapshot = histogram.snapshot();
+    if (snapshot.samples != 4 || snapshot.counts[0] != 1 ||
+        snapshot.counts[1] != 2 || snapshot.quantileUs(0.5) != 2 ||
+        snapshot.quantileUs(1.0) != 4096 || snapshot.maxNs != 3'000'000) {
+        throw std::runtime_error("LatencyHistogram bucket mismatch");
+    }
+
+    uint16_t port = 0;
+    const int reader = bindLoopbackUdp(port, 1 << 20);
+    const std::vector<std::complex<float>> frame(256, {0.5f, 0.5f});
+    LatencyHistogram::Snapshot latency;
+    {
+        UdpStreamer streamer("127.0.0.1", {port}, 0, 2);
+        for (std::size_t index = 0; index < 32; ++index) {
+            streamer.send(frame.data(), frame.size(), realtimeNs());
+        }
+        latency = streamer.txLatency();
+    }
+    ::close(reader);
+    if (latency.samples == 0 || latency.samples > 16) {
+        throw std::runtime_error("TX timestamps should be sampled");
+    }
+    if (latency.maxNs > 1'000'000'000LL) {
+        throw std::runtime_error("Loopback TX latency is implausible");
+    }
+
+    // With every timestamp discarded, the pending one is given up on after
+    // kTimestampGiveUpFrames further frames, and sampling resumes.
+    const int lossReader = bindLoopbackUdp(port, 1 << 20);
+    const std::vector<std::complex<float>> small(4, {0.5f, 0.5f});
+    uint64_t lost = 0;
+    uint64_t framesToLoss = 0;
+    {
+        UdpStreamer streamer("127.0.0.1", {port}, 0, 1);
+        while (streamer.txTimestampsLost() == 0 && framesToLoss < 1100) {
+            streamer.discardTxTimestamps();
+            streamer.send(small.data(), small.size(), realtimeNs());
+            ++framesToLoss;
+        }
+        lost = streamer.txTimestampsLost();
+        // The send that gave up timed a fresh frame; let its timestamp in.
+        for (std::size_t index = 0; index < 4; ++index) {
+            streamer.send(small.data(), small.size(), realtimeNs());
+        }
+        latency = streamer.txLatency();
+    }
+    ::close(lossReader);
+    // The timed first frame, more than 1000 frames past it, then the send
+    // whose poll gives up.
+    if (lost != 1 || framesToLoss != 1003) {
+        throw std::runtime_error("A lost TX timestamp should be counted "
+                                 "after the give-up window, frames=" +
+                                 std::to_string(framesToLoss));
+    }
+    if (latency.samples == 0) {
+        throw std::runtime_error("TX sampling should resume after a loss");
+    }
+}
+
+void testFlushDenormalsPropagatesToPools() {
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--denormals";
+    char arg2[] = "ieee";
+    char *argv[] = {arg0, arg1, arg2};
+    if (parseArgs(3, argv).flushDenormals || !parseArgs(1, argv).flushDenormals) {
+        throw std::runtime_error("--denormals parse mismatch");
+    }
+    if (!flushDenormalsSupported()) {
+        return;
+    }
+
+    const bool previous = flushDenormalsEnabled();
+    volatile float subnormal = 1e-39f;
+    for (const bool flush : {true, false}) {
+        setFlushDenormals(flush);
+        if ((subnormal * 0.5f == 0.0f) != flush) {
+            throw std::runtime_error("FTZ/DAZ mode not applied to arithmetic");
+        }
+        ForkJoinPool pool(3);
+        std::atomic<int> mismatches{0};
+        for (int loop = 0; loop < 8; ++loop) {
+            pool.run(6, [&](std::size_t) {
+                if (flushDenormalsEnabled() != flush) {
+                    ++mismatches;
+                }
+            });
+        }
+        WorkStealingScheduler scheduler(2);
+        for (int task = 0; task < 8; ++task) {
+            scheduler.submit([&] {
+                if (flushDenormalsEnabled() != flush) {
+                    ++mismatches;
+                }
+            });
+        }
+        scheduler.waitIdle();
+        if (mismatches.load() != 0) {
+            setFlushDenormals(previous);
+            throw std::runtime_error(
+                "Pool threads should inherit the caller's FTZ/DAZ mode");
+        }
+    }
+    setFlushDenormals(previous);
+}
+
+void testPacketFlagsBlankAndRestart() {
+    char arg0[] = "airspyhf_decimator";
+    char arg1[] = "--packet-flags";
+    char *argv[] = {arg0, arg1};
+    if (!parseArgs(2, argv).packetFlags || parseArgs(1, argv).packetFlags) {
+        throw std::runtime_error("--packet-flags parse mismatch");
+    }
+    ZmqPacket flagged;
+    bool logged = false;
+    flagged.flags = kZmqFlagOverflow | kZmqFlagRetune;
+    applyPacketFlagPolicy(true, flagged, logged);
+    if (flagged.flags != (kZmqFlagOverflow | kZmqFlagRetune) || logged) {
+        throw std::runtime_error("Opted-in packet flags were altered");
+    }
+    applyPacketFlagPolicy(false, flagged, logged);
+    if (flagged.flags != 0U || !logged) {
+        throw std::runtime_error("Packet flags should be ignored by default");
+    }
+
+    PipelineConfig config;
+    config.inputRate = 768000.0;
+    config.shiftHz = 10000.0;
+    config.frameSamples = 129;
+    DecimationPipeline blanked(config);
+    DecimationPipeline reference(config);
+
+    std::mt19937 rng(95);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    SampleVector input(16384);
+    for (auto &sample : input) {
+        sample = {noise(rng), noise(rng)};
+    }
+    auto referenceInput = input;
+    (void)blanked.process(input);
+    (void)reference.process(referenceInput);
+
+    // An overflowed packet yields as many outputs as a filtered one.
+    SampleVector overflowPacket(16384 + 7);
+    const std::size_t expected = reference.process(overflowPacket).size();
+    if (blanked.blankInput(overflowPacket.size()) != expected ||
+        blanked.outputSamples() != reference.outputSamples() ||
+        blanked.inputSamples() != reference.inputSamples()) {
+        throw std::runtime_error("blankInput output count differs");
+    }
+
+    // Silence after the blank leaves no filter transient.
+    SampleVector silence(4096);
+    for (const auto &sample : blanked.process(silence)) {
+        if (sample != std::complex<float>{}) {
+            throw std::runtime_error("blankInput left a filter transient");
+        }
+    }
+
+    input.assign(16384, {0.5f, -0.5f});
+    (void)blanked.process(input);
+    const std::size_t partial = blanked.bufferedSamples();
+    const uint64_t sentBefore = blanked.samplesSent();
+    if (partial == 0 || blanked.restartAtDiscontinuity() != partial ||
+        blanked.bufferedSamples() != 0 ||
+        blanked.samplesSent() != sentBefore + partial) {
+        throw std::runtime_error(
+            "restartAtDiscontinuity should drop the partial frame");
+    }
+    // With nothing buffered the timeline stays on the real sample count.
+    const uint64_t sentAfter = blanked.samplesSent();
+    if (blanked.restartAtDiscontinuity() != 0 ||
+        blanked.samplesSent() != sentAfter) {
+        throw std::runtime_error("Retune moved the timeline");
+    }
+    silence.assign(4096, {});
+    for (const auto &sample : blanked.process(silence)) {
+        if (sample != std::complex<float>{}) {
+            throw std::runtime_error("Retune left filter history behind");
+        }
+    }
+}
+
+void testDriftCompensationLocksToReferenceClock() {
+    // A sample clock 200 ppm fast against jittery packet timestamps: the
+    // output must run at the nominal rate of the timestamp clock.
+    constexpr double nominalRate = 48000.0;
+    constexpr double driftPpm = 200.0;
+    constexpr double actualRate = nominalRate * (1.0 + driftPpm * 1e-6);
+    constexpr double toneHz = 20.0;
+    constexpr std::size_t packetSamples = 4800;
+    constexpr std::size_t packets = 2000;
+    PipelineConfig config;
+    config.inputRate = nominalRate;
+    config.shiftHz = 0.0;
+    config.frameSamples = 65;
+    config.driftCompensation = true;
+    DecimationPipeline pipeline(config);
+
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<double> jitterUs(-500.0, 500.0);
+    const uint64_t startUs = 1'700'000'000'000'000ULL;
+    std::vector<std::complex<float>> output;
+    SampleVector input(packetSamples);
+    uint64_t sampleIndex = 0;
+    for (std::size_t packet = 0; packet < packets; ++packet) {
+        const double referenceSec =
+            static_cast<double>(sampleIndex) / actualRate;
+        pipeline.observeReferenceTime(
+            startUs + static_cast<uint64_t>(referenceSec * 1e6 +
+                                            jitterUs(rng)),
+            true);
+        for (std::size_t index = 0; index < packetSamples; ++index) {
+            // The tone is 20 Hz in the reference clock.
+            const double phase = kTwoPi * toneHz *
+                                 std::fmod(static_cast<double>(sampleIndex +
+                                                               index) /
+                                               actualRate,
+                                           1.0 / toneHz);
+            input[index] = std::polar(0.5f, static_cast<float>(phase));
+        }
+        sampleIndex += packetSamples;
+        const SampleVector &block = pipeline.process(input);
+        output.insert(output.end(), block.begin(), block.end());
+    }
+
+    const DriftCompensator *drift = pipeline.driftCompensator();
+    if (drift == nullptr || !drift->locked() ||
+        std::abs(drift->driftPpm() - driftPpm) > 5.0 ||
+        std::abs(drift->timeErrorUs()) > 100.0) {
+        throw std::runtime_error("Drift compensator did not lock");
+    }
+
+    // Uncompensated, the output would be 200 ppm long: 7.7 samples here.
+    const double outputRate = nominalRate / kTotalDecimation;
+    const double referenceSeconds =
+        static_cast<double>(sampleIndex) / actualRate;
+    if (std::abs(static_cast<double>(output.size()) -
+                 referenceSeconds * outputRate) > 3.0) {
+        throw std::runtime_error("Drift-compensated output count is off");
+    }
+
+    // Measured over the last 100 s, where it would read 20.004 Hz.
+    const std::size_t span = static_cast<std::size_t>(100.0 * outputRate);
+    double phase = 0.0;
+    for (std::size_t index = output.size() - span; index < output.size();
+         ++index) {
+        phase += std::arg(output[index] * std::conj(output[index - 1]));
+    }
+    const double measuredHz = phase * outputRate / (kTwoPi * span);
+    if (std::abs(measuredHz - toneHz) > 0.0005) {
+        throw std::runtime_error("Drift-compensated tone frequency is off: " +
+                                 std::to_string(measuredHz));
+    }
+}
+
+void testResumeGapOutputSamples() {
+    constexpr double inputRate = 768000.0;
+    constexpr uint64_t packetSamples = 16384;
+    const uint64_t lastUs = 1'000'000'000ULL;
+    const uint64_t nextUs =
+        lastUs + static_cast<uint64_t>(packetSamples * 1e6 / inputRate);
+
+    if (resumeGapOutputSamples(lastUs, packetSamples, inputRate, nextUs) !=
+        0U) {
+        throw std::runtime_error("Contiguous resume should report no gap");
+    }
+    if (resumeGapOutputSamples(lastUs, packetSamples, inputRate, lastUs) !=
+        0U) {
+        throw std::runtime_error("Earlier resume timestamp should clamp to 0");
+    }
+
+    const uint64_t twoSecondsLater = nextUs + 2'000'000ULL;
+    const uint64_t gap = resumeGapOutputSamples(lastUs, packetSamples,
+                                                inputRate, twoSecondsLater);
+    if (gap < 7679U || gap > 7681U) {
+        throw std::runtime_error(
+            "Two-second resume gap should map to 7680 output samples");
+    }
+
+    // Skipping a gap leaves the mixer where it would be had the missing
+    // input been mixed, and starts the filters afresh.
+    PipelineConfig config;
+    config.inputRate = inputRate;
+    config.shiftHz = 10000.0;
+    config.frameSamples = 129;
+    DecimationPipeline skipped(config);
+    DecimationPipeline reference(config);
+    constexpr std::size_t gapOutputs = 40;
+    std::mt19937 rng(77);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    SampleVector input(16000);
+    for (auto &sample : input) {
+        sample = {noise(rng), noise(rng)};
+    }
+    auto referenceInput = input;
+    (void)skipped.process(input);
+    (void)reference.process(referenceInput);
+    referenceInput.assign(gapOutputs * 200, {});
+    (void)reference.process(referenceInput);
+    const uint64_t timelineBefore =
+        skipped.samplesSent() + skipped.bufferedSamples();
+    const uint64_t discarded = skipped.skipGap(gapOutputs);
+    if (skipped.samplesSent() != timelineBefore + gapOutputs ||
+        discarded == 0 || skipped.bufferedSamples() != 0) {
+        throw std::runtime_error("skipGap moved the timeline wrongly");
+    }
+    SampleVector silence(4096);
+    for (const auto &sample : skipped.process(silence)) {
+        if (sample != std::complex<float>{}) {
+            throw std::runtime_error("skipGap left filter history behind");
+        }
+    }
+    silence.assign(4096, {});
+    (void)reference.process(silence);
+    // A tone the mixer brings to DC, whose output phase is the mixer's.
+    SampleVector tone(32768);
+    for (std::size_t index = 0; index < tone.size(); ++index) {
+        const double phase = kTwoPi * -config.shiftHz *
+                             static_cast<double>(index) / inputRate;
+        tone[index] = {0.5f * static_cast<float>(std::cos(phase)),
+                       0.5f * static_cast<float>(std::sin(phase))};
+    }
+    auto referenceTone = tone;
+    const auto resumed = skipped.process(tone);
+    const auto continuous = reference.process(referenceTone);
+    if (resumed.empty() || resumed.size() != continuous.size() ||
+        std::abs(continuous.back()) < 0.1f ||
+        std::abs(resumed.back() - continuous.back()) > 1e-4f) {
+        throw std::runtime_error("skipGap did not advance the mixer phase");
+    }
+}
+
+template <typename Sample>
+SampleBuffer<Sample> runTemplatedChain(const std::vector<uint8_t> &payload) {
+    SampleBuffer<Sample> input;
+    convertToComplex(payload.data(), payload.size(), input);
+    BasicFrequencyShifter<Sample> shifter(768000.0, 10000.0);
+    BasicFirDecimator<Sample> stage1(8, 8 * 16, 0.45f / 8.0f);
+    BasicFirDecimator<Sample> stage2(5, 5 * 16, 0.45f / 5.0f);
+    BasicFirDecimator<Sample> stage3(5, 5 * 16, 0.45f / 5.0f);
+    shifter.mix(input);
+    return stage3.process(stage2.process(stage1.process(input)));
+}
+
+void testTemplatedChainsAgree() {
+    constexpr std::size_t sampleCount = 768000 / 10;
+    std::vector<std::complex<float>> samples(sampleCount);
+    std::mt19937 rng(11);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    for (std::size_t index = 0; index < sampleCount; ++index) {
+        const double phase = kTwoPi * -9000.0 * static_cast<double>(index) /
+                             768000.0;
+        samples[index] = {0.5f * static_cast<float>(std::cos(phase)) +
+                              noise(rng),
+                          0.5f * static_cast<float>(std::sin(phase)) +
+                              noise(rng)};
+    }
+    const auto payload = makeIqPayload(samples);
+
+    const auto reference = runTemplatedChain<cf64>(payload);
+    const auto single = runTemplatedChain<cf32>(payload);
+    const auto narrow = runTemplatedChain<ci16>(payload);
+    if (reference.size() != sampleCount / 200 ||
+        single.size() != reference.size() || narrow.size() != reference.size()) {
+        throw std::runtime_error("Templated chains output count mismatch");
+    }
+
+    double signal = 0.0;
+    double singleError = 0.0;
+    double narrowError = 0.0;
+    for (std::size_t index = 0; index < reference.size(); ++index) {
+        const cf64 narrowValue{narrow[index].i / 32767.0,
+                               narrow[index].q / 32767.0};
+        signal += std::norm(reference[index]);
+        singleError += std::norm(static_cast<cf64>(single[index]) -
+                                 reference[index]);
+        narrowError += std::norm(narrowValue - reference[index]);
+    }
+    const double singleSnrDb = 10.0 * std::log10(signal / singleError);
+    const double narrowSnrDb = 10.0 * std::log10(signal / narrowError);
+    if (singleSnrDb < 100.0) {
+        throw std::runtime_error("cf32 chain deviates from cf64 reference");
+    }
+    if (narrowSnrDb < 60.0) {
+        throw std::runtime_error("ci16 chain deviates from cf64 reference");
+    }
+}
+
 void testTimestampEncoderMonotonicStep() {
     TimestampEncoder encoder(1000.0);
 
@@ -685,6 +2563,90 @@ void testPulseSurvivesShiftAndDecimation() {
     }
 }
 
+// The IIR stage-1 engine against the FIR cascade: the same pulse comes
+// out at the same place with the same energy, and a tone that aliases
+// into the channel after stage 1 is rejected at least as well.
+void testIirStage1MatchesFirPulseAndRejectsAliases() {
+    constexpr double inputRateHz = 768000.0;
+    constexpr double pulseStartSeconds = 0.25;
+    constexpr double pulseWidthSeconds = 0.015;
+    const auto run = [&](Stage1Engine engine, double toneHz,
+                         bool pulsed) -> SampleVector {
+        PipelineConfig config;
+        config.inputRate = inputRateHz;
+        config.shiftHz = 0.0;
+        config.stage1Engine = engine;
+        DecimationPipeline pipeline(config);
+        SampleVector output;
+        SampleVector block(16384);
+        for (std::size_t start = 0;
+             start < static_cast<std::size_t>(inputRateHz);
+             start += block.size()) {
+            for (std::size_t index = 0; index < block.size(); ++index) {
+                const double seconds =
+                    static_cast<double>(start + index) / inputRateHz;
+                const bool on =
+                    !pulsed || (seconds >= pulseStartSeconds &&
+                                seconds < pulseStartSeconds + pulseWidthSeconds);
+                block[index] =
+                    on ? std::polar(0.7f, static_cast<float>(std::fmod(
+                                              kTwoPi * toneHz * seconds,
+                                              kTwoPi)))
+                       : std::complex<float>{};
+            }
+            const SampleVector &decimated = pipeline.process(block);
+            output.insert(output.end(), decimated.begin(), decimated.end());
+        }
+        return output;
+    };
+    const auto energy = [](const SampleVector &samples, std::size_t skip) {
+        double sum = 0.0;
+        for (std::size_t index = skip; index < samples.size(); ++index) {
+            sum += std::norm(samples[index]);
+        }
+        return sum;
+    };
+    // The first sample at half the peak power: the pulse's rising edge.
+    const auto edgeIndex = [](const SampleVector &samples) {
+        float peak = 0.0f;
+        for (const auto &sample : samples) {
+            peak = std::max(peak, std::norm(sample));
+        }
+        std::size_t index = 0;
+        while (std::norm(samples[index]) < 0.5f * peak) {
+            ++index;
+        }
+        return index;
+    };
+
+    const SampleVector firPulse = run(Stage1Engine::Fir, 500.0, true);
+    const SampleVector iirPulse = run(Stage1Engine::Iir, 500.0, true);
+    if (firPulse.size() != iirPulse.size()) {
+        throw std::runtime_error("IIR stage 1 changed the output count");
+    }
+    const double energyRatioDb =
+        10.0 * std::log10(energy(iirPulse, 0) / energy(firPulse, 0));
+    const std::size_t firEdge = edgeIndex(firPulse);
+    const std::size_t iirEdge = edgeIndex(iirPulse);
+    // Measured 0.0004 dB and one output sample of extra group delay.
+    if (std::abs(energyRatioDb) > 0.001 ||
+        std::max(firEdge, iirEdge) - std::min(firEdge, iirEdge) > 1) {
+        throw std::runtime_error("IIR stage 1 pulse differs from FIR: " +
+                                 std::to_string(energyRatioDb) + " dB");
+    }
+
+    // 96 kHz + 500 Hz lands on the pulse's 500 Hz after stage 1.
+    const std::size_t settle = 64;
+    const double inBand = energy(run(Stage1Engine::Iir, 500.0, false), settle);
+    const double firAlias =
+        energy(run(Stage1Engine::Fir, 96500.0, false), settle);
+    const double iirAlias =
+        energy(run(Stage1Engine::Iir, 96500.0, false), settle);
+    if (10.0 * std::log10(iirAlias / inBand) > -90.0 || iirAlias > firAlias) {
+        throw std::runtime_error("IIR stage 1 alias rejection is too low");
+    }
+}
+
 void testNoisyPulseSurvivesShiftAndDecimation() {
     constexpr double inputRateHz = 768000.0;
     constexpr double rfCenterHz = 145990000.0;
@@ -813,6 +2775,15 @@ int main() {
         {"parseArgs defaults", testParseArgsDefaults},
         {"parseArgs custom", testParseArgsCustom},
         {"parseArgs validation", testParseArgsValidation},
+        {"parseArgs spectrum options", testParseArgsSpectrumOptions},
+        {"parseArgs channels", testParseArgsChannels},
+        {"NUMA topology from sysfs", testNumaTopologyFromSysfs},
+        {"UdpStreamer per-destination counters",
+         testUdpStreamerPerDestinationCounters},
+        {"Per-port frames share one ring", testPerPortFramesShareOneRing},
+        {"UDP TX timestamp latency histogram",
+         testUdpTxTimestampLatencyHistogram},
+        {"FTZ/DAZ propagates to pools", testFlushDenormalsPropagatesToPools},
         {"designLowpass normalization", testDesignLowpassNormalization},
         {"convertToComplex little-endian", testConvertToComplexLittleEndian},
         {"FrequencyShifter zero-shift", testFrequencyShifterZeroShiftNoop},
@@ -822,7 +2793,48 @@ int main() {
         {"parseZmqFrame malformed", testParseZmqFrameMalformed},
         {"Zmq receiver malformed accounting",
          testZmqReceiverMalformedFrameAccounting},
+        {"Zmq receiver link events and restart",
+         testZmqReceiverLinkEventsAndRestart},
+        {"SequenceTracker wraparound", testSequenceTrackerWraparound},
+        {"StreamMerger aligns by timestamp", testStreamMergerAlignsByTimestamp},
+        {"StreamMerger restarts a retuned stream",
+         testStreamMergerRestartsRetunedStream},
+        {"Shard coordinator assigns and rebalances",
+         testShardCoordinatorAssignsAndRebalances},
+        {"PacketArena reuse", testPacketArenaReuse},
+        {"Zmq receiver multipart combine", testZmqReceiverMultipartCombine},
+        {"Zmq receiver shared context inproc",
+         testZmqReceiverSharedContextInproc},
         {"FirDecimator output count", testFirDecimatorOutputCount},
+        {"AlignedAllocator alignment", testAlignedAllocatorAlignment},
+        {"MirroredRing aliasing", testMirroredRingAliasing},
+        {"FirDecimator matches direct convolution",
+         testFirDecimatorMatchesDirectConvolution},
+        {"Segmented stage 1 matches sequential",
+         testSegmentedStage1MatchesSequential},
+        {"Parallel stage 1 pipeline bit-exact",
+         testParallelStage1PipelineBitExact},
+        {"FrameAssembler contiguous frames",
+         testFrameAssemblerContiguousFrames},
+        {"Templated cf32/cf64/ci16 chains agree", testTemplatedChainsAgree},
+        {"Fixed-point chain SNR vs float", testFixedPointChainSnrVersusFloat},
+        {"IntegerNcoShifter sign convention", testIntegerNcoMatchesFloatShift},
+        {"SaturatingQ15 full scale", testSaturatingQ15FullScale},
+        {"FirDecimator checkpoint continuity",
+         testFirDecimatorCheckpointContinuity},
+        {"Checkpoint file round trip", testCheckpointFileRoundTrip},
+        {"Resume gap accounting", testResumeGapOutputSamples},
+        {"Packet flags blank and restart", testPacketFlagsBlankAndRestart},
+        {"Drift compensation locks to reference clock",
+         testDriftCompensationLocksToReferenceClock},
+        {"IIR stage 1 matches FIR pulse and rejects aliases",
+         testIirStage1MatchesFirPulseAndRejectsAliases},
+        {"C API matches pipeline", testCApiMatchesPipeline},
+        {"Work stealing preserves channel order",
+         testWorkStealingPreservesChannelOrder},
+        {"TaskStrand rethrows job errors", testTaskStrandRethrows},
+        {"WelchAverager tone peak", testWelchAveragerTonePeak},
+        {"Spectrum packet layout", testEncodeSpectrumPacketLayout},
         {"TimestampEncoder monotonic step", testTimestampEncoderMonotonicStep},
         {"Timestamp matches uavrt_detection format",
          testTimestampMatchesUavrtDetectionFormat},